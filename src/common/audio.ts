@@ -363,6 +363,126 @@ export var WorkerSoundChannel = function(worker) {
 
 }
 
+// SampleRing
+
+// single-producer/single-consumer ring of samples in a SharedArrayBuffer,
+// so the emulator (main thread or worker) can feed an AudioWorklet without locks
+// layout: Int32 write index, Int32 read index (both free-running), then Float32 samples
+export class SampleRing {
+  buffer : SharedArrayBuffer;
+  idx : Int32Array;
+  data : Float32Array;
+  mask : number;
+  w : number;         // local copy of write index
+  dropped : number = 0;
+
+  constructor(bufferOrSize : SharedArrayBuffer | number) {
+    if (typeof bufferOrSize === 'number') {
+      // size must be a power of 2
+      bufferOrSize = new SharedArrayBuffer(8 + bufferOrSize * 4);
+    }
+    this.buffer = bufferOrSize;
+    this.idx = new Int32Array(this.buffer, 0, 2);
+    this.data = new Float32Array(this.buffer, 8);
+    this.mask = this.data.length - 1;
+    this.w = Atomics.load(this.idx, 0);
+  }
+  // SharedArrayBuffer needs a cross-origin isolated page (COOP/COEP headers, see README)
+  static isSupported() : boolean {
+    return typeof SharedArrayBuffer !== 'undefined' && typeof Atomics !== 'undefined'
+      && (typeof crossOriginIsolated === 'undefined' || crossOriginIsolated);
+  }
+  push(value : number) {
+    var w = this.w;
+    if (((w - Atomics.load(this.idx, 1)) | 0) > this.mask) {
+      this.dropped++; // consumer isn't keeping up (or is suspended)
+      return;
+    }
+    this.data[w & this.mask] = value;
+    this.w = w = (w + 1) | 0;
+    Atomics.store(this.idx, 0, w);
+  }
+  available() : number {
+    return (this.w - Atomics.load(this.idx, 1)) | 0;
+  }
+}
+
+// feeds a SampleRing from a machine (e.g. in a worker), resampling like SampleAudio
+export class SampleRingSink implements SampledAudioSink {
+  ring : SampleRing;
+  sinc : number;
+  sfrac = 0;
+  accum = 0;
+
+  constructor(ring : SampleRing, clockfreq : number, outputRate : number) {
+    this.ring = ring;
+    this.sinc = outputRate / clockfreq;
+  }
+  feedSample(value : number, count : number) {
+    this.accum += value * count;
+    this.sfrac += this.sinc * count;
+    if (this.sfrac >= 1) {
+      this.accum /= this.sfrac;
+      while (this.sfrac >= 1) {
+        this.ring.push(this.accum * this.sinc);
+        this.sfrac -= 1;
+      }
+      this.accum *= this.sfrac;
+    }
+  }
+}
+
+// AudioWorklet side of SampleRing, kept as source text so it can be loaded from a Blob
+// (bundling would pull in helpers from outside the worklet scope)
+// keeps the fill level near a target by resampling up to 0.5% faster or slower,
+// skips ahead if far behind (e.g. after a pause), holds the last sample on underrun
+const SAMPLE_RING_WORKLET = `
+class SampleRingProcessor extends AudioWorkletProcessor {
+  constructor(options) {
+    super();
+    var buf = options.processorOptions.buffer;
+    this.idx = new Int32Array(buf, 0, 2);
+    this.data = new Float32Array(buf, 8);
+    this.mask = this.data.length - 1;
+    this.target = options.processorOptions.target;
+    this.frac = 0;
+    this.last = 0;
+  }
+  process(inputs, outputs) {
+    var out = outputs[0][0];
+    var w = Atomics.load(this.idx, 0);
+    var r = Atomics.load(this.idx, 1);
+    var avail = (w - r) | 0;
+    if (avail > this.target * 3) {
+      r = (w - this.target) | 0;
+      avail = this.target;
+    }
+    var ratio = 1 + Math.max(-0.005, Math.min(0.005, (avail - this.target) * 0.01 / this.target));
+    var frac = this.frac;
+    var data = this.data, mask = this.mask;
+    for (var i = 0; i < out.length; i++) {
+      if (avail < 2) {
+        out[i] = this.last;
+        continue;
+      }
+      var a = data[r & mask];
+      var b = data[(r + 1) & mask];
+      out[i] = this.last = a + (b - a) * frac;
+      frac += ratio;
+      while (frac >= 1) {
+        frac -= 1;
+        r = (r + 1) | 0;
+        avail--;
+      }
+    }
+    this.frac = frac;
+    Atomics.store(this.idx, 1, r);
+    return true;
+  }
+}
+registerProcessor('sample-ring', SampleRingProcessor);
+`;
+
 // SampleAudio
 
 export var SampleAudio = function(clockfreq) {
@@ -414,7 +534,20 @@ export var SampleAudio = function(clockfreq) {
     self.filterNode.frequency.value=100;
     self.filterNode.gain.value=-6;
 
+    // compressor for a bit of volume boost, helps with multich tunes
+    self.compressorNode=self.context.createDynamicsCompressor();
+    self.filterNode.connect(self.compressorNode);
+    self.compressorNode.connect(self.context.destination);
+
     // mixer
+    if (ctx.audioWorklet && SampleRing.isSupported()) {
+      createWorkletMixer();
+    } else {
+      createScriptMixer();
+    }
+  }
+
+  function createScriptMixer() {
     if ( typeof self.context.createScriptProcessor === 'function') {
       self.mixerNode=self.context.createScriptProcessor(self.bufferlen, 1, 1);
     } else {
@@ -424,13 +557,49 @@ export var SampleAudio = function(clockfreq) {
     self.mixerNode.module=self;
     self.mixerNode.onaudioprocess=mix;
 
-    // compressor for a bit of volume boost, helps with multich tunes
-    self.compressorNode=self.context.createDynamicsCompressor();
-
     // patch up some cables :)
     self.mixerNode.connect(self.filterNode);
-    self.filterNode.connect(self.compressorNode);
-    self.compressorNode.connect(self.context.destination);
+    createBuffers();
+  }
+
+  function createBuffers() {
+    bufpos = 0;
+    bufferlist = [];
+    idrain = 1;
+    ifill = 0;
+    for (var i=0; i<nbuffers; i++) {
+      var arrbuf = new ArrayBuffer(self.bufferlen*4);
+      bufferlist[i] = new Float32Array(arrbuf);
+    }
+    buffer = bufferlist[0];
+  }
+
+  // samples go through a shared ring to an AudioWorklet, no main thread callbacks
+  // (the ring fills up until the worklet is loaded, then ringReady is set)
+  function createWorkletMixer() {
+    var ctx : AudioContext = self.context;
+    // about two frames of latency, the emulator produces a frame's worth at a time
+    var target = Math.ceil(self.sr / 30);
+    self.ring = new SampleRing(8192);
+    var url = URL.createObjectURL(new Blob([SAMPLE_RING_WORKLET], {type:'application/javascript'}));
+    ctx.audioWorklet.addModule(url).then(() => {
+      if (self.context !== ctx) return; // closed meanwhile
+      self.mixerNode = new AudioWorkletNode(ctx, 'sample-ring', {
+        numberOfInputs: 0,
+        outputChannelCount: [1],
+        processorOptions: { buffer: self.ring.buffer, target: target }
+      });
+      self.mixerNode.connect(self.filterNode);
+      self.ringReady = true;
+      self.onready && self.onready();
+    }).catch((e) => {
+      console.log("could not load audio worklet, using ScriptProcessor", e);
+      if (self.context !== ctx) return;
+      self.ring = null;
+      createScriptMixer();
+    }).finally(() => {
+      URL.revokeObjectURL(url);
+    });
   }
 
   this.start = function() {
@@ -446,15 +615,6 @@ export var SampleAudio = function(clockfreq) {
     sinc = this.sr * 1.0 / clockfreq;
     sfrac = 0;
     accum = 0;
-    bufpos = 0;
-    bufferlist = [];
-    idrain = 1;
-    ifill = 0;
-    for (var i=0; i<nbuffers; i++) {
-      var arrbuf = new ArrayBuffer(self.bufferlen*4);
-      bufferlist[i] = new Float32Array(arrbuf);
-    }
-    buffer = bufferlist[0];
   }
   
   this.stop = function() {
@@ -466,10 +626,16 @@ export var SampleAudio = function(clockfreq) {
     if (this.context) {
       this.context.close();
       this.context = null;
+      this.ring = null;
+      this.ringReady = false;
     }
   }
 
   this.addSingleSample = function(value) {
+    if (this.ring) {
+      this.ring.push(value);
+      return;
+    }
     if (!buffer) return;
     buffer[bufpos++] = value;
     if (bufpos >= buffer.length) {
@@ -516,6 +682,17 @@ export class SampledAudio {
   stop() {
     this.sa.stop();
   }
+  // only once mixing through an AudioWorklet, null if it couldn't be loaded
+  getRing() : SampleRing {
+    return (this.sa.ringReady && this.sa.ring) || null;
+  }
+  // called when getRing() starts returning the ring
+  set onRingReady(fn : () => void) {
+    this.sa.onready = fn;
+  }
+  getOutputRate() : number {
+    return this.sa.sr;
+  }
 }
 
 interface TssChannel {
@@ -1,5 +1,5 @@
 
-import { RasterVideo, dumpRAM, AnimationTimer, ControllerPoller, drawCrosshair } from "./emu";
+import { RasterVideo, dumpRAM, AnimationTimer, ControllerPoller, drawCrosshair, EmuHalt } from "./emu";
 import { hex, printFlags, invertMap, byteToASCII } from "./util";
 import { CodeAnalyzer } from "./analysis";
 import { Segment, FileData } from "./workertypes";
@@ -8,9 +8,11 @@ import { disassembleZ80 } from "./cpu/disasmz80";
 import { Z80 } from "./cpu/ZilogZ80";
 
 import { Bus, Resettable, FrameBased, VideoSource, SampledAudioSource, AcceptsROM, AcceptsBIOS, AcceptsKeyInput, SavesState, SavesInputState, HasCPU, HasSerialIO, SerialIOInterface, AcceptsJoyInput } from "./devices";
-import { Probeable, RasterFrameBased, AcceptsPaddleInput } from "./devices";
+import { Probeable, ProbeAll, RasterFrameBased, AcceptsPaddleInput } from "./devices";
 import { SampledAudio } from "./audio";
 import { ProbeRecorder } from "./probe";
+import { UndoLog, isRAMIn } from "./undolog";
+import { MachineWorkerCommand, MachineWorkerResult, WorkerMachineSpec } from "./machineworker";
 import { BaseWASMMachine } from "./wasmplatform";
 import { CPU6809 } from "./cpu/6809";
 import { _MOS6502 } from "./cpu/MOS6502";
@@ -111,6 +113,7 @@ export interface Platform {
   runUntilReturn?() : void;
   stepBack?() : void;
   runEval?(evalfunc : DebugEvalCondition) : void;
+  runEvalBackward?(evalfunc : DebugEvalCondition) : void;
   runToFrameClock?(clock : number) : void;
   stepOver?() : void;
   restartAtPC?(pc:number) : boolean;
@@ -125,6 +128,7 @@ export interface Platform {
   getMemoryMap?() : MemoryMap;
 
   setRecorder?(recorder : EmuRecorder) : void;
+  requestState?() : void; // views showing the machine ask for it while it runs elsewhere
   advance?(novideo? : boolean) : number;
   advanceFrameClock?(trap:DebugCondition, step:number) : number;
   showHelp?() : string;
@@ -175,28 +179,74 @@ export type BreakpointCallback = (s:EmuState, msg?:string) => void;
 // for composite breakpoints w/ single debug function
 export class BreakpointList {
   id2bp : {[id:string] : Breakpoint} = {};
-  getDebugCondition() : DebugCondition {
-    if (Object.keys(this.id2bp).length == 0) {
-      return null; // no breakpoints
-    } else {
-      // evaluate all breakpoints
-      return () => {
-        var result = false;
-        for (var id in this.id2bp)
-          if (this.id2bp[id].cond())
-            result = true;
-        return result;
-      };
+  compiled : DebugCondition = undefined; // cached until breakpoints change
+
+  set(id : string, bp : Breakpoint) {
+    this.id2bp[id] = bp;
+    this.compiled = undefined;
+  }
+  remove(id : string) {
+    delete this.id2bp[id];
+    this.compiled = undefined;
+  }
+  // getPC returns -1 between instructions, hitPC is called when a PC breakpoint fires
+  getDebugCondition(getPC? : () => number, hitPC? : () => void) : DebugCondition {
+    if (this.compiled === undefined) {
+      this.compiled = this.compile(getPC, hitPC);
     }
+    return this.compiled;
+  }
+  compile(getPC : () => number, hitPC : () => void) : DebugCondition {
+    var conds : DebugCondition[] = [];
+    var pcs : number[] = [];
+    for (var id in this.id2bp) {
+      var bp = this.id2bp[id];
+      if (bp.pc != null && getPC) pcs.push(bp.pc);
+      if (bp.cond) conds.push(bp.cond);
+    }
+    // evaluate all conditions (they may have side effects, e.g. counting clocks)
+    var cond : DebugCondition;
+    switch (conds.length) {
+      case 0: cond = null; break;
+      case 1: cond = conds[0]; break;
+      case 2: {
+        let [c0, c1] = conds;
+        cond = () => { var r0 = c0(); var r1 = c1(); return r0 || r1; };
+        break;
+      }
+      default:
+        cond = () => {
+          var result = false;
+          for (var i = 0; i < conds.length; i++)
+            if (conds[i]()) result = true;
+          return result;
+        };
+    }
+    if (pcs.length == 0) return cond;
+    // PC breakpoints, one bit per address
+    var bits = new Uint8Array(Math.max(...pcs) + 1);
+    for (var pc of pcs) bits[pc] = 1;
+    return () => {
+      var result = cond != null && cond();
+      var pc = getPC();
+      if (!result && pc >= 0 && bits[pc]) {
+        hitPC && hitPC();
+        result = true;
+      }
+      return result;
+    };
   }
 }
 export interface Breakpoint {
-  cond: DebugCondition;
+  cond?: DebugCondition; // break when true (evaluated each step)
+  pc?: number; // or break before executing this address
 };
 
 export interface EmuRecorder {
   frameRequested() : boolean;
   recordFrame(state : EmuState);
+  checkpointInterval? : number; // frameRequested() is true every n frames
+  numFrames?() : number;
 }
 
 /////
@@ -253,20 +303,27 @@ export abstract class BaseDebugPlatform extends BasePlatform {
 
   setBreakpoint(id : string, cond : DebugCondition) {
     if (cond) {
-      this.breakpoints.id2bp[id] = {cond:cond};
+      this.breakpoints.set(id, {cond:cond});
       this.restartDebugging();
     } else {
       this.clearBreakpoint(id);
     }
   }
+  setPCBreakpoint(id : string, pc : number, cond? : DebugCondition) {
+    this.breakpoints.set(id, {pc:pc, cond:cond});
+    this.restartDebugging();
+  }
   clearBreakpoint(id : string) {
-    delete this.breakpoints.id2bp[id];
+    this.breakpoints.remove(id);
   }
   hasBreakpoint(id : string) {
     return this.breakpoints.id2bp[id] != null;
   }
   getDebugCallback() : DebugCondition {
-    return this.breakpoints.getDebugCondition();
+    // like runUntil(), PC breakpoints don't fire before the target clock
+    return this.breakpoints.getDebugCondition(
+      () => (this.debugClock >= this.debugTargetClock && this.isStable()) ? this.getPC() : -1,
+      () => this.breakpointHit(this.debugClock));
   }
   setupDebug(callback : BreakpointCallback) : void {
     this.onBreakpointHit = callback;
@@ -353,10 +410,13 @@ export abstract class BaseDebugPlatform extends BasePlatform {
     this.breakpointHit(this.debugClock, reason);
   }
   runEval(evalfunc : DebugEvalCondition) {
+    this.runUntil(() => evalfunc(this.getCPUState()));
+  }
+  // like runEval(), but cond fetches only what it needs (no CPU state per step)
+  runUntil(cond : () => boolean) {
     this.setDebugCondition( () => {
       if (++this.debugClock >= this.debugTargetClock && this.isStable()) {
-        var cpuState = this.getCPUState();
-        if (evalfunc(cpuState)) {
+        if (cond()) {
           this.breakpointHit(this.debugClock);
           return true;
         } else {
@@ -367,20 +427,22 @@ export abstract class BaseDebugPlatform extends BasePlatform {
   }
   runToPC(pc: number) {
     this.debugTargetClock++;
-    this.runEval((c) => {
-      return c.PC == pc;
+    // the breakpoint list checks the PC, this only counts clocks
+    this.setPCBreakpoint('debug', pc, () => {
+      ++this.debugClock;
+      return false;
     });
   }
   runUntilReturn() {
     var SP0 = this.getSP();
-    this.runEval( (c:CpuState) : boolean => {
-      return c.SP > SP0; // TODO: check for RTS/RET opcode
+    this.runUntil( () : boolean => {
+      return this.getSP() > SP0; // TODO: check for RTS/RET opcode
     });
   }
   runToFrameClock(clock : number) : void {
     this.restartDebugging();
     this.debugTargetClock = clock;
-    this.runEval(() : boolean => { return true; });
+    this.runUntil(() : boolean => { return true; });
   }
   step() {
     this.runToFrameClock(this.debugClock+1);
@@ -391,7 +453,7 @@ export abstract class BaseDebugPlatform extends BasePlatform {
     var clock0 = this.debugTargetClock;
     this.restartDebugging();
     this.debugTargetClock = clock0 - 25; // TODO: depends on CPU
-    this.runEval( (c:CpuState) : boolean => {
+    this.runUntil( () : boolean => {
       if (this.debugClock < clock0) {
         prevState = this.saveState();
         prevClock = this.debugClock;
@@ -405,10 +467,34 @@ export abstract class BaseDebugPlatform extends BasePlatform {
       }
     });
   }
+  // reverse continue: back to the last step in this frame where evalfunc is true,
+  // or stay put if there isn't one
+  runEvalBackward(evalfunc : DebugEvalCondition) {
+    var foundState;
+    var foundClock;
+    var clock0 = this.debugTargetClock;
+    this.restartDebugging();
+    this.debugTargetClock = 0;
+    this.runUntil( () : boolean => {
+      if (this.debugClock < clock0) {
+        if (evalfunc(this.getCPUState())) {
+          foundState = this.saveState();
+          foundClock = this.debugClock;
+        }
+        return false;
+      } else {
+        if (foundState) {
+          this.loadState(foundState);
+          this.debugClock = foundClock;
+        }
+        return true;
+      }
+    });
+  }
   runToVsync() {
     this.restartDebugging();
     var frame0 = this.frameCount;
-    this.runEval( () : boolean => {
+    this.runUntil( () : boolean => {
       return this.frameCount > frame0;
     });
   }
@@ -775,28 +861,51 @@ export abstract class BaseMachinePlatform<T extends Machine> extends BaseDebugPl
   probeRecorder : ProbeRecorder;
   startProbing;
   stopProbing;
+  probing = false;
+  undoLog : UndoLog; // only if machine has readConst() and platform has a memory map
+  undoRecording = false; // only single steps are logged, not runs to a breakpoint
+  connectedProbe : ProbeAll = null;
+  // running in a worker (options=worker), the machine here mirrors it
+  workerMachine : WorkerMachineSpec; // set by platforms that support it
+  useWorker = false;
+  worker : Worker;
+  workerROM : {title:string, data:Uint8Array}; // sent when the worker starts
+  workerBIOS : {title:string, data:Uint8Array};
+  workerGen = 0;
+  workerRunning = false;
+  workerStateRequested = false;
+  workerStopping = false; // waiting for the state the worker stopped at
+  useJIT = false; // compile CPU code to JS (options=jit), if the machine supports it
 
   abstract newMachine() : T;
   abstract getToolForFilename(s:string) : string;
   abstract getDefaultExtension() : string;
   abstract getPresets() : Preset[];
   
-  constructor(mainElement : HTMLElement) {
+  constructor(mainElement : HTMLElement, options? : {}) {
     super();
     this.mainElement = mainElement;
+    this.useWorker = options != null && options['worker'] != null;
+    this.useJIT = options != null && options['jit'] != null;
   }
 
   reset() {
     this.machine.reset();
     if (this.serialVisualizer != null) this.serialVisualizer.reset();
+    // the machine here may be some frames behind the worker's
+    this.workerStopping = false;
+    if (this.workerRunning) this.postWorkerGen({reset: true});
   }
-  loadState(s)   { this.machine.loadState(s); }
+  loadState(s)   { this.machine.loadState(s); this.syncWorker(); }
   saveState()    { return this.machine.saveState(); }
   getSP()        { return this.machine.cpu.getSP(); }
   getPC()        { return this.machine.cpu.getPC(); }
   isStable() 	 { return this.machine.cpu.isStable(); }
   getCPUState()  { return this.machine.cpu.saveState(); }
-  loadControlsState(s)   { this.machine.loadControlsState(s); }
+  loadControlsState(s) {
+    this.machine.loadControlsState(s);
+    if (this.workerRunning) this.postToWorker({controls: s});
+  }
   saveControlsState()    { return this.machine.saveControlsState(); }
   
   async start() {
@@ -806,6 +915,9 @@ export abstract class BaseMachinePlatform<T extends Machine> extends BaseDebugPl
     if (m instanceof BaseWASMMachine) {
       await m.loadWASM();
     }
+    if (this.useJIT && m['enableJIT']) {
+      m['enableJIT'](true);
+    }
     var videoFrequency;
     if (hasVideo(m)) {
       var vp = m.getVideoParams();
@@ -817,8 +929,8 @@ export abstract class BaseMachinePlatform<T extends Machine> extends BaseDebugPl
       m.connectVideo(this.video.getFrameData());
       // TODO: support keyboard w/o video?
       if (hasKeyInput(m)) {
-        this.video.setKeyboardEvents(m.setKeyInput.bind(m));
-        this.poller = new ControllerPoller(m.setKeyInput.bind(m));
+        this.video.setKeyboardEvents(this.sendKeyInput.bind(this));
+        this.poller = new ControllerPoller(this.sendKeyInput.bind(this));
       }
       videoFrequency = vp.videoFrequency;
     }
@@ -826,6 +938,8 @@ export abstract class BaseMachinePlatform<T extends Machine> extends BaseDebugPl
     if (hasAudio(m)) {
       var ap = m.getAudioParams();
       this.audio = new SampledAudio(ap.sampleRate);
+      // the worker can only take over once the worklet's ring is there
+      this.audio.onRingReady = () => { if (this.useWorker && this.isRunning()) this.resume(); };
       this.audio.start();
       m.connectAudio(this.audio);
     }
@@ -835,16 +949,24 @@ export abstract class BaseMachinePlatform<T extends Machine> extends BaseDebugPl
     if (hasProbe(m)) {
       this.probeRecorder = new ProbeRecorder(m);
       this.startProbing = () => {
-        m.connectProbe(this.probeRecorder);
+        this.probing = true;
+        this.updateProbe(this.connectedProbe === this.undoLog);
         return this.probeRecorder;
       };
       this.stopProbing = () => {
-        m.connectProbe(null);
+        this.probing = false;
+        this.updateProbe(this.connectedProbe === this.undoLog);
       };
+      var memmap = this.getMemoryMap && this.getMemoryMap();
+      if (typeof m['readConst'] === 'function' && memmap && memmap['main']) {
+        this.undoLog = new UndoLog(m, () => this.debugClock, isRAMIn(memmap['main']));
+      }
     }
     if (hasBIOS(m)) {
       this.loadBIOS = (title, data) => {
         m.loadBIOS(data, title);
+        this.workerBIOS = {title, data};
+        if (this.worker) this.postToWorker({bios: this.workerBIOS});
       };
     }
     if (hasSerialIO(m)) {
@@ -854,13 +976,125 @@ export abstract class BaseMachinePlatform<T extends Machine> extends BaseDebugPl
         m.connectSerialIO(this.serialIOInterface);
       }
     }
+    // the worker starts on resume(), once the audio context exists
+    this.useWorker = this.useWorker && this.workerMachine != null && this.video != null
+      && !hasSerialIO(m) && typeof OffscreenCanvas !== 'undefined';
   }
 
   loadROM(title, data) {
     this.machine.loadROM(data, title);
+    this.workerROM = {title, data};
+    if (this.worker) this.postToWorker({rom: this.workerROM});
     this.reset();
   }
 
+  sendKeyInput(key : number, code : number, flags : number) {
+    (this.machine as any as AcceptsKeyInput).setKeyInput(key, code, flags);
+    if (this.workerRunning) this.postToWorker({key: [key, code, flags]});
+  }
+
+  // audio must go through a shared ring, so it needs cross-origin isolation
+  canStartWorker() {
+    return this.useWorker && !this.worker && (!this.audio || this.audio.getRing() != null);
+  }
+  startWorker() {
+    var ring = this.audio && this.audio.getRing();
+    this.worker = new Worker("./gen/machineworker.js");
+    this.worker.onmessage = (e) => this.receiveFromWorker(e.data);
+    // couldn't load, run here instead
+    this.worker.onerror = (e) => {
+      console.log("machine worker failed", e.message);
+      var running = this.workerRunning;
+      this.workerRunning = false;
+      this.worker.terminate();
+      this.worker = null;
+      this.useWorker = false;
+      if (running) this.timer.start();
+    };
+    this.postToWorker({
+      init: {
+        machine: this.workerMachine,
+        frameRate: this.timer.frameRate,
+        audio: ring && {buffer: ring.buffer, sampleRate: this.audio.getOutputRate()}
+      },
+      bios: this.workerBIOS,
+      rom: this.workerROM
+    });
+  }
+  postToWorker(cmd : Partial<MachineWorkerCommand>) {
+    cmd.gen = this.workerGen;
+    this.worker.postMessage(cmd);
+  }
+  // frames it sent before are dropped, and it counts frames to checkpoints from here
+  postWorkerGen(cmd : Partial<MachineWorkerCommand>) {
+    this.workerGen++;
+    this.workerStateRequested = false;
+    this.postToWorker({...cmd, checkpoints: this.getWorkerCheckpoints()});
+  }
+  // the frames the worker sends its state with, so the recorder gets it
+  getWorkerCheckpoints() {
+    var r = this.recorder;
+    var n = (r && r.numFrames && r.checkpointInterval) || 0;
+    return {every: n, next: n && (n - r.numFrames() % n) % n};
+  }
+  // send the machine state to the worker
+  syncWorker() {
+    this.workerStopping = false; // this state is newer than the one the worker stops at
+    if (this.workerRunning) {
+      this.postWorkerGen({state: this.machine.saveState(), controls: this.machine.saveControlsState()});
+    }
+  }
+  // the worker sends back the state it stopped at
+  stopWorker() {
+    if (this.workerRunning) {
+      this.workerRunning = false;
+      this.workerStopping = true;
+      this.postWorkerGen({run: false});
+    }
+  }
+  requestState() {
+    if (this.workerRunning && !this.workerStateRequested) {
+      this.workerStateRequested = true;
+      this.postToWorker({sendState: true});
+    }
+  }
+  setRecorder(recorder : EmuRecorder) {
+    super.setRecorder(recorder);
+    if (this.workerRunning) this.postWorkerGen({});
+  }
+  receiveFromWorker(result : MachineWorkerResult) {
+    if (result.gen != this.workerGen) {
+      result.frame && result.frame.close();
+      return;
+    }
+    if (!this.workerRunning) {
+      if (this.workerStopping && result.state) {
+        this.machine.loadState(result.state);
+        this.workerStopping = false;
+      }
+      result.frame && result.frame.close();
+      return;
+    }
+    if (result.state) {
+      this.machine.loadState(result.state);
+      this.workerStateRequested = false;
+    }
+    if (result.frame) {
+      this.video.getContext().drawImage(result.frame, 0, 0);
+      result.frame.close();
+    }
+    if (result.error) {
+      this.pause();
+      throw new EmuHalt(result.error);
+    }
+    this.frameCount++;
+    this.updateRecorder();
+    this.pollControls();
+    if (hasPaddleInput(this.machine)) {
+      this.postToWorker({paddles: [this.video.paddle_x, this.video.paddle_y]});
+    }
+  }
+
   loadBIOS : (title, data) => void; // only set if hasBIOS() is true
 
   pollControls() {
@@ -875,8 +1109,25 @@ export abstract class BaseMachinePlatform<T extends Machine> extends BaseDebugPl
     }
   }
 
+  // probe recorder if probing, behind the undo log while debugging
+  updateProbe(debugging:boolean) {
+    if (!hasProbe(this.machine)) return;
+    var probe : ProbeAll = this.probing ? this.probeRecorder : null;
+    if (debugging && this.undoLog && this.undoRecording) {
+      // the replay from the start of the frame only needs its last steps
+      this.undoLog.minClock = this.debugTargetClock - this.undoLog.maxSteps;
+      this.undoLog.next = probe || this.undoLog.nullProbe;
+      probe = this.undoLog;
+    }
+    if (probe !== this.connectedProbe) {
+      this.machine.connectProbe(probe);
+      this.connectedProbe = probe;
+    }
+  }
+
   advance(novideo:boolean) {
     let trap = this.getDebugCallback();
+    this.updateProbe(trap != null);
     try {
       var steps = this.machine.advanceFrame(trap);
       return steps;
@@ -916,15 +1167,92 @@ export abstract class BaseMachinePlatform<T extends Machine> extends BaseDebugPl
   }
 
   isRunning() {
-    return this.timer && this.timer.isRunning();
+    return this.workerRunning || (this.timer && this.timer.isRunning());
+  }
+
+  resetDebugging() {
+    super.resetDebugging();
+    this.undoLog?.clear();
+  }
+  preFrame() {
+    // debug clocks are rewound, so the log can't go back past here
+    if (this.debugCallback && !this.debugBreakState) {
+      this.undoLog?.clear();
+    }
+    super.preFrame();
+  }
+  breakpointHit(targetClock : number, reason? : string) {
+    this.undoLog?.seal();
+    super.breakpointHit(targetClock, reason);
+  }
+  // undo the last instruction from the undo log, false if it isn't there or can't be undone
+  undoStep() : boolean {
+    var log = this.undoLog;
+    if (!log || !this.debugBreakState || this.isRunning()) return false;
+    var clock = log.peekClock();
+    if (clock < 0 || clock >= this.debugClock) return false;
+    var step = log.undo();
+    if (!step) return false;
+    this.debugClock = step.clock;
+    return true;
+  }
+  // every debug run starts here, step() and stepBack() turn recording back on
+  restartDebugging() {
+    this.undoRecording = false;
+    super.restartDebugging();
+  }
+  step() {
+    super.step();
+    this.undoRecording = true;
+  }
+  stepBack() {
+    if (this.undoStep()) {
+      this.breakpointHit(this.debugClock);
+    } else {
+      super.stepBack(); // replays from the saved frame state
+      this.undoRecording = true;
+    }
+  }
+  // undo while the log lasts, then search the rest of the frame by replaying it
+  runEvalBackward(evalfunc : DebugEvalCondition) {
+    var moved = false;
+    while (this.undoStep()) {
+      moved = true;
+      if (evalfunc(this.getCPUState())) {
+        this.breakpointHit(this.debugClock);
+        return;
+      }
+    }
+    if (moved) this.debugTargetClock = this.debugClock;
+    super.runEvalBackward(evalfunc);
   }
 
   resume() {
-    this.timer.start();
+    // starting the audio context creates the ring the worker writes to
     this.audio && this.audio.start();
+    // debugging always runs here
+    if (!this.getDebugCallback() && this.canStartWorker()) this.startWorker();
+    if (this.worker && !this.getDebugCallback()) {
+      if (!this.workerRunning) {
+        this.timer.stop();
+        this.workerRunning = true;
+        if (this.workerStopping) {
+          // it hasn't sent the state it stopped at yet, so it's still newer
+          this.workerStopping = false;
+          this.postWorkerGen({run: true});
+        } else {
+          this.syncWorker();
+          this.postToWorker({run: true});
+        }
+      }
+    } else {
+      this.stopWorker();
+      this.timer.start();
+    }
   }
 
   pause() {
+    this.stopWorker();
     this.timer.stop();
     this.audio && this.audio.stop();
   }
@@ -933,7 +1261,7 @@ export abstract class BaseMachinePlatform<T extends Machine> extends BaseDebugPl
   runToVsync() {
     this.restartDebugging();
     var flag = false;
-    this.runEval( () : boolean => {
+    this.runUntil( () : boolean => {
       if (this.getRasterScanline() > 0) flag = true;
       else return flag;
     });
@@ -88,8 +88,9 @@ runtime.input = async (prompt:string) => {
 runtime.resume = function() {
     process.nextTick(() => {
         try {
-            if (runtime.step()) {
-                if (runtime.running) runtime.resume();
+            runtime.run(10000);
+            if (runtime.running) {
+                runtime.resume();
             } else if (runtime.exited) {
                 //console.log("*** PROGRAM EXITED ***");
                 process.exit(0);
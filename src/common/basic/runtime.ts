@@ -32,8 +32,27 @@ class ExprOptions {
 
 interface CompiledStatement {
     $run?: () => void;
+    $js?: string;
 }
 
+// statements that never change curpc or stop the program,
+// so they can be chained inside a compiled block
+const STRAIGHT_LINE_COMMANDS = {
+    LET:1, PRINT:1, DIM:1, READ:1, RESTORE:1, DATA:1, OPTION:1,
+    DEF:1, RANDOMIZE:1, CHANGE:1, CONVERT:1, POP:1, CLEAR:1,
+};
+// statements that always jump, wait for input, or stop the program
+const BLOCK_END_COMMANDS = {
+    GOTO:1, GOSUB:1, ONGOTO:1, ONGOSUB:1, RETURN:1, ELSE:1, WEND:1,
+    END:1, STOP:1, SUB:1, CALL:1, INPUT:1, GET:1,
+};
+// statements that can leave a variable without a value of its type
+// (SUB parameters shadow variables and RETURN restores them, CLEAR)
+const RESCOPE_COMMANDS = { RETURN:1, POP:1, CALL:1, CLEAR:1 };
+// a checked read of a variable, as expr2js() writes it. the quotes of a
+// name inside a string literal are escaped, so those never match
+const CHECKED_SLOT_READ = /this\.checkValue\(this\.slots\[(\d+)\], "([^"\\]+)"\)/g;
+
 class RNG {
     next : () => number;
     seed : (aa,bb,cc,dd) => void;
@@ -70,6 +89,7 @@ class RNG {
 };
 
 const DEFAULT_MAX_ARRAY_ELEMENTS = 1024*1024;
+const MAX_BLOCK_STATEMENTS = 256;
 
 export class BASICRuntime {
 
@@ -85,8 +105,10 @@ export class BASICRuntime {
 
     curpc : number;
     dataptr : number;
-    vars : {[name:string] : any}; // actually Value, but += doesn't work
-    globals : {[name:string] : any};
+    // variables are numbered when first compiled, and kept across hot reloads
+    varSlots = new Map<string,number>();
+    slots : any[]; // values by slot, actually Value, but += doesn't work
+    localScopes : { depth:number, slots:number[], saved:any[] }[]; // variables shadowed by SUB parameters
     arrays : {};
     defs : {};
     subroutines : {};
@@ -101,6 +123,10 @@ export class BASICRuntime {
     exited : boolean = true;
     trace : boolean = false;
 
+    // compiled blocks for run(), indexed by pc (null = use step())
+    pc2block : ((pc:number, max:number) => number)[];
+    breakRun : boolean = false; // set to return from run() at next jump
+
     load(program: basic.BASICProgram) : boolean {
         // get previous label and offset for hot reload
         let prevlabel = null;
@@ -124,6 +150,7 @@ export class BASICRuntime {
         this.datums = [];
         this.subroutines = {};
         this.builtins = this.getBuiltinFunctions();
+        this.pc2block = null;
         // TODO: detect undeclared vars
         // build PC -> label lookup
         for (var label in program.labels) {
@@ -164,7 +191,8 @@ export class BASICRuntime {
         this.exited = false;
     }
     clearVars() {
-        this.globals = this.vars = {};
+        this.slots = [];
+        this.localScopes = [];
         this.arrays = {};
         this.defs = {}; // TODO? only in interpreters
         this.forLoops = {};
@@ -242,7 +270,7 @@ export class BASICRuntime {
             this.exited = true;
             return false;
         }
-        if (this.trace) console.log(this.curpc, stmt, this.vars, Object.keys(this.arrays));
+        if (this.trace) console.log(this.curpc, stmt, this.getVariables(), Object.keys(this.arrays));
         // skip to next statment
         this.curpc++;
         // compile (unless cached) and execute statement
@@ -258,6 +286,7 @@ export class BASICRuntime {
                 var functext = stmtfn.bind(this)(stmt);
                 if (this.trace) console.log(functext);
                 stmt.$run = this.compileJS(functext);
+                stmt.$js = functext || '';
             } catch (e) {
                 if (functext) console.log(functext);
                 throw e;
@@ -274,6 +303,102 @@ export class BASICRuntime {
         stmt.$run();
     }
 
+    // run up to maxStmts statements using compiled blocks, returns # executed
+    run(maxStmts: number) : number {
+        if (this.trace) { this.step(); return 1; }
+        if (this.pc2block == null) this.compileBlocks();
+        var count = 0;
+        this.breakRun = false;
+        while (this.running && !this.breakRun && count < maxStmts) {
+            var block = this.pc2block[this.curpc];
+            var k = block != null ? block(this.curpc, maxStmts - count) : 0;
+            if (k) {
+                count += k;
+            } else {
+                this.step();
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // compile the program into one function per block, ending after a
+    // statement that always jumps or stops. each block is a switch on the
+    // entry pc, so GOTO/RETURN/NEXT can land in the middle of it, and jumps
+    // that stay inside the block loop without leaving the function.
+    // a block is only entered when the rest of it fits in the statement
+    // budget (otherwise it returns 0 and run() steps instead), so run()
+    // never runs more statements than it was asked to.
+    // curpc is only stored before statements that read or change it;
+    // when a straight-line statement throws, blockError() sets it from the count.
+    // if every variable the block reads holds a value when it's entered,
+    // it runs a copy without checkValue(), which returns to run() after
+    // any statement that can take values away again.
+    compileBlocks() {
+        var n = this.allstmts.length;
+        this.pc2block = new Array(n).fill(null);
+        var start = 0;
+        while (start < n) {
+            // find end of block
+            var end = start;
+            do {
+                var cmd = this.allstmts[end++].command;
+            } while (end < n && end - start < MAX_BLOCK_STATEMENTS && !BLOCK_END_COMMANDS[cmd]);
+            // generate switch, exit or loop back when curpc changes
+            var checked = '';
+            var unchecked = '';
+            var reads = [];
+            for (var pc=start; pc<end; pc++) {
+                var stmt = this.allstmts[pc] as basic.Statement & CompiledStatement;
+                var jumps = !STRAIGHT_LINE_COMMANDS[stmt.command];
+                var head = jumps ? `case ${pc}: this.curpc = ${pc+1}; n++; ` : `case ${pc}: n++; `;
+                var tail = jumps ? `if (this.curpc !== ${pc+1}) { pc = this.curpc; if (pc >= ${start} && pc < ${end} && max - n >= ${end} - pc && this.running && !this.breakRun) { base = pc - n; continue; } return n; }\n` : '';
+                checked += `${head}{${stmt.$js};}\n${tail}`;
+                var js = stmt.$js.replace(CHECKED_SLOT_READ, (s, slot, name) => {
+                    reads[slot] = name;
+                    return `this.slots[${slot}]`;
+                });
+                if (RESCOPE_COMMANDS[stmt.command])
+                    tail = jumps ? `return n;\n` : `this.curpc = ${pc+1}; return n;\n`;
+                unchecked += `${head}{${js};}\n${tail}`;
+            }
+            var loop = (cases) => `for (;;) {\nswitch (pc) {\n${cases}}\nthis.curpc = ${end};\nreturn n;\n}\n`;
+            var tests = [];
+            reads.forEach((name, slot) => {
+                tests.push(`typeof this.slots[${slot}] === "${name.endsWith('$') ? 'string' : 'number'}"`);
+            });
+            var s = `if (max < ${end} - pc) return 0;\nvar n = 0, base = pc;\ntry {\n`;
+            if (tests.length)
+                s += `if (${tests.join(' && ')})\n${loop(unchecked)}`;
+            s += loop(checked);
+            s += '} catch (e) {\nthrow this.blockError(e, base + n);\n}';
+            var block = null;
+            try {
+                block = new Function('pc', 'max', s).bind(this);
+            } catch (e) {
+                console.log("could not compile block", start, e); // fall back to step()
+            }
+            for (var pc=start; pc<end; pc++) {
+                this.pc2block[pc] = block;
+            }
+            start = end;
+        }
+    }
+
+    // a compiled block threw before statement nextpc, so set curpc and the
+    // error location as step() would have
+    blockError(e, nextpc: number) {
+        var stmt = this.allstmts[nextpc-1];
+        if (stmt && STRAIGHT_LINE_COMMANDS[stmt.command]) {
+            this.curpc = nextpc;
+            if (e instanceof EmuHalt) {
+                this.curpc--; // as runtimeError() does
+                e.$loc = this.getCurrentSourceLocation();
+            }
+        }
+        return e;
+    }
+
     // TODO: this only works because each line has a label
     skipToEOL() {
         do {
@@ -343,13 +468,40 @@ export class BASICRuntime {
         }
     }
 
-    newLocalScope() {
-        this.vars = Object.create(this.vars);
+    // slot for a variable, numbered the first time it's seen
+    varSlot(name: string) : number {
+        var slot = this.varSlots.get(name);
+        if (slot == null) {
+            slot = this.varSlots.size;
+            this.varSlots.set(name, slot);
+        }
+        return slot;
+    }
+
+    // variables that have been set, by name (for the debugger)
+    getVariables() : {[name:string] : basic.Value} {
+        var vars = {};
+        this.varSlots.forEach((slot, name) => {
+            if (this.slots[slot] !== undefined) vars[name] = this.slots[slot];
+        });
+        return vars;
+    }
+
+    // SUB parameters shadow the variables of the same name until the SUB returns
+    newLocalScope(slots: number[], values: basic.Value[]) {
+        this.localScopes.push({ depth: this.returnStack.length, slots: slots, saved: slots.map((slot) => this.slots[slot]) });
+        for (var i=0; i<slots.length; i++)
+            this.slots[slots[i]] = values[i];
     }
     
+    // restore the variables shadowed by SUBs that aren't on the return stack anymore
     popLocalScope() {
-        if (this.vars !== this.globals)
-            this.vars = Object.getPrototypeOf(this.vars);
+        var scopes = this.localScopes;
+        while (scopes.length && scopes[scopes.length-1].depth > this.returnStack.length) {
+            var scope = scopes.pop();
+            for (var i=scope.slots.length-1; i>=0; i--)
+                this.slots[scope.slots[i]] = scope.saved[i];
+        }
     }
 
     gosubLabel(label) {
@@ -371,6 +523,7 @@ export class BASICRuntime {
         if (this.returnStack.length == 0)
             this.runtimeError("I tried to POP, but there wasn't a corresponding GOSUB.");
         this.returnStack.pop();
+        this.popLocalScope();
     }
 
     valueToString(obj:basic.Value, padding:boolean) : string {
@@ -455,11 +608,11 @@ export class BASICRuntime {
                 } else if (expr.args) {
                     // get array slice (HP BASIC)
                     if (this.opts.arraysContainChars && expr.name.endsWith('$'))
-                        s += `this.getStringSlice(this.vars.${expr.name}, ${jsargs})`;
+                        s += `this.getStringSlice(this.slots[${this.varSlot(expr.name)}], ${jsargs})`;
                     else
                         s += `this.arrayGet(${qname}, ${jsargs})`;
                 } else { // just a variable
-                    s += `this.vars.${expr.name}`;
+                    s += `this.slots[${this.varSlot(expr.name)}]`;
                 }
                 return opts.novalid ? s : `this.checkValue(${s}, ${qname})`;
             }
@@ -488,7 +641,7 @@ export class BASICRuntime {
                 s += this.array2js(expr, opts);
             }
         } else { // just a variable
-            s = `this.globals.${expr.name}`;
+            s = `this.slots[${this.varSlot(expr.name)}]`;
         }
         return s;
     }
@@ -517,11 +670,12 @@ export class BASICRuntime {
         var looppc = this.curpc - 1;
         var looplabel = this.pc2label.get(looppc);
         if (!step) step = 1;
-        this.vars[forname] = init;
+        var slot = this.varSlot(forname);
+        this.slots[slot] = init;
         if (this.trace) console.log(`FOR ${forname} = ${init} TO ${targ} STEP ${step}`);
         // create done function
         var loopdone = () => {
-            return step >= 0 ? this.vars[forname] > targ : this.vars[forname] < targ;
+            return step >= 0 ? this.slots[slot] > targ : this.slots[slot] < targ;
         }
         // skip entire for loop before first iteration? (Minimal BASIC)
         if (this.opts.testInitialFor && loopdone()) {
@@ -539,7 +693,7 @@ export class BASICRuntime {
             $next: (nextname:string) => {
                 if (nextname && forname != nextname)
                     this.runtimeError(`I executed NEXT "${nextname}", but the last FOR was for "${forname}".`)
-                this.vars[forname] += step;
+                this.slots[slot] += step;
                 var done = loopdone();
                 if (done) {
                     // delete entry, pop FOR off the stack and continue
@@ -549,7 +703,7 @@ export class BASICRuntime {
                     // go back to FOR loop, adjusting for hot reload (fetch pc by label)
                     this.curpc = ((looplabel != null && this.label2pc[looplabel]) || looppc) + 1;
                 }
-                if (this.trace) console.log(`NEXT ${forname}: ${this.vars[forname]} TO ${targ} STEP ${step} DONE=${done}`);
+                if (this.trace) console.log(`NEXT ${forname}: ${this.slots[slot]} TO ${targ} STEP ${step} DONE=${done}`);
             }
         };
     }
@@ -660,7 +814,8 @@ export class BASICRuntime {
 
     arrayGet(name: string, ...indices: number[]) : basic.Value {
         var arr = this.getArray(name, indices.length);
-        indices = indices.map(this.ROUND.bind(this));
+        for (var i=0; i<indices.length; i++)
+            indices[i] = this.ROUND(indices[i]); // no closure, this is hot
         var v = arr;
         for (var i=0; i<indices.length; i++) {
             var idx = indices[i];
@@ -780,7 +935,8 @@ export class BASICRuntime {
         for (var lexpr of stmt.lexprs) {
             // HP BASIC string-slice syntax?
             if (this.opts.arraysContainChars && lexpr.args && lexpr.name.endsWith('$')) {
-                s += `this.globals.${lexpr.name} = this.modifyStringSlice(this.vars.${lexpr.name}, _right, `
+                var slot = this.varSlot(lexpr.name);
+                s += `this.slots[${slot}] = this.modifyStringSlice(this.slots[${slot}], _right, `
                 s += lexpr.args.map((arg) => this.expr2js(arg)).join(', ');
                 s += ');';
             } else {
@@ -999,13 +1155,11 @@ export class BASICRuntime {
         var callargs = stmt.call.args || [];
         if (subargs.length != callargs.length)
             this.runtimeError(`I tried to call ${stmt.call.name} with the wrong number of parameters.`);
+        var slots = subargs.map((arg: basic.IndOp) => this.varSlot(arg.name));
         var s = '';
+        s += `let _args = [${callargs.map((arg) => this.expr2js(arg)).join(', ')}];`
         s += `this.gosubLabel(${JSON.stringify(stmt.call.name)});`
-        s += `this.newLocalScope();`
-        for (var i=0; i<subargs.length; i++) {
-            var arg = subargs[i] as basic.IndOp;
-            s += `this.vars.${arg.name} = ${this.expr2js(callargs[i])};`
-        }
+        s += `this.newLocalScope([${slots.join(', ')}], _args);`
         return s;
     }
 
@@ -1,5 +1,6 @@
 
-import { CPU, Bus, ClockBased, SavesState, Interruptable } from "../devices";
+import { CPU, Bus, ClockBased, CycleBatched, SavesState, Interruptable } from "../devices";
+import { MOS6502JIT, MOS6502Regs } from "./MOS6502JIT";
 
 // Copyright 2015 by Paulo Augusto Peccin. See license.txt distributed with this file.
 
@@ -1902,6 +1903,19 @@ export var _MOS6502 = function() {
     this.isPCStable = function() {
       return T == 0;
     }
+
+    // register exchange with the block JIT (only at a stable PC)
+    this.exportRegs = function(r:MOS6502Regs) {
+      r.PC = (PC-1) & 0xffff;
+      r.A = A; r.X = X; r.Y = Y; r.SP = SP;
+      r.N = N; r.V = V; r.D = D; r.I = I; r.Z = Z; r.C = C;
+    }
+    this.importRegs = function(r:MOS6502Regs) {
+      PC = r.PC;
+      A = r.A; X = r.X; Y = r.Y; SP = r.SP;
+      N = r.N; V = r.V; D = r.D; I = r.I; Z = r.Z; C = r.C;
+      fetchOpcodeAndDecodeInstruction();
+    }
 };
 
 export interface MOS6502State {
@@ -1930,13 +1944,46 @@ boa : number;
 
 export enum MOS6502Interrupts { None=0, NMI=1, IRQ=2 };
 
-export class MOS6502 implements CPU, ClockBased, SavesState<MOS6502State>, Interruptable<MOS6502Interrupts> {
+export class MOS6502 implements CPU, ClockBased, CycleBatched, SavesState<MOS6502State>, Interruptable<MOS6502Interrupts> {
 
   cpu = new _MOS6502();
   interruptType : MOS6502Interrupts = MOS6502Interrupts.None;
+  bus : Bus;
+  jit : MOS6502JIT;
   
   connectMemoryBus(bus:Bus) {
-    this.cpu.connectBus(bus);
+    this.bus = bus;
+    var jit = this.jit;
+    // the interpreter's writes also have to invalidate compiled code
+    this.cpu.connectBus(!jit ? bus : {
+      read: (a) => bus.read(a),
+      write: (a, v) => {
+        bus.write(a, v);
+        if (jit.codemap[a]) jit.invalidate(a);
+      }
+    });
+  }
+  // readConst() must return code bytes without side effects
+  enableJIT(readConst: (a:number) => number) {
+    this.jit = readConst ? new MOS6502JIT(readConst) : null;
+    if (this.bus) this.connectMemoryBus(this.bus);
+  }
+  // drop compiled code after memory changes other than CPU writes (bank switch, state load)
+  invalidateJIT() {
+    if (this.jit) this.jit.reset();
+  }
+  // leave the running compiled block after this write (e.g. a WSYNC strobe)
+  stopBlock() {
+    if (this.jit) this.jit.stop = true;
+  }
+  // run a compiled block of at least one instruction, returns cycles or 0 if not possible
+  advanceBlock(maxCycles:number) : number {
+    if (!this.jit || this.interruptType || !this.isStable() || !this.cpu.isRDY()) return 0;
+    var r = this.jit.regs;
+    this.cpu.exportRegs(r);
+    var n = this.jit.execute(r, this.bus, maxCycles);
+    if (n) this.cpu.importRegs(r);
+    return n;
   }
   advanceClock() {
     if (this.interruptType && this.isStable()) {
@@ -1953,14 +2000,25 @@ export class MOS6502 implements CPU, ClockBased, SavesState<MOS6502State>, Inter
       this.advanceClock();
     } while (!this.isStable());
   }
+  // clock-based, so stops exactly at the budget (maybe mid-instruction)
+  runCycles(maxCycles:number) : number {
+    var n = 0;
+    do {
+      this.advanceClock();
+      n++;
+    } while (n < maxCycles);
+    return n;
+  }
   reset() {
     this.cpu.reset();
     this.interruptType = 0;
+    if (this.jit) this.jit.reset();
   }
   interrupt(itype:number) {
     if (this.interruptType != MOS6502Interrupts.NMI) {
         this.interruptType = itype;
     }
+    if (this.jit) this.jit.stop = true; // leave the current block
   }
   NMI() {
     this.interrupt(MOS6502Interrupts.NMI);
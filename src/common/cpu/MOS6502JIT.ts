@@ -0,0 +1,245 @@
+
+import { Bus } from "../devices";
+import { OPS_6502 } from "./disasm6502";
+
+// Translates runs of 6502 code into JS functions, cached by PC.
+// Data reads and writes hit the bus in the same order as the per-cycle core,
+// opcode/operand fetches are elided (the bytes are constants in the generated code).
+// Blocks exit at JMP/JSR/RTS/RTI, taken branches, when the cycle budget runs out,
+// or when a write lands on compiled code (or an interrupt is raised).
+// Compiled blocks stay valid until invalidate() sees a write to one of their bytes,
+// or reset() drops them all (the owner calls it when memory is banked or reloaded).
+
+export interface MOS6502Regs {
+  PC: number; SP: number; A: number; X: number; Y: number;
+  N: number; V: number; D: number; I: number; Z: number; C: number;
+}
+
+interface JITBlock {
+  start: number;
+  length: number;     // code bytes covered, for invalidate()
+  fn: (r: MOS6502Regs, B: Bus, M: Uint8Array, j: MOS6502JIT, m: number) => number;
+}
+
+const MAX_BLOCK_INSNS = 32;
+
+const BRANCH_CONDS = {
+  BPL: "N===0", BMI: "N===1", BVC: "V===0", BVS: "V===1",
+  BCC: "C===0", BCS: "C===1", BNE: "Z===0", BEQ: "Z===1",
+};
+
+const SET_ZN = (r: string) => `Z=${r}===0?1:0;N=(${r}&128)?1:0;`;
+
+// operations on 'd' (fetched data)
+const READ_OPS = {
+  LDA: "A=d;" + SET_ZN("A"),
+  LDX: "X=d;" + SET_ZN("X"),
+  LDY: "Y=d;" + SET_ZN("Y"),
+  AND: "A&=d;" + SET_ZN("A"),
+  ORA: "A|=d;" + SET_ZN("A"),
+  EOR: "A^=d;" + SET_ZN("A"),
+  BIT: "Z=(A&d)===0?1:0;V=(d&64)?1:0;N=(d&128)?1:0;",
+  CMP: "t=(A-d)&255;C=A>=d?1:0;" + SET_ZN("t"),
+  CPX: "t=(X-d)&255;C=X>=d?1:0;" + SET_ZN("t"),
+  CPY: "t=(Y-d)&255;C=Y>=d?1:0;" + SET_ZN("t"),
+  ADC: "if(D){l=(A&15)+(d&15)+C;if(l>9)l+=6;h=((A>>4)+(d>>4)+(l>15?1:0))<<4;" +
+       "Z=((A+d+C)&255)===0?1:0;N=(h&128)?1:0;V=((A^h)&~(A^d)&128)?1:0;" +
+       "if(h>0x9f)h+=0x60;C=h>255?1:0;A=(h|(l&15))&255;}" +
+       "else{s=A+d+C;C=s>255?1:0;V=((A^s)&(d^s)&128)?1:0;A=s&255;" + SET_ZN("A") + "}",
+  SBC: "if(D){l=(A&15)-(d&15)-(1-C);h=(A>>4)-(d>>4)-(l<0?1:0);if(l<0)l-=6;if(h<0)h-=6;" +
+       "s=A-d-(1-C);C=(~s&256)?1:0;V=((A^d)&(A^s)&128)?1:0;Z=(s&255)===0?1:0;N=(s&128)?1:0;" +
+       "A=((h<<4)|(l&15))&255;}" +
+       "else{o=(~d)&255;s=A+o+C;C=s>255?1:0;V=((A^s)&(o^s)&128)?1:0;A=s&255;" + SET_ZN("A") + "}",
+};
+
+const WRITE_OPS = { STA: "A", STX: "X", STY: "Y" };
+
+const RMW_OPS = {
+  ASL: "C=d>127?1:0;d=(d<<1)&255;" + SET_ZN("d"),
+  LSR: "C=d&1;d>>>=1;Z=d===0?1:0;N=0;",
+  ROL: "t=d>127?1:0;d=((d<<1)|C)&255;C=t;" + SET_ZN("d"),
+  ROR: "t=d&1;d=(d>>>1)|(C<<7);C=t;" + SET_ZN("d"),
+  INC: "d=(d+1)&255;" + SET_ZN("d"),
+  DEC: "d=(d-1)&255;" + SET_ZN("d"),
+};
+
+const IMPLIED_OPS = {
+  CLC: "C=0;", SEC: "C=1;", CLD: "D=0;", SED: "D=1;", CLV: "V=0;",
+  CLI: "I=0;", SEI: "I=1;", NOP: "",
+  INX: "X=(X+1)&255;" + SET_ZN("X"), DEX: "X=(X-1)&255;" + SET_ZN("X"),
+  INY: "Y=(Y+1)&255;" + SET_ZN("Y"), DEY: "Y=(Y-1)&255;" + SET_ZN("Y"),
+  TAX: "X=A;" + SET_ZN("X"), TAY: "Y=A;" + SET_ZN("Y"),
+  TXA: "A=X;" + SET_ZN("A"), TYA: "A=Y;" + SET_ZN("A"),
+  TSX: "X=SP;" + SET_ZN("X"), TXS: "SP=X;",
+  PHA: "B.write(256+SP,A);if(M[256+SP])j.invalidate(256+SP);SP=(SP-1)&255;",
+  PHP: "t=256+SP;B.write(t,N<<7|V<<6|0x30|D<<3|I<<2|Z<<1|C);if(M[t])j.invalidate(t);SP=(SP-1)&255;",
+  PLA: "B.read(256+SP);SP=(SP+1)&255;A=B.read(256+SP);" + SET_ZN("A"),
+  PLP: "B.read(256+SP);SP=(SP+1)&255;t=B.read(256+SP);" +
+       "N=t>>>7;V=t>>>6&1;D=t>>>3&1;I=t>>>2&1;Z=t>>>1&1;C=t&1;",
+};
+
+// instructions after which pending IRQs must be looked at again
+const ENDS_BLOCK = { CLI: 1, PLP: 1 };
+
+const WRITE_MEM = (addr: string, val: string) => `B.write(${addr},${val});if(M[${addr}])j.invalidate(${addr});`;
+
+export class MOS6502JIT {
+  readConst: (a: number) => number;
+  blocks = new Map<number, JITBlock>();
+  codemap = new Uint8Array(0x10000); // nonzero where compiled code lives
+  regs: MOS6502Regs = { PC: 0, SP: 0, A: 0, X: 0, Y: 0, N: 0, V: 0, D: 0, I: 0, Z: 0, C: 0 };
+  stop = false;
+  compiled = 0;
+
+  constructor(readConst: (a: number) => number) {
+    this.readConst = readConst;
+  }
+  reset() {
+    this.blocks.clear();
+    this.codemap.fill(0);
+  }
+  invalidate(addr: number) {
+    this.stop = true;
+    this.codemap[addr] = 0;
+    for (let [start, block] of this.blocks) {
+      if (((addr - start) & 0xffff) < block.length) {
+        this.blocks.delete(start);
+      }
+    }
+  }
+  lookup(pc: number): JITBlock {
+    let block = this.blocks.get(pc);
+    if (!block) {
+      block = this.compile(pc);
+      this.blocks.set(pc, block);
+    }
+    return block;
+  }
+  // runs a block with the CPU at an instruction boundary, returns cycles taken (0 = not compiled)
+  execute(r: MOS6502Regs, bus: Bus, maxCycles: number): number {
+    let block = this.lookup(r.PC);
+    if (!block.fn) return 0;
+    this.stop = false;
+    return block.fn(r, bus, this.codemap, this, maxCycles);
+  }
+  compile(start: number): JITBlock {
+    let length = 0;
+    let body = "";
+    let pc = start;
+    let ninsns = 0;
+    let done = false;
+    while (!done && ninsns < MAX_BLOCK_INSNS) {
+      let opcode = this.readConst(pc);
+      let op = OPS_6502[opcode];
+      if (op.il || op.mn == "BRK") break; // leave these to the interpreter
+      let b1 = this.readConst((pc + 1) & 0xffff);
+      let b2 = this.readConst((pc + 2) & 0xffff);
+      let next = (pc + op.nb) & 0xffff;
+      let code = this.translate(op, b1, b2, next, start);
+      if (code == null) break;
+      // budget check at each instruction boundary, like the per-cycle loop
+      if (ninsns > 0) body += `if(c>=m){PC=${pc};break b;}`;
+      body += `c+=${op.c1};` + code;
+      if (op.nw && op.mn != "JSR") body += `if(j.stop){PC=${next};break b;}`;
+      for (let i = 0; i < op.nb; i++) {
+        this.codemap[(pc + i) & 0xffff] = 1;
+      }
+      length += op.nb;
+      ninsns++;
+      if ((op.br && op.am != "branch") || ENDS_BLOCK[op.mn]) done = true;
+      pc = next;
+    }
+    if (ninsns == 0) {
+      this.codemap[start] = 1;
+      return { start, length: 1, fn: null };
+    }
+    body += `PC=${pc};`;
+    let src = "var A=r.A,X=r.X,Y=r.Y,SP=r.SP,N=r.N,V=r.V,D=r.D,I=r.I,Z=r.Z,C=r.C,PC=0,c=0,t,a,d,l,h,s,o;\n"
+      + "b:for(;;){" + body + "break;}\n"
+      + "r.A=A;r.X=X;r.Y=Y;r.SP=SP;r.N=N;r.V=V;r.D=D;r.I=I;r.Z=Z;r.C=C;r.PC=PC;return c;";
+    this.compiled++;
+    return { start, length, fn: new Function('r', 'B', 'M', 'j', 'm', src) as any };
+  }
+  // addressing modes leave the effective address in 'a', indexed modes do their dummy reads
+  address(am: string, b1: number, b2: number, read: boolean): string {
+    let abs = b1 | (b2 << 8);
+    switch (am) {
+      case "aa": return `a=${b1};`;
+      case "aa,x": return `B.read(${b1});a=(${b1}+X)&255;`;
+      case "aa,y": return `B.read(${b1});a=(${b1}+Y)&255;`;
+      case "AAAA": return `a=${abs};`;
+      case "AAAA,x":
+      case "AAAA,y": {
+        let ix = am == "AAAA,x" ? "X" : "Y";
+        // reads only re-read (and take the extra cycle) when the page is crossed
+        return `t=${b1}+${ix};a=${abs & 0xff00}|(t&255);d=B.read(a);if(t>255){a=(a+256)&65535;`
+          + (read ? "d=B.read(a);c++;}" : "}");
+      }
+      case "(aa,x)":
+        return `B.read(${b1});t=(${b1}+X)&255;a=B.read(t)|(B.read((t+1)&255)<<8);`;
+      case "(aa),y":
+        return `a=B.read(${b1})|(B.read(${(b1 + 1) & 255})<<8);t=(a&255)+Y;a=(a&0xff00)|(t&255);d=B.read(a);`
+          + `if(t>255){a=(a+256)&65535;` + (read ? "d=B.read(a);c++;}" : "}");
+    }
+    return null;
+  }
+  // jumps back to the start of the block loop inside the generated function
+  jump(target: number, start: number): string {
+    if (target == start) return `if(c>=m){PC=${start};break b;}continue b;`;
+    return `PC=${target};break b;`;
+  }
+  translate(op, b1: number, b2: number, next: number, start: number): string {
+    let mn = op.mn;
+    let am = op.am;
+    if (am == "") {
+      if (RMW_OPS[mn]) return "d=A;" + RMW_OPS[mn] + "A=d;";
+      if (IMPLIED_OPS[mn] != null) return IMPLIED_OPS[mn];
+      switch (mn) {
+        case "RTS":
+          return "B.read(256+SP);SP=(SP+1)&255;t=B.read(256+SP);SP=(SP+1)&255;t|=B.read(256+SP)<<8;"
+            + "PC=(t+1)&65535;break b;";
+        case "RTI":
+          return "B.read(256+SP);SP=(SP+1)&255;t=B.read(256+SP);"
+            + "N=t>>>7;V=t>>>6&1;D=t>>>3&1;I=t>>>2&1;Z=t>>>1&1;C=t&1;"
+            + "SP=(SP+1)&255;t=B.read(256+SP);SP=(SP+1)&255;t|=B.read(256+SP)<<8;PC=t;break b;";
+      }
+      return null;
+    }
+    if (am == "branch") {
+      let target = (next + ((b1 << 24) >> 24)) & 0xffff;
+      let cycles = 1 + ((target & 0xff00) != (next & 0xff00) ? 1 : 0);
+      return `if(${BRANCH_CONDS[mn]}){c+=${cycles};` + this.jump(target, start) + "}";
+    }
+    if (mn == "JMP") {
+      if (am == "AAAA") return this.jump(b1 | (b2 << 8), start);
+      // indirect: the high byte is fetched without carry into the page
+      return `PC=B.read(${b1 | (b2 << 8)})|(B.read(${(b2 << 8) | ((b1 + 1) & 255)})<<8);break b;`;
+    }
+    if (mn == "JSR") {
+      let ret = (next - 1) & 0xffff;
+      return "B.read(256+SP);" + WRITE_MEM("256+SP", String(ret >> 8)) + "SP=(SP-1)&255;"
+        + WRITE_MEM("256+SP", String(ret & 0xff)) + `SP=(SP-1)&255;PC=${b1 | (b2 << 8)};break b;`;
+    }
+    if (READ_OPS[mn]) {
+      if (am == "#aa") return `d=${b1};` + READ_OPS[mn];
+      let addr = this.address(am, b1, b2, true);
+      if (addr == null) return null;
+      // indexed absolute modes have already read the data at the final address
+      if (am == "AAAA,x" || am == "AAAA,y" || am == "(aa),y")
+        return addr + READ_OPS[mn];
+      return addr + "d=B.read(a);" + READ_OPS[mn];
+    }
+    if (WRITE_OPS[mn]) {
+      let addr = this.address(am, b1, b2, false);
+      if (addr == null) return null;
+      return addr + WRITE_MEM("a", WRITE_OPS[mn]);
+    }
+    if (RMW_OPS[mn]) {
+      let addr = this.address(am, b1, b2, false);
+      if (addr == null) return null;
+      // (abs,X reads the carried address again after the dummy read)
+      return addr + "d=B.read(a);" + WRITE_MEM("a", "d") + RMW_OPS[mn] + WRITE_MEM("a", "d");
+    }
+    return null;
+  }
+}
@@ -1,6 +1,6 @@
 // Generated by CoffeeScript 1.9.3
 
-import { CPU, Bus, InstructionBased, IOBusConnected, SavesState, Interruptable } from "../devices";
+import { CPU, Bus, InstructionBased, CycleBatched, IOBusConnected, SavesState, Interruptable } from "../devices";
 
 ///////////////////////////////////////////////////////////////////////////////
 /// @file Z80.js
@@ -33,7 +33,8 @@ import { CPU, Bus, InstructionBased, IOBusConnected, SavesState, Interruptable }
 function FastZ80(coreParameter)
 {
    // Obviously we'll be needing the core object's functions again.
-   const core = coreParameter;
+   // (replaced by connectCore() when the machine swaps buses)
+   let core = coreParameter;
    
    // The argument to this constructor should be an object containing 4 functions:
    // mem_read(address) should return the byte at the given memory address,
@@ -93,7 +94,19 @@ function FastZ80(coreParameter)
    // This tracks the number of cycles spent in a single instruction run,
    //  including processing any prefixes and handling interrupts.
    let cycle_counter = 0;
-   
+
+   // Local references to the bus functions, so the instruction
+   //  handlers call them directly instead of through the core object.
+   let mem_read = core.mem_read;
+   let mem_write = core.mem_write;
+
+   function connectCore(newCore)
+   {
+      core = newCore;
+      mem_read = core.mem_read;
+      mem_write = core.mem_write;
+   }
+
    function getState():Z80State {
       return {
          PC:pc,
@@ -213,7 +226,7 @@ let run_instruction = function()
       r = (r & 0x80) | (((r & 0x7f) + 1) & 0x7f);
       
       // Read the byte at the PC and run the instruction it encodes.
-      var opcode = core.mem_read(pc);
+      var opcode = mem_read(pc);
       decode_instruction(opcode);
       pc = (pc + 1) & 0xffff;
       
@@ -307,8 +320,8 @@ let interrupt = function(non_maskable:boolean, data:number) : boolean
          //  but it doesn't appear that this is actually the case on the hardware,
          //  so we don't attempt to enforce that here.
          var vector_address = ((i << 8) | data);
-         pc = core.mem_read(vector_address) | 
-                   (core.mem_read((vector_address + 1) & 0xffff) << 8);
+         pc = mem_read(vector_address) | 
+                   (mem_read((vector_address + 1) & 0xffff) << 8);
          
          cycle_counter += 19;
       }
@@ -324,68 +337,10 @@ let interrupt = function(non_maskable:boolean, data:number) : boolean
 ///////////////////////////////////////////////////////////////////////////////
 let decode_instruction = function(opcode)
 {
-   // The register-to-register loads and ALU instructions
-   //  are all so uniform that we can decode them directly
-   //  instead of going into the instruction array for them.
-   // This function gets the operand for all of these instructions.
-   var get_operand = function(opcode)
-   {
-      return ((opcode & 0x07) === 0) ? b :
-             ((opcode & 0x07) === 1) ? c :
-             ((opcode & 0x07) === 2) ? d :
-             ((opcode & 0x07) === 3) ? e :
-             ((opcode & 0x07) === 4) ? h :
-             ((opcode & 0x07) === 5) ? l :
-             ((opcode & 0x07) === 6) ? core.mem_read(l | (h << 8)) : a;
-   };
-
-   // Handle HALT right up front, because it fouls up our LD decoding
-   //  by falling where LD (HL), (HL) ought to be.
-   if (opcode === 0x76)
-   {
-      halted = true;
-   }
-   else if ((opcode >= 0x40) && (opcode < 0x80))
-   {
-      // This entire range is all 8-bit register loads.
-      // Get the operand and assign it to the correct destination.
-      var operand = get_operand(opcode);
-         
-      if (((opcode & 0x38) >>> 3) === 0)
-         b = operand;
-      else if (((opcode & 0x38) >>> 3) === 1)
-         c = operand;
-      else if (((opcode & 0x38) >>> 3) === 2)
-         d = operand;
-      else if (((opcode & 0x38) >>> 3) === 3)
-         e = operand;
-      else if (((opcode & 0x38) >>> 3) === 4)
-         h = operand;
-      else if (((opcode & 0x38) >>> 3) === 5)
-         l = operand;
-      else if (((opcode & 0x38) >>> 3) === 6)
-         core.mem_write(l | (h << 8), operand);
-      else if (((opcode & 0x38) >>> 3) === 7)
-         a = operand;
-   }
-   else if ((opcode >= 0x80) && (opcode < 0xc0))
-   {
-      // These are the 8-bit register ALU instructions.
-      // We'll get the operand and then use this "jump table"
-      //  to call the correct utility function for the instruction.
-      var operand = get_operand(opcode),
-          op_array = [do_add, do_adc, do_sub, do_sbc,
-                      do_and, do_xor, do_or, do_cp];
-      
-      op_array[(opcode & 0x38) >>> 3]( operand);
-   }
-   else
-   {
-      // This is one of the less formulaic instructions;
-      //  we'll get the specific function for it from our array.
-      var func = instructions[opcode];
-      func();
-   }
+   // Every opcode has its own entry in the instruction table,
+   //  including the uniform register loads and ALU instructions,
+   //  which are built once when the core is constructed (see below).
+   instructions[opcode]();
    
    // Update the cycle counter with however many cycles
    //  the base instruction took.
@@ -487,11 +442,9 @@ let update_xy_flags = function(result)
    flags.X = (result & 0x08) >>> 3;
 };
 
-let get_parity = function(value)
-{
-   // We could try to actually calculate the parity every time,
-   //  but why calculate what you can pre-calculate?
-   var parity_bits = [
+// We could try to actually calculate the parity every time,
+//  but why calculate what you can pre-calculate?
+let parity_bits = new Uint8Array([
       1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
       0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0, 
       0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0, 
@@ -508,7 +461,10 @@ let get_parity = function(value)
       0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0, 
       0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0, 
       1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1
-   ];
+]);
+
+let get_parity = function(value)
+{
    return parity_bits[value];
 };
 
@@ -518,18 +474,18 @@ let push_word = function(operand)
    //  decrement the stack pointer, write the high byte to the new
    //  stack pointer location, then repeat for the low byte.
    sp = (sp - 1) & 0xffff;
-   core.mem_write(sp, (operand & 0xff00) >>> 8);
+   mem_write(sp, (operand & 0xff00) >>> 8);
    sp = (sp - 1) & 0xffff;
-   core.mem_write(sp, operand & 0x00ff);
+   mem_write(sp, operand & 0x00ff);
 };
 
 let pop_word = function()
 {
    // Again, not complicated; read a byte off the top of the stack,
    //  increment the stack pointer, rinse and repeat.
-   var retval = core.mem_read(sp) & 0xff;
+   var retval = mem_read(sp) & 0xff;
    sp = (sp + 1) & 0xffff;
-   retval |= core.mem_read(sp) << 8;
+   retval |= mem_read(sp) << 8;
    sp = (sp + 1) & 0xffff;
    return retval;
 };
@@ -550,8 +506,8 @@ let do_conditional_absolute_jump = function(condition)
       //  because the instruction decoder increments the PC
       //  unconditionally at the end of every instruction
       //  and we need to counteract that so we end up at the jump target.
-      pc =  core.mem_read((pc + 1) & 0xffff) |
-                (core.mem_read((pc + 2) & 0xffff) << 8);
+      pc =  mem_read((pc + 1) & 0xffff) |
+                (mem_read((pc + 2) & 0xffff) << 8);
       pc = (pc - 1) & 0xffff;
    }
    else
@@ -569,7 +525,7 @@ let do_conditional_relative_jump = function(condition)
       // We need a few more cycles to actually take the jump.
       cycle_counter += 5;
       // Calculate the offset specified by our operand.
-      var offset = get_signed_offset_byte(core.mem_read((pc + 1) & 0xffff));
+      var offset = get_signed_offset_byte(mem_read((pc + 1) & 0xffff));
       // Add the offset to the PC, also skipping past this instruction.
       pc = (pc + offset + 1) & 0xffff;
    }
@@ -588,8 +544,8 @@ let do_conditional_call = function(condition)
    {
       cycle_counter += 7;
       push_word((pc + 3) & 0xffff);
-      pc =  core.mem_read((pc + 1) & 0xffff) |
-                (core.mem_read((pc + 2) & 0xffff) << 8);
+      pc =  mem_read((pc + 1) & 0xffff) |
+                (mem_read((pc + 2) & 0xffff) << 8);
       pc = (pc - 1) & 0xffff;
    }
    else
@@ -853,8 +809,8 @@ let do_neg = function()
 let do_ldi = function()
 {
    // Copy the value that we're supposed to copy.
-   var read_value = core.mem_read(l | (h << 8));
-   core.mem_write(e | (d << 8), read_value);
+   var read_value = mem_read(l | (h << 8));
+   mem_write(e | (d << 8), read_value);
    
    // Increment DE and HL, and decrement BC.
    var result = (e | (d << 8)) + 1;
@@ -877,7 +833,7 @@ let do_ldi = function()
 let do_cpi = function()
 {
    var temp_carry = flags.C;
-   var read_value = core.mem_read(l | (h << 8))
+   var read_value = mem_read(l | (h << 8))
    do_cp(read_value);
    flags.C = temp_carry;
    flags.Y = ((a - read_value - flags.H) & 0x02) >>> 1;
@@ -897,7 +853,7 @@ let do_ini = function()
 {
    b = do_dec(b);
    
-   core.mem_write(l | (h << 8), core.io_read((b << 8) | c));
+   mem_write(l | (h << 8), core.io_read((b << 8) | c));
    
    var result = (l | (h << 8)) + 1;
    l = result & 0xff;
@@ -908,7 +864,7 @@ let do_ini = function()
 
 let do_outi = function()
 {
-   core.io_write((b << 8) | c, core.mem_read(l | (h << 8)));
+   core.io_write((b << 8) | c, mem_read(l | (h << 8)));
    
    var result = (l | (h << 8)) + 1;
    l = result & 0xff;
@@ -923,8 +879,8 @@ let do_ldd = function()
    flags.N = 0;
    flags.H = 0;
    
-   var read_value = core.mem_read(l | (h << 8));
-   core.mem_write(e | (d << 8), read_value);
+   var read_value = mem_read(l | (h << 8));
+   mem_write(e | (d << 8), read_value);
    
    var result = (e | (d << 8)) - 1;
    e = result & 0xff;
@@ -944,7 +900,7 @@ let do_ldd = function()
 let do_cpd = function()
 {
    var temp_carry = flags.C
-   var read_value = core.mem_read(l | (h << 8))
+   var read_value = mem_read(l | (h << 8))
    do_cp(read_value);
    flags.C = temp_carry;
    flags.Y = ((a - read_value - flags.H) & 0x02) >>> 1;
@@ -964,7 +920,7 @@ let do_ind = function()
 {
    b = do_dec(b);
    
-   core.mem_write(l | (h << 8), core.io_read((b << 8) | c));
+   mem_write(l | (h << 8), core.io_read((b << 8) | c));
    
    var result = (l | (h << 8)) - 1;
    l = result & 0xff;
@@ -975,7 +931,7 @@ let do_ind = function()
 
 let do_outd = function()
 {
-   core.io_write((b << 8) | c, core.mem_read(l | (h << 8)));
+   core.io_write((b << 8) | c, mem_read(l | (h << 8)));
    
    var result = (l | (h << 8)) - 1;
    l = result & 0xff;
@@ -1143,14 +1099,14 @@ instructions[0x00] = function() { };
 instructions[0x01] = function()
 {
    pc = (pc + 1) & 0xffff;
-   c = core.mem_read(pc);
+   c = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   b = core.mem_read(pc);
+   b = mem_read(pc);
 };
 // 0x02 : LD (BC), A
 instructions[0x02] = function()
 {
-   core.mem_write(c | (b << 8), a);
+   mem_write(c | (b << 8), a);
 };
 // 0x03 : INC BC
 instructions[0x03] = function()
@@ -1174,7 +1130,7 @@ instructions[0x05] = function()
 instructions[0x06] = function()
 {
    pc = (pc + 1) & 0xffff;
-   b = core.mem_read(pc);
+   b = mem_read(pc);
 };
 // 0x07 : RLCA
 instructions[0x07] = function()
@@ -1208,7 +1164,7 @@ instructions[0x09] = function()
 // 0x0a : LD A, (BC)
 instructions[0x0a] = function()
 {
-   a = core.mem_read(c | (b << 8));
+   a = mem_read(c | (b << 8));
 };
 // 0x0b : DEC BC
 instructions[0x0b] = function()
@@ -1232,7 +1188,7 @@ instructions[0x0d] = function()
 instructions[0x0e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   c = core.mem_read(pc);
+   c = mem_read(pc);
 };
 // 0x0f : RRCA
 instructions[0x0f] = function()
@@ -1253,14 +1209,14 @@ instructions[0x10] = function()
 instructions[0x11] = function()
 {
    pc = (pc + 1) & 0xffff;
-   e = core.mem_read(pc);
+   e = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   d = core.mem_read(pc);
+   d = mem_read(pc);
 };
 // 0x12 : LD (DE), A
 instructions[0x12] = function()
 {
-   core.mem_write(e | (d << 8), a);
+   mem_write(e | (d << 8), a);
 };
 // 0x13 : INC DE
 instructions[0x13] = function()
@@ -1284,7 +1240,7 @@ instructions[0x15] = function()
 instructions[0x16] = function()
 {
    pc = (pc + 1) & 0xffff;
-   d = core.mem_read(pc);
+   d = mem_read(pc);
 };
 // 0x17 : RLA
 instructions[0x17] = function()
@@ -1298,7 +1254,7 @@ instructions[0x17] = function()
 // 0x18 : JR n
 instructions[0x18] = function()
 {
-   var offset = get_signed_offset_byte(core.mem_read((pc + 1) & 0xffff));
+   var offset = get_signed_offset_byte(mem_read((pc + 1) & 0xffff));
    pc = (pc + offset + 1) & 0xffff;
 };
 // 0x19 : ADD HL, DE
@@ -1309,7 +1265,7 @@ instructions[0x19] = function()
 // 0x1a : LD A, (DE)
 instructions[0x1a] = function()
 {
-   a = core.mem_read(e | (d << 8));
+   a = mem_read(e | (d << 8));
 };
 // 0x1b : DEC DE
 instructions[0x1b] = function()
@@ -1333,7 +1289,7 @@ instructions[0x1d] = function()
 instructions[0x1e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   e = core.mem_read(pc);
+   e = mem_read(pc);
 };
 // 0x1f : RRA
 instructions[0x1f] = function()
@@ -1353,20 +1309,20 @@ instructions[0x20] = function()
 instructions[0x21] = function()
 {
    pc = (pc + 1) & 0xffff;
-   l = core.mem_read(pc);
+   l = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   h = core.mem_read(pc);
+   h = mem_read(pc);
 };
 // 0x22 : LD (nn), HL
 instructions[0x22] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   core.mem_write(address, l);
-   core.mem_write((address + 1) & 0xffff, h);
+   mem_write(address, l);
+   mem_write((address + 1) & 0xffff, h);
 };
 // 0x23 : INC HL
 instructions[0x23] = function()
@@ -1390,7 +1346,7 @@ instructions[0x25] = function()
 instructions[0x26] = function()
 {
    pc = (pc + 1) & 0xffff;
-   h = core.mem_read(pc);
+   h = mem_read(pc);
 };
 // 0x27 : DAA
 instructions[0x27] = function()
@@ -1439,12 +1395,12 @@ instructions[0x29] = function()
 instructions[0x2a] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   l = core.mem_read(address);
-   h = core.mem_read((address + 1) & 0xffff);
+   l = mem_read(address);
+   h = mem_read((address + 1) & 0xffff);
 };
 // 0x2b : DEC HL
 instructions[0x2b] = function()
@@ -1468,7 +1424,7 @@ instructions[0x2d] = function()
 instructions[0x2e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   l = core.mem_read(pc);
+   l = mem_read(pc);
 };
 // 0x2f : CPL
 instructions[0x2f] = function()
@@ -1486,19 +1442,19 @@ instructions[0x30] = function()
 // 0x31 : LD SP, nn
 instructions[0x31] = function()
 {
-   sp =  core.mem_read((pc + 1) & 0xffff) | 
-            (core.mem_read((pc + 2) & 0xffff) << 8);
+   sp =  mem_read((pc + 1) & 0xffff) | 
+            (mem_read((pc + 2) & 0xffff) << 8);
    pc = (pc + 2) & 0xffff;
 };
 // 0x32 : LD (nn), A
 instructions[0x32] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   core.mem_write(address, a);
+   mem_write(address, a);
 };
 // 0x33 : INC SP
 instructions[0x33] = function()
@@ -1509,19 +1465,19 @@ instructions[0x33] = function()
 instructions[0x34] = function()
 {
    var address = l | (h << 8);
-   core.mem_write(address, do_inc(core.mem_read(address)));
+   mem_write(address, do_inc(mem_read(address)));
 };
 // 0x35 : DEC (HL)
 instructions[0x35] = function()
 {
    var address = l | (h << 8);
-   core.mem_write(address, do_dec(core.mem_read(address)));
+   mem_write(address, do_dec(mem_read(address)));
 };
 // 0x36 : LD (HL), n
 instructions[0x36] = function()
 {
    pc = (pc + 1) & 0xffff;
-   core.mem_write(l | (h << 8), core.mem_read(pc));
+   mem_write(l | (h << 8), mem_read(pc));
 };
 // 0x37 : SCF
 instructions[0x37] = function()
@@ -1545,11 +1501,11 @@ instructions[0x39] = function()
 instructions[0x3a] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   a = core.mem_read(address);
+   a = mem_read(address);
 };
 // 0x3b : DEC SP
 instructions[0x3b] = function()
@@ -1569,7 +1525,7 @@ instructions[0x3d] = function()
 // 0x3e : LD A, n
 instructions[0x3e] = function()
 {
-   a = core.mem_read((pc + 1) & 0xffff);
+   a = mem_read((pc + 1) & 0xffff);
    pc = (pc + 1) & 0xffff;
 };
 // 0x3f : CCF
@@ -1600,8 +1556,8 @@ instructions[0xc2] = function()
 // 0xc3 : JP nn
 instructions[0xc3] = function()
 {
-   pc =  core.mem_read((pc + 1) & 0xffff) |
-            (core.mem_read((pc + 2) & 0xffff) << 8);
+   pc =  mem_read((pc + 1) & 0xffff) |
+            (mem_read((pc + 2) & 0xffff) << 8);
    pc = (pc - 1) & 0xffff;
 };
 // 0xc4 : CALL NZ, nn
@@ -1618,7 +1574,7 @@ instructions[0xc5] = function()
 instructions[0xc6] = function()
 {
    pc = (pc + 1) & 0xffff;
-   do_add(core.mem_read(pc));
+   do_add(mem_read(pc));
 };
 // 0xc7 : RST 00h
 instructions[0xc7] = function()
@@ -1649,113 +1605,10 @@ instructions[0xcb] = function()
    //  it can only be changed using the LD R, A instruction.
    r = (r & 0x80) | (((r & 0x7f) + 1) & 0x7f);
 
-   // We don't have a table for this prefix,
-   //  the instructions are all so uniform that we can directly decode them.
+   // The CB table is built from the uniform encoding below.
    pc = (pc + 1) & 0xffff;
-   var opcode = core.mem_read(pc),
-       bit_number = (opcode & 0x38) >>> 3,
-       reg_code = opcode & 0x07;
-   
-   if (opcode < 0x40)
-   {
-      // Shift/rotate instructions
-      var op_array = [do_rlc, do_rrc, do_rl, do_rr,
-                      do_sla, do_sra, do_sll, do_srl];
-      
-      if (reg_code === 0)
-         b = op_array[bit_number]( b);
-      else if (reg_code === 1)
-         c = op_array[bit_number]( c);
-      else if (reg_code === 2)
-         d = op_array[bit_number]( d);
-      else if (reg_code === 3)
-         e = op_array[bit_number]( e);
-      else if (reg_code === 4)
-         h = op_array[bit_number]( h);
-      else if (reg_code === 5)
-         l = op_array[bit_number]( l);
-      else if (reg_code === 6)
-         core.mem_write(l | (h << 8),
-                            op_array[bit_number]( core.mem_read(l | (h << 8))));
-      else if (reg_code === 7)
-         a = op_array[bit_number]( a);
-   }
-   else if (opcode < 0x80)
-   {
-      // BIT instructions
-      if (reg_code === 0)
-         flags.Z = !(b & (1 << bit_number)) ? 1 : 0;
-      else if (reg_code === 1)
-         flags.Z = !(c & (1 << bit_number)) ? 1 : 0;
-      else if (reg_code === 2)
-         flags.Z = !(d & (1 << bit_number)) ? 1 : 0;
-      else if (reg_code === 3)
-         flags.Z = !(e & (1 << bit_number)) ? 1 : 0;
-      else if (reg_code === 4)
-         flags.Z = !(h & (1 << bit_number)) ? 1 : 0;
-      else if (reg_code === 5)
-         flags.Z = !(l & (1 << bit_number)) ? 1 : 0;
-      else if (reg_code === 6)
-         flags.Z = !((core.mem_read(l | (h << 8))) & (1 << bit_number)) ? 1 : 0;
-      else if (reg_code === 7)
-         flags.Z = !(a & (1 << bit_number)) ? 1 : 0;
-         
-      flags.N = 0;
-      flags.H = 1;
-      flags.P = flags.Z;
-      flags.S = ((bit_number === 7) && !flags.Z) ? 1 : 0;
-      // For the BIT n, (HL) instruction, the X and Y flags are obtained
-      //  from what is apparently an internal temporary register used for
-      //  some of the 16-bit arithmetic instructions.
-      // I haven't implemented that register here,
-      //  so for now we'll set X and Y the same way for every BIT opcode,
-      //  which means that they will usually be wrong for BIT n, (HL).
-      flags.Y = ((bit_number === 5) && !flags.Z) ? 1 : 0;
-      flags.X = ((bit_number === 3) && !flags.Z) ? 1 : 0;
-   }
-   else if (opcode < 0xc0)
-   {
-      // RES instructions
-      if (reg_code === 0)
-         b &= (0xff & ~(1 << bit_number));
-      else if (reg_code === 1)
-         c &= (0xff & ~(1 << bit_number));
-      else if (reg_code === 2)
-         d &= (0xff & ~(1 << bit_number));
-      else if (reg_code === 3)
-         e &= (0xff & ~(1 << bit_number));
-      else if (reg_code === 4)
-         h &= (0xff & ~(1 << bit_number));
-      else if (reg_code === 5)
-         l &= (0xff & ~(1 << bit_number));
-      else if (reg_code === 6)
-         core.mem_write(l | (h << 8),
-                            core.mem_read(l | (h << 8)) & ~(1 << bit_number));
-      else if (reg_code === 7)
-         a &= (0xff & ~(1 << bit_number));
-   }
-   else
-   {
-      // SET instructions
-      if (reg_code === 0)
-         b |= (1 << bit_number);
-      else if (reg_code === 1)
-         c |= (1 << bit_number);
-      else if (reg_code === 2)
-         d |= (1 << bit_number);
-      else if (reg_code === 3)
-         e |= (1 << bit_number);
-      else if (reg_code === 4)
-         h |= (1 << bit_number);
-      else if (reg_code === 5)
-         l |= (1 << bit_number);
-      else if (reg_code === 6)
-         core.mem_write(l | (h << 8),
-                            core.mem_read(l | (h << 8)) | (1 << bit_number));
-      else if (reg_code === 7)
-         a |= (1 << bit_number);
-   }
-   
+   var opcode = mem_read(pc);
+   cb_instructions[opcode]();
    cycle_counter += cycle_counts_cb[opcode];
 };
 // 0xcc : CALL Z, nn
@@ -1767,15 +1620,15 @@ instructions[0xcc] = function()
 instructions[0xcd] = function()
 {
    push_word((pc + 3) & 0xffff);
-   pc =  core.mem_read((pc + 1) & 0xffff) |
-            (core.mem_read((pc + 2) & 0xffff) << 8);
+   pc =  mem_read((pc + 1) & 0xffff) |
+            (mem_read((pc + 2) & 0xffff) << 8);
    pc = (pc - 1) & 0xffff;
 };
 // 0xce : ADC A, n
 instructions[0xce] = function()
 {
    pc = (pc + 1) & 0xffff;
-   do_adc(core.mem_read(pc));
+   do_adc(mem_read(pc));
 };
 // 0xcf : RST 08h
 instructions[0xcf] = function()
@@ -1803,7 +1656,7 @@ instructions[0xd2] = function()
 instructions[0xd3] = function()
 {
    pc = (pc + 1) & 0xffff;
-   core.io_write((a << 8) | core.mem_read(pc), a);
+   core.io_write((a << 8) | mem_read(pc), a);
 };
 // 0xd4 : CALL NC, nn
 instructions[0xd4] = function()
@@ -1819,7 +1672,7 @@ instructions[0xd5] = function()
 instructions[0xd6] = function()
 {
    pc = (pc + 1) & 0xffff;
-   do_sub(core.mem_read(pc));
+   do_sub(mem_read(pc));
 };
 // 0xd7 : RST 10h
 instructions[0xd7] = function()
@@ -1862,7 +1715,7 @@ instructions[0xda] = function()
 instructions[0xdb] = function()
 {
    pc = (pc + 1) & 0xffff;
-   a = core.io_read((a << 8) | core.mem_read(pc));
+   a = core.io_read((a << 8) | mem_read(pc));
 };
 // 0xdc : CALL C, nn
 instructions[0xdc] = function()
@@ -1879,7 +1732,7 @@ instructions[0xdd] = function()
    r = (r & 0x80) | (((r & 0x7f) + 1) & 0x7f);
 
    pc = (pc + 1) & 0xffff;
-   var opcode = core.mem_read(pc),
+   var opcode = mem_read(pc),
        func = dd_instructions[opcode];
        
    if (func)
@@ -1904,7 +1757,7 @@ instructions[0xdd] = function()
 instructions[0xde] = function()
 {
    pc = (pc + 1) & 0xffff;
-   do_sbc(core.mem_read(pc));
+   do_sbc(mem_read(pc));
 };
 // 0xdf : RST 18h
 instructions[0xdf] = function()
@@ -1931,11 +1784,11 @@ instructions[0xe2] = function()
 // 0xe3 : EX (SP), HL
 instructions[0xe3] = function()
 {
-   var temp = core.mem_read(sp);
-   core.mem_write(sp, l);
+   var temp = mem_read(sp);
+   mem_write(sp, l);
    l = temp;
-   temp = core.mem_read((sp + 1) & 0xffff);
-   core.mem_write((sp + 1) & 0xffff, h);
+   temp = mem_read((sp + 1) & 0xffff);
+   mem_write((sp + 1) & 0xffff, h);
    h = temp;
 };
 // 0xe4 : CALL PO, nn
@@ -1952,7 +1805,7 @@ instructions[0xe5] = function()
 instructions[0xe6] = function()
 {
    pc = (pc + 1) & 0xffff;
-   do_and(core.mem_read(pc));
+   do_and(mem_read(pc));
 };
 // 0xe7 : RST 20h
 instructions[0xe7] = function()
@@ -2000,7 +1853,7 @@ instructions[0xed] = function()
    r = (r & 0x80) | (((r & 0x7f) + 1) & 0x7f);
 
    pc = (pc + 1) & 0xffff;
-   var opcode = core.mem_read(pc),
+   var opcode = mem_read(pc),
        func = ed_instructions[opcode];
        
    if (func)
@@ -2019,7 +1872,7 @@ instructions[0xed] = function()
 instructions[0xee] = function()
 {
    pc = (pc + 1) & 0xffff;
-   do_xor(core.mem_read(pc));
+   do_xor(mem_read(pc));
 };
 // 0xef : RST 28h
 instructions[0xef] = function()
@@ -2063,7 +1916,7 @@ instructions[0xf5] = function()
 instructions[0xf6] = function()
 {
    pc = (pc + 1) & 0xffff;
-   do_or(core.mem_read(pc));
+   do_or(mem_read(pc));
 };
 // 0xf7 : RST 30h
 instructions[0xf7] = function()
@@ -2106,7 +1959,7 @@ instructions[0xfd] = function()
    r = (r & 0x80) | (((r & 0x7f) + 1) & 0x7f);
    
    pc = (pc + 1) & 0xffff;
-   var opcode = core.mem_read(pc),
+   var opcode = mem_read(pc),
        func = dd_instructions[opcode];
        
    if (func)
@@ -2139,7 +1992,7 @@ instructions[0xfd] = function()
 instructions[0xfe] = function()
 {
    pc = (pc + 1) & 0xffff;
-   do_cp(core.mem_read(pc));
+   do_cp(mem_read(pc));
 };
 // 0xff : RST 38h
 instructions[0xff] = function()
@@ -2148,6 +2001,113 @@ instructions[0xff] = function()
 };
 
 
+///////////////////////////////////////////////////////////////////////////////
+/// The 8-bit register loads (0x40-0x7f), the 8-bit register ALU
+///  instructions (0x80-0xbf) and the whole CB prefix are so uniform
+///  that we decode them once, here, into one table entry per opcode.
+/// Register code 6 is the (HL) operand.
+///////////////////////////////////////////////////////////////////////////////
+let reg_getters = [
+   function() { return b; },
+   function() { return c; },
+   function() { return d; },
+   function() { return e; },
+   function() { return h; },
+   function() { return l; },
+   function() { return mem_read(l | (h << 8)); },
+   function() { return a; }
+];
+let reg_setters = [
+   function(value) { b = value; },
+   function(value) { c = value; },
+   function(value) { d = value; },
+   function(value) { e = value; },
+   function(value) { h = value; },
+   function(value) { l = value; },
+   function(value) { mem_write(l | (h << 8), value); },
+   function(value) { a = value; }
+];
+let alu_functions = [do_add, do_adc, do_sub, do_sbc,
+                     do_and, do_xor, do_or, do_cp];
+let shift_functions = [do_rlc, do_rrc, do_rl, do_rr,
+                       do_sla, do_sra, do_sll, do_srl];
+
+let make_load = function(get, set)
+{
+   return function() { set(get()); };
+};
+let make_alu = function(func, get)
+{
+   return function() { func(get()); };
+};
+let make_shift = function(func, get, set)
+{
+   return function() { set(func(get())); };
+};
+let make_bit = function(bit_number, get)
+{
+   var mask = 1 << bit_number;
+   return function()
+   {
+      flags.Z = !(get() & mask) ? 1 : 0;
+      flags.N = 0;
+      flags.H = 1;
+      flags.P = flags.Z;
+      flags.S = ((bit_number === 7) && !flags.Z) ? 1 : 0;
+      // For the BIT n, (HL) instruction, the X and Y flags are obtained
+      //  from what is apparently an internal temporary register used for
+      //  some of the 16-bit arithmetic instructions.
+      // I haven't implemented that register here,
+      //  so for now we'll set X and Y the same way for every BIT opcode,
+      //  which means that they will usually be wrong for BIT n, (HL).
+      flags.Y = ((bit_number === 5) && !flags.Z) ? 1 : 0;
+      flags.X = ((bit_number === 3) && !flags.Z) ? 1 : 0;
+   };
+};
+let make_res = function(bit_number, get, set)
+{
+   var mask = 0xff & ~(1 << bit_number);
+   return function() { set(get() & mask); };
+};
+let make_set = function(bit_number, get, set)
+{
+   var mask = 1 << bit_number;
+   return function() { set(get() | mask); };
+};
+
+// HALT falls where LD (HL), (HL) ought to be.
+instructions[0x76] = function()
+{
+   halted = true;
+};
+for (let opcode = 0x40; opcode < 0xc0; opcode++)
+{
+   let get = reg_getters[opcode & 0x07];
+   if (opcode === 0x76)
+      continue;
+   else if (opcode < 0x80)
+      instructions[opcode] = make_load(get, reg_setters[(opcode & 0x38) >>> 3]);
+   else
+      instructions[opcode] = make_alu(alu_functions[(opcode & 0x38) >>> 3], get);
+}
+
+let cb_instructions = [];
+for (let opcode = 0; opcode < 0x100; opcode++)
+{
+   let bit_number = (opcode & 0x38) >>> 3,
+       get = reg_getters[opcode & 0x07],
+       set = reg_setters[opcode & 0x07];
+   if (opcode < 0x40)
+      cb_instructions[opcode] = make_shift(shift_functions[bit_number], get, set);
+   else if (opcode < 0x80)
+      cb_instructions[opcode] = make_bit(bit_number, get);
+   else if (opcode < 0xc0)
+      cb_instructions[opcode] = make_res(bit_number, get, set);
+   else
+      cb_instructions[opcode] = make_set(bit_number, get, set);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 /// This table of ED opcodes is pretty sparse;
 ///  there are not very many valid ED-prefixed opcodes in the Z80,
@@ -2173,12 +2133,12 @@ ed_instructions[0x42] = function()
 ed_instructions[0x43] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   core.mem_write(address, c);
-   core.mem_write((address + 1) & 0xffff, b);
+   mem_write(address, c);
+   mem_write((address + 1) & 0xffff, b);
 };
 // 0x44 : NEG
 ed_instructions[0x44] = function()
@@ -2220,12 +2180,12 @@ ed_instructions[0x4a] = function()
 ed_instructions[0x4b] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   c = core.mem_read(address);
-   b = core.mem_read((address + 1) & 0xffff);
+   c = mem_read(address);
+   b = mem_read((address + 1) & 0xffff);
 };
 // 0x4c : NEG (Undocumented)
 ed_instructions[0x4c] = function()
@@ -2266,12 +2226,12 @@ ed_instructions[0x52] = function()
 ed_instructions[0x53] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   core.mem_write(address, e);
-   core.mem_write((address + 1) & 0xffff, d);
+   mem_write(address, e);
+   mem_write((address + 1) & 0xffff, d);
 };
 // 0x54 : NEG (Undocumented)
 ed_instructions[0x54] = function()
@@ -2319,12 +2279,12 @@ ed_instructions[0x5a] = function()
 ed_instructions[0x5b] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   e = core.mem_read(address);
-   d = core.mem_read((address + 1) & 0xffff);
+   e = mem_read(address);
+   d = mem_read((address + 1) & 0xffff);
 };
 // 0x5c : NEG (Undocumented)
 ed_instructions[0x5c] = function()
@@ -2372,12 +2332,12 @@ ed_instructions[0x62] = function()
 ed_instructions[0x63] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   core.mem_write(address, l);
-   core.mem_write((address + 1) & 0xffff, h);
+   mem_write(address, l);
+   mem_write((address + 1) & 0xffff, h);
 };
 // 0x64 : NEG (Undocumented)
 ed_instructions[0x64] = function()
@@ -2398,11 +2358,11 @@ ed_instructions[0x66] = function()
 // 0x67 : RRD
 ed_instructions[0x67] = function()
 {
-   var hl_value = core.mem_read(l | (h << 8));
+   var hl_value = mem_read(l | (h << 8));
    var temp1 = hl_value & 0x0f, temp2 = a & 0x0f;
    hl_value = ((hl_value & 0xf0) >>> 4) | (temp2 << 4);
    a = (a & 0xf0) | temp1;
-   core.mem_write(l | (h << 8), hl_value);
+   mem_write(l | (h << 8), hl_value);
    
    flags.S = (a & 0x80) ? 1 : 0;
    flags.Z = a ? 0 : 1;
@@ -2430,12 +2390,12 @@ ed_instructions[0x6a] = function()
 ed_instructions[0x6b] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   l = core.mem_read(address);
-   h = core.mem_read((address + 1) & 0xffff);
+   l = mem_read(address);
+   h = mem_read((address + 1) & 0xffff);
 };
 // 0x6c : NEG (Undocumented)
 ed_instructions[0x6c] = function()
@@ -2456,11 +2416,11 @@ ed_instructions[0x6e] = function()
 // 0x6f : RLD
 ed_instructions[0x6f] = function()
 {
-   var hl_value = core.mem_read(l | (h << 8));
+   var hl_value = mem_read(l | (h << 8));
    var temp1 = hl_value & 0xf0, temp2 = a & 0x0f;
    hl_value = ((hl_value & 0x0f) << 4) | temp2;
    a = (a & 0xf0) | (temp1 >>> 4);
-   core.mem_write(l | (h << 8), hl_value);
+   mem_write(l | (h << 8), hl_value);
    
    flags.S = (a & 0x80) ? 1 : 0;
    flags.Z = a ? 0 : 1;
@@ -2488,12 +2448,12 @@ ed_instructions[0x72] = function()
 ed_instructions[0x73] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   core.mem_write(address, sp & 0xff);
-   core.mem_write((address + 1) & 0xffff, (sp >>> 8) & 0xff);
+   mem_write(address, sp & 0xff);
+   mem_write((address + 1) & 0xffff, (sp >>> 8) & 0xff);
 };
 // 0x74 : NEG (Undocumented)
 ed_instructions[0x74] = function()
@@ -2530,12 +2490,12 @@ ed_instructions[0x7a] = function()
 ed_instructions[0x7b] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= core.mem_read(pc) << 8;
+   address |= mem_read(pc) << 8;
    
-   sp = core.mem_read(address);
-   sp |= core.mem_read((address + 1) & 0xffff) << 8;
+   sp = mem_read(address);
+   sp |= mem_read((address + 1) & 0xffff) << 8;
 };
 // 0x7c : NEG (Undocumented)
 ed_instructions[0x7c] = function()
@@ -2696,20 +2656,20 @@ dd_instructions[0x19] = function()
 dd_instructions[0x21] = function()
 {
    pc = (pc + 1) & 0xffff;
-   ix = core.mem_read(pc);
+   ix = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   ix |= (core.mem_read(pc) << 8);
+   ix |= (mem_read(pc) << 8);
 };
 // 0x22 : LD (nn), IX
 dd_instructions[0x22] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= (core.mem_read(pc) << 8);
+   address |= (mem_read(pc) << 8);
    
-   core.mem_write(address, ix & 0xff);
-   core.mem_write((address + 1) & 0xffff, (ix >>> 8) & 0xff);
+   mem_write(address, ix & 0xff);
+   mem_write((address + 1) & 0xffff, (ix >>> 8) & 0xff);
 };
 // 0x23 : INC IX
 dd_instructions[0x23] = function()
@@ -2730,7 +2690,7 @@ dd_instructions[0x25] = function()
 dd_instructions[0x26] = function()
 {
    pc = (pc + 1) & 0xffff;
-   ix = (core.mem_read(pc) << 8) | (ix & 0xff);
+   ix = (mem_read(pc) << 8) | (ix & 0xff);
 };
 // 0x29 : ADD IX, IX
 dd_instructions[0x29] = function()
@@ -2741,12 +2701,12 @@ dd_instructions[0x29] = function()
 dd_instructions[0x2a] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var address = core.mem_read(pc);
+   var address = mem_read(pc);
    pc = (pc + 1) & 0xffff;
-   address |= (core.mem_read(pc) << 8);
+   address |= (mem_read(pc) << 8);
    
-   ix = core.mem_read(address);
-   ix |= (core.mem_read((address + 1) & 0xffff) << 8);
+   ix = mem_read(address);
+   ix |= (mem_read((address + 1) & 0xffff) << 8);
 };
 // 0x2b : DEC IX
 dd_instructions[0x2b] = function()
@@ -2767,31 +2727,31 @@ dd_instructions[0x2d] = function()
 dd_instructions[0x2e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   ix = (core.mem_read(pc) & 0xff) | (ix & 0xff00);
+   ix = (mem_read(pc) & 0xff) | (ix & 0xff00);
 };
 // 0x34 : INC (IX+n)
 dd_instructions[0x34] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc)),
-       value = core.mem_read((offset + ix) & 0xffff);
-   core.mem_write((offset + ix) & 0xffff, do_inc(value));
+   var offset = get_signed_offset_byte(mem_read(pc)),
+       value = mem_read((offset + ix) & 0xffff);
+   mem_write((offset + ix) & 0xffff, do_inc(value));
 };
 // 0x35 : DEC (IX+n)
 dd_instructions[0x35] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc)),
-       value = core.mem_read((offset + ix) & 0xffff);
-   core.mem_write((offset + ix) & 0xffff, do_dec(value));
+   var offset = get_signed_offset_byte(mem_read(pc)),
+       value = mem_read((offset + ix) & 0xffff);
+   mem_write((offset + ix) & 0xffff, do_dec(value));
 };
 // 0x36 : LD (IX+n), n
 dd_instructions[0x36] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
+   var offset = get_signed_offset_byte(mem_read(pc));
    pc = (pc + 1) & 0xffff;
-   core.mem_write((ix + offset) & 0xffff, core.mem_read(pc));   
+   mem_write((ix + offset) & 0xffff, mem_read(pc));   
 };
 // 0x39 : ADD IX, SP
 dd_instructions[0x39] = function()
@@ -2812,8 +2772,8 @@ dd_instructions[0x45] = function()
 dd_instructions[0x46] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   b = core.mem_read((ix + offset) & 0xffff);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   b = mem_read((ix + offset) & 0xffff);
 };
 // 0x4c : LD C, IXH (Undocumented)
 dd_instructions[0x4c] = function()
@@ -2829,8 +2789,8 @@ dd_instructions[0x4d] = function()
 dd_instructions[0x4e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   c = core.mem_read((ix + offset) & 0xffff);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   c = mem_read((ix + offset) & 0xffff);
 };
 // 0x54 : LD D, IXH (Undocumented)
 dd_instructions[0x54] = function()
@@ -2846,8 +2806,8 @@ dd_instructions[0x55] = function()
 dd_instructions[0x56] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   d = core.mem_read((ix + offset) & 0xffff);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   d = mem_read((ix + offset) & 0xffff);
 };
 // 0x5c : LD E, IXH (Undocumented)
 dd_instructions[0x5c] = function()
@@ -2863,8 +2823,8 @@ dd_instructions[0x5d] = function()
 dd_instructions[0x5e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   e = core.mem_read((ix + offset) & 0xffff);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   e = mem_read((ix + offset) & 0xffff);
 };
 // 0x60 : LD IXH, B (Undocumented)
 dd_instructions[0x60] = function()
@@ -2900,8 +2860,8 @@ dd_instructions[0x65] = function()
 dd_instructions[0x66] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   h = core.mem_read((ix + offset) & 0xffff);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   h = mem_read((ix + offset) & 0xffff);
 };
 // 0x67 : LD IXH, A (Undocumented)
 dd_instructions[0x67] = function()
@@ -2942,8 +2902,8 @@ dd_instructions[0x6d] = function()
 dd_instructions[0x6e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   l = core.mem_read((ix + offset) & 0xffff);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   l = mem_read((ix + offset) & 0xffff);
 };
 // 0x6f : LD IXL, A (Undocumented)
 dd_instructions[0x6f] = function()
@@ -2954,50 +2914,50 @@ dd_instructions[0x6f] = function()
 dd_instructions[0x70] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   core.mem_write((ix + offset) & 0xffff, b);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   mem_write((ix + offset) & 0xffff, b);
 };
 // 0x71 : LD (IX+n), C
 dd_instructions[0x71] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   core.mem_write((ix + offset) & 0xffff, c);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   mem_write((ix + offset) & 0xffff, c);
 };
 // 0x72 : LD (IX+n), D
 dd_instructions[0x72] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   core.mem_write((ix + offset) & 0xffff, d);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   mem_write((ix + offset) & 0xffff, d);
 };
 // 0x73 : LD (IX+n), E
 dd_instructions[0x73] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   core.mem_write((ix + offset) & 0xffff, e);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   mem_write((ix + offset) & 0xffff, e);
 };
 // 0x74 : LD (IX+n), H
 dd_instructions[0x74] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   core.mem_write((ix + offset) & 0xffff, h);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   mem_write((ix + offset) & 0xffff, h);
 };
 // 0x75 : LD (IX+n), L
 dd_instructions[0x75] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   core.mem_write((ix + offset) & 0xffff, l);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   mem_write((ix + offset) & 0xffff, l);
 };
 // 0x77 : LD (IX+n), A
 dd_instructions[0x77] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   core.mem_write((ix + offset) & 0xffff, a);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   mem_write((ix + offset) & 0xffff, a);
 };
 // 0x7c : LD A, IXH (Undocumented)
 dd_instructions[0x7c] = function()
@@ -3013,8 +2973,8 @@ dd_instructions[0x7d] = function()
 dd_instructions[0x7e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   a = core.mem_read((ix + offset) & 0xffff);
+   var offset = get_signed_offset_byte(mem_read(pc));
+   a = mem_read((ix + offset) & 0xffff);
 };
 // 0x84 : ADD A, IXH (Undocumented)
 dd_instructions[0x84] = function()
@@ -3030,8 +2990,8 @@ dd_instructions[0x85] = function()
 dd_instructions[0x86] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   do_add(core.mem_read((ix + offset) & 0xffff));
+   var offset = get_signed_offset_byte(mem_read(pc));
+   do_add(mem_read((ix + offset) & 0xffff));
 };
 // 0x8c : ADC A, IXH (Undocumented)
 dd_instructions[0x8c] = function()
@@ -3047,8 +3007,8 @@ dd_instructions[0x8d] = function()
 dd_instructions[0x8e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   do_adc(core.mem_read((ix + offset) & 0xffff));
+   var offset = get_signed_offset_byte(mem_read(pc));
+   do_adc(mem_read((ix + offset) & 0xffff));
 };
 // 0x94 : SUB IXH (Undocumented)
 dd_instructions[0x94] = function()
@@ -3064,8 +3024,8 @@ dd_instructions[0x95] = function()
 dd_instructions[0x96] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   do_sub(core.mem_read((ix + offset) & 0xffff));
+   var offset = get_signed_offset_byte(mem_read(pc));
+   do_sub(mem_read((ix + offset) & 0xffff));
 };
 // 0x9c : SBC IXH (Undocumented)
 dd_instructions[0x9c] = function()
@@ -3081,8 +3041,8 @@ dd_instructions[0x9d] = function()
 dd_instructions[0x9e] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   do_sbc(core.mem_read((ix + offset) & 0xffff));
+   var offset = get_signed_offset_byte(mem_read(pc));
+   do_sbc(mem_read((ix + offset) & 0xffff));
 };
 // 0xa4 : AND IXH (Undocumented)
 dd_instructions[0xa4] = function()
@@ -3098,8 +3058,8 @@ dd_instructions[0xa5] = function()
 dd_instructions[0xa6] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   do_and(core.mem_read((ix + offset) & 0xffff));
+   var offset = get_signed_offset_byte(mem_read(pc));
+   do_and(mem_read((ix + offset) & 0xffff));
 };
 // 0xac : XOR IXH (Undocumented)
 dd_instructions[0xac] = function()
@@ -3115,8 +3075,8 @@ dd_instructions[0xad] = function()
 dd_instructions[0xae] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   do_xor(core.mem_read((ix + offset) & 0xffff));
+   var offset = get_signed_offset_byte(mem_read(pc));
+   do_xor(mem_read((ix + offset) & 0xffff));
 };
 // 0xb4 : OR IXH (Undocumented)
 dd_instructions[0xb4] = function()
@@ -3132,8 +3092,8 @@ dd_instructions[0xb5] = function()
 dd_instructions[0xb6] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   do_or(core.mem_read((ix + offset) & 0xffff));
+   var offset = get_signed_offset_byte(mem_read(pc));
+   do_or(mem_read((ix + offset) & 0xffff));
 };
 // 0xbc : CP IXH (Undocumented)
 dd_instructions[0xbc] = function()
@@ -3149,31 +3109,28 @@ dd_instructions[0xbd] = function()
 dd_instructions[0xbe] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
-   do_cp(core.mem_read((ix + offset) & 0xffff));
+   var offset = get_signed_offset_byte(mem_read(pc));
+   do_cp(mem_read((ix + offset) & 0xffff));
 };
 // 0xcb : CB Prefix (IX bit instructions)
 dd_instructions[0xcb] = function()
 {
    pc = (pc + 1) & 0xffff;
-   var offset = get_signed_offset_byte(core.mem_read(pc));
+   var offset = get_signed_offset_byte(mem_read(pc));
    pc = (pc + 1) & 0xffff;
-   var opcode = core.mem_read(pc), value;
+   var opcode = mem_read(pc), value;
    
    // As with the "normal" CB prefix, we implement the DDCB prefix
    //  by decoding the opcode directly, rather than using a table.
    if (opcode < 0x40)
    {
       // Shift and rotate instructions.
-      var ddcb_functions = [do_rlc, do_rrc, do_rl, do_rr,
-                            do_sla, do_sra, do_sll, do_srl];
-      
       // Most of the opcodes in this range are not valid,
       //  so we map this opcode onto one of the ones that is.
-      var func = ddcb_functions[(opcode & 0x38) >>> 3],
-      value = func( core.mem_read((ix + offset) & 0xffff));
+      var func = shift_functions[(opcode & 0x38) >>> 3],
+      value = func( mem_read((ix + offset) & 0xffff));
       
-      core.mem_write((ix + offset) & 0xffff, value);
+      mem_write((ix + offset) & 0xffff, value);
    }
    else
    {
@@ -3184,21 +3141,21 @@ dd_instructions[0xcb] = function()
          // BIT
          flags.N = 0;
          flags.H = 1;
-         flags.Z = !(core.mem_read((ix + offset) & 0xffff) & (1 << bit_number)) ? 1 : 0;
+         flags.Z = !(mem_read((ix + offset) & 0xffff) & (1 << bit_number)) ? 1 : 0;
          flags.P = flags.Z;
          flags.S = ((bit_number === 7) && !flags.Z) ? 1 : 0;
       }
       else if (opcode < 0xc0)
       {
          // RES
-         value = core.mem_read((ix + offset) & 0xffff) & ~(1 << bit_number) & 0xff;
-         core.mem_write((ix + offset) & 0xffff, value);
+         value = mem_read((ix + offset) & 0xffff) & ~(1 << bit_number) & 0xff;
+         mem_write((ix + offset) & 0xffff, value);
       }
       else
       {
          // SET
-         value = core.mem_read((ix + offset) & 0xffff) | (1 << bit_number);
-         core.mem_write((ix + offset) & 0xffff, value);
+         value = mem_read((ix + offset) & 0xffff) | (1 << bit_number);
+         mem_write((ix + offset) & 0xffff, value);
       }
    }
    
@@ -3234,10 +3191,10 @@ dd_instructions[0xe1] = function()
 dd_instructions[0xe3] = function()
 {
    var temp = ix;
-   ix = core.mem_read(sp);
-   ix |= core.mem_read((sp + 1) & 0xffff) << 8;
-   core.mem_write(sp, temp & 0xff);
-   core.mem_write((sp + 1) & 0xffff, (temp >>> 8) & 0xff);
+   ix = mem_read(sp);
+   ix |= mem_read((sp + 1) & 0xffff) << 8;
+   mem_write(sp, temp & 0xff);
+   mem_write((sp + 1) & 0xffff, (temp >>> 8) & 0xff);
 };
 // 0xe5 : PUSH IX
 dd_instructions[0xe5] = function()
@@ -3343,6 +3300,7 @@ let cycle_counts_dd = [
    this.saveState = getState;
    this.loadState = setState;
    this.reset = reset;
+   this.connectCore = connectCore;
    this.advanceInsn = run_instruction;
    this.interrupt = interrupt;
    this.getPC = ():number => { return pc; }
@@ -3373,7 +3331,7 @@ do_delayed_ei : boolean;
 cycle_counter : number;
 }
 
-export class Z80 implements CPU, InstructionBased, IOBusConnected, SavesState<Z80State>, Interruptable<number> {
+export class Z80 implements CPU, InstructionBased, CycleBatched, IOBusConnected, SavesState<Z80State>, Interruptable<number> {
 
   cpu;
   interruptType;
@@ -3384,12 +3342,15 @@ export class Z80 implements CPU, InstructionBased, IOBusConnected, SavesState<Z8
   
   private buildCPU() {
     if (this.memBus && this.ioBus) {
-      this.cpu = new FastZ80({
+      var core = {
         mem_read: this.memBus.read.bind(this.memBus),
         mem_write: this.memBus.write.bind(this.memBus),
         io_read: this.ioBus.read.bind(this.ioBus),
         io_write: this.ioBus.write.bind(this.ioBus),
-      });
+      };
+      // buses are swapped on a running CPU (e.g. when a probe connects)
+      if (this.cpu) this.cpu.connectCore(core);
+      else this.cpu = new FastZ80(core);
     }
   }
   connectMemoryBus(bus:Bus) {
@@ -3406,6 +3367,13 @@ export class Z80 implements CPU, InstructionBased, IOBusConnected, SavesState<Z8
     }
     return this.cpu.advanceInsn();
   }
+  runCycles(maxCycles:number) : number {
+    var n = 0;
+    do {
+      n += this.advanceInsn();
+    } while (n < maxCycles);
+    return n;
+  }
   reset() {
     this.cpu.reset();
   }
@@ -0,0 +1,82 @@
+// Files a source file depends on, by the directives the supported tools use.
+// The IDE loads these before a build, the worker keys its build cache on
+// them, and the ROM tools gather them the same way.
+// Paths are returned as written; callers resolve them against a folder.
+
+// TODO: use tool id to parse files, not platform
+export function parseIncludeDependencies(text: string, verilog: boolean): string[] {
+  let files = [];
+  let m;
+  if (verilog) {
+    // include verilog includes
+    let re1 = /^\s*(`include|[.]include)\s+"(.+?)"/gmi;
+    while (m = re1.exec(text)) {
+      files.push(m[2]);
+    }
+    // for Silice
+    let re1a = /^\s*\$(include|\$dofile|\$write_image_in_table)\('(.+?)'/gmi;
+    while (m = re1a.exec(text)) {
+      files.push(m[2]);
+    }
+    // include .arch (json) statements
+    let re2 = /^\s*([.]arch)\s+(\w+)/gmi;
+    while (m = re2.exec(text)) {
+      files.push(m[2] + ".json");
+    }
+    // include $readmem[bh] (TODO)
+    let re3 = /\$readmem[bh]\("(.+?)"/gmi;
+    while (m = re3.exec(text)) {
+      files.push(m[1]);
+    }
+  } else {
+    // for .asm -- [.%]include "file"
+    // for .c -- #include "file"
+    let re2 = /^\s*[.#%]?(include|incbin|embed)\s+"(.+?)"/gmi;
+    while (m = re2.exec(text)) {
+      files.push(m[2]);
+    }
+    // for .c -- //#resource "file" (or ;resource or #resource)
+    let re3 = /^\s*([;']|[/][/])#(resource)\s+"(.+?)"/gm;
+    while (m = re3.exec(text)) {
+      files.push(m[3]);
+    }
+    // for XASM only (USE include.ext)
+    // for merlin32 (ASM include.ext)
+    let re4 = /^\s+(USE|ASM)\s+(\S+[.]\S+)/gm;
+    while (m = re4.exec(text)) {
+      files.push(m[2]);
+    }
+    // for wiz
+    let re5 = /^\s*(import|embed)\s*"(.+?)";/gmi;
+    while (m = re5.exec(text)) {
+      if (m[1] == 'import')
+        files.push(m[2] + ".wiz");
+      else
+        files.push(m[2]);
+    }
+    // for ecs
+    let re6 = /^\s*(import)\s*"(.+?)"/gmi;
+    while (m = re6.exec(text)) {
+      files.push(m[2]);
+    }
+    // for acme
+    let re7 = /^[!]src\s+"(.+?)"/gmi;
+    while (m = re7.exec(text)) {
+      files.push(m[1]);
+    }
+  }
+  return files;
+}
+
+export function parseLinkDependencies(text: string, verilog: boolean): string[] {
+  let files = [];
+  let m;
+  if (!verilog) {
+    // for .c -- //#link "file" (or ;link or #link)
+    let re = /^\s*([;]|[/][/])#link\s+"(.+?)"/gm;
+    while (m = re.exec(text)) {
+      files.push(m[2]);
+    }
+  }
+  return files;
+}
@@ -24,6 +24,11 @@ export interface InstructionBased {
   advanceInsn(): number;
 }
 
+// runs until at least maxCycles have elapsed, returns cycles
+export interface CycleBatched {
+  runCycles(maxCycles: number): number;
+}
+
 export type TrapCondition = () => boolean;
 
 export interface FrameBased {
@@ -234,6 +239,15 @@ export abstract class BasicHeadlessMachine implements HasCPU, Bus, AcceptsROM, P
 
   nullProbe = new NullProbe();
   probe: ProbeAll = this.nullProbe;
+  // buses are only wrapped by the probe while one is connected
+  cpuMemoryBus: Bus;
+  cpuIOBus: Bus;
+  probedMemoryBus: Bus;
+  probedIOBus: Bus;
+  switchedBuses: { bus: Bus, raw: Bus, probed: Bus }[] = [];
+  // let the CPU run a batch of cycles in its own loop when nothing needs each step
+  // (set false if I/O reads depend on the cycle count within a scanline)
+  batchCPU = true;
 
   abstract read(a: number): number;
   abstract write(a: number, v: number): void;
@@ -242,7 +256,9 @@ export abstract class BasicHeadlessMachine implements HasCPU, Bus, AcceptsROM, P
     this.handler && this.handler(key, code, flags);
   }
   connectProbe(probe: ProbeAll): void {
+    var wasProbed = this.probe !== this.nullProbe;
     this.probe = probe || this.nullProbe;
+    if (wasProbed != (this.probe !== this.nullProbe)) this.switchBuses();
   }
   reset() {
     this.cpu.reset();
@@ -252,11 +268,13 @@ export abstract class BasicHeadlessMachine implements HasCPU, Bus, AcceptsROM, P
     if (data.length > this.rom.length)
       throw new Error(`ROM too big: ${data.length} > ${this.rom.length}}`);
     this.rom.set(data);
+    this.invalidateJIT();
   }
   loadState(state) {
     this.cpu.loadState(state.c);
     this.ram.set(state.ram);
     this.inputs.set(state.inputs);
+    this.invalidateJIT();
   }
   saveState() {
     return {
@@ -276,12 +294,48 @@ export abstract class BasicHeadlessMachine implements HasCPU, Bus, AcceptsROM, P
   advanceCPU() {
     var c = this.cpu as any;
     var n = 1;
+    if (this.probe === this.nullProbe) {
+      if (c.advanceClock) { c.advanceClock(); }
+      else if (c.advanceInsn) { n = c.advanceInsn(1); }
+      return n;
+    }
     if (this.cpu.isStable()) { this.probe.logExecute(this.cpu.getPC(), this.cpu.getSP()); }
     if (c.advanceClock) { c.advanceClock(); }
     else if (c.advanceInsn) { n = c.advanceInsn(1); }
     this.probe.logClocks(n);
     return n;
   }
+  // compile blocks of CPU code to JS, if the CPU supports it
+  // (reads don't see mid-block cycle counts, so not for cycle-timed I/O)
+  enableJIT(enable: boolean) {
+    var c = this.cpu as any;
+    var m = this as any;
+    if (c.enableJIT) c.enableJIT(enable && m.readConst ? (a) => m.readConst(a) : null);
+  }
+  // call when memory changes without a CPU write (bank switch, ROM or state load)
+  invalidateJIT() {
+    var c = this.cpu as any;
+    if (c.invalidateJIT) c.invalidateJIT();
+  }
+  // run a compiled block of up to maxCycles, returns cycles or 0 if there isn't one here
+  advanceJITBlock(maxCycles: number) {
+    var c = this.cpu as any;
+    return (c.jit && this.probe === this.nullProbe) ? c.advanceBlock(maxCycles) : 0;
+  }
+  // run up to maxCycles (at least one step) -- only without a probe or breakpoint
+  advanceCPUBlock(maxCycles: number) {
+    var c = this.cpu as any;
+    // machines that hook each step override this, and do per-block what
+    // their advanceCPU() does per step (see Apple II and Atari 7800)
+    if (this.probe === this.nullProbe && this.advanceCPU === BasicHeadlessMachine.prototype.advanceCPU) {
+      var n = this.advanceJITBlock(maxCycles);
+      if (n) return n;
+      if (c.runCycles && this.batchCPU) {
+        return c.runCycles(maxCycles);
+      }
+    }
+    return this.advanceCPU();
+  }
   probeMemoryBus(membus: Bus & Partial<Bus32>): Bus & Partial<Bus32> {
     return {
       read: (a) => {
@@ -305,7 +359,9 @@ export abstract class BasicHeadlessMachine implements HasCPU, Bus, AcceptsROM, P
     };
   }
   connectCPUMemoryBus(membus: Bus): void {
-    this.cpu.connectMemoryBus(this.probeMemoryBus(membus as Bus&Bus32));
+    this.cpuMemoryBus = membus;
+    this.probedMemoryBus = this.probeMemoryBus(membus as Bus&Bus32);
+    this.cpu.connectMemoryBus(this.probe !== this.nullProbe ? this.probedMemoryBus : membus);
   }
   probeIOBus(iobus: Bus): Bus {
     return {
@@ -320,7 +376,25 @@ export abstract class BasicHeadlessMachine implements HasCPU, Bus, AcceptsROM, P
       },
     };
   }
+  // returns a bus that only goes through the probe while one is connected
   probeDMABus(iobus: Bus): Bus {
+    return this.switchedBus(iobus, this.probeDMABusAlways(iobus));
+  }
+  // same for a CPU memory bus, for CPUs that can't be reconnected
+  probeSwitchedMemoryBus(membus: Bus): Bus {
+    return this.switchedBus(membus, this.probeMemoryBus(membus));
+  }
+  switchedBus(target: Bus, probed: Bus): Bus {
+    var raw = {
+      read: target.read.bind(target),
+      write: target.write.bind(target),
+    };
+    var cur = this.probe !== this.nullProbe ? probed : raw;
+    var bus = { read: cur.read, write: cur.write };
+    this.switchedBuses.push({ bus, raw, probed });
+    return bus;
+  }
+  probeDMABusAlways(iobus: Bus): Bus {
     return {
       read: (a) => {
         let val = iobus.read(a);
@@ -334,7 +408,19 @@ export abstract class BasicHeadlessMachine implements HasCPU, Bus, AcceptsROM, P
     };
   }
   connectCPUIOBus(iobus: Bus): void {
-    this.cpu['connectIOBus'](this.probeIOBus(iobus));
+    this.cpuIOBus = iobus;
+    this.probedIOBus = this.probeIOBus(iobus);
+    this.cpu['connectIOBus'](this.probe !== this.nullProbe ? this.probedIOBus : iobus);
+  }
+  // reconnect the raw or probed buses after a probe is connected or disconnected
+  switchBuses() {
+    var probed = this.probe !== this.nullProbe;
+    if (this.cpuMemoryBus) this.cpu.connectMemoryBus(probed ? this.probedMemoryBus : this.cpuMemoryBus);
+    if (this.cpuIOBus) this.cpu['connectIOBus'](probed ? this.probedIOBus : this.cpuIOBus);
+    for (var sw of this.switchedBuses) {
+      sw.bus.read = (probed ? sw.probed : sw.raw).read;
+      sw.bus.write = (probed ? sw.probed : sw.raw).write;
+    }
   }
 }
 
@@ -397,12 +483,14 @@ export abstract class BasicScanlineMachine extends BasicMachine implements Raste
           sl = 999;
           break;
         }
-        this.frameCycles += this.advanceCPU();
+        this.frameCycles += trap ? this.advanceCPU() : this.advanceCPUBlock(endLineClock - this.frameCycles);
         steps++;
       }
       this.drawScanline();
-      this.probe.logNewScanline();
-      this.probe.logClocks(Math.floor(this.frameCycles - endLineClock)); // remainder of prev. line
+      if (this.probe !== this.nullProbe) {
+        this.probe.logNewScanline();
+        this.probe.logClocks(Math.floor(this.frameCycles - endLineClock)); // remainder of prev. line
+      }
     }
     this.postFrame();
     return steps; // TODO: return steps, not clock? for recorder
@@ -81,6 +81,8 @@ export class RasterVideo {
   ctx : CanvasRenderingContext2D;
   imageData : ImageData;
   datau32 : Uint32Array;
+  prevu32 : Uint32Array; // frame data as last uploaded, to find changed rows
+  fullUpdate = true;     // canvas may not match prevu32, upload everything
   vcanvas : JQuery;
   
   paddle_x = 255;
@@ -116,6 +118,8 @@ export class RasterVideo {
     this.ctx = canvas.getContext('2d');
     this.imageData = this.ctx.createImageData(this.width, this.height);
     this.datau32 = new Uint32Array(this.imageData.data.buffer);
+    this.prevu32 = new Uint32Array(this.datau32.length);
+    this.fullUpdate = true;
   }
 
   setKeyboardEvents(callback) {
@@ -124,16 +128,56 @@ export class RasterVideo {
 
   getFrameData() { return this.datau32; }
 
-  getContext() { return this.ctx; }
+  // whoever draws on the context directly (overlays, etc) gets a full upload next frame
+  getContext() {
+    this.fullUpdate = true;
+    return this.ctx;
+  }
 
   updateFrame(sx?:number, sy?:number, dx?:number, dy?:number, w?:number, h?:number) {
     if (w && h)
       this.ctx.putImageData(this.imageData, sx, sy, dx, dy, w, h);
     else
+      this.updateChangedRows();
+  }
+
+  // upload only the bands of rows that changed since the last frame
+  // (static screens then cost a compare, not a full blit + composite)
+  updateChangedRows() {
+    var data = this.datau32;
+    var prev = this.prevu32;
+    var width = this.width;
+    var height = this.height;
+    if (this.fullUpdate || !prev) {
       this.ctx.putImageData(this.imageData, 0, 0);
+      if (prev) prev.set(data);
+      this.fullUpdate = false;
+      return;
+    }
+    const maxGap = 8; // rows between bands before we do separate blits
+    var y0 = -1;
+    var ylast = -1;
+    for (var y = 0; y <= height; y++) {
+      var dirty = false;
+      if (y < height) {
+        for (var i = y * width, e = i + width; i < e; i++) {
+          if (data[i] !== prev[i]) { dirty = true; break; }
+        }
+      }
+      if (dirty) {
+        if (y0 < 0) y0 = y;
+        ylast = y;
+      } else if (y0 >= 0 && (y - ylast > maxGap || y == height)) {
+        var h = ylast + 1 - y0;
+        this.ctx.putImageData(this.imageData, 0, 0, 0, y0, width, h);
+        prev.set(data.subarray(y0 * width, (ylast + 1) * width), y0 * width);
+        y0 = -1;
+      }
+    }
   }
 
   clearRect(dx:number, dy:number, w:number, h:number) {
+    this.fullUpdate = true;
     var ctx = this.ctx;
     ctx.fillStyle = '#000000';
     ctx.fillRect(dx, dy, w, h);
@@ -689,6 +733,62 @@ export function newAddressDecoder(table : AddressDecoderEntry[], options?:Addres
   return new (AddressDecoder as any)(table, options);
 }
 
+// Memory bus with a table of 256-byte pages.
+// RAM/ROM pages index one backing array directly, so views mapped into the bus
+// must come from alloc(). Unmapped pages (I/O) go to the fallback functions,
+// e.g. from newAddressDecoder(). Bank switching just rewrites page entries.
+export class PageTableBus {
+  mem : Uint8Array;       // backing store for all mapped memory
+  top : number = 0;       // next free byte in mem
+  rpages : Int32Array;    // offset of each page in mem, or -1 if unmapped
+  wpages : Int32Array;
+  readIO : (a:number) => number;
+  writeIO : (a:number, v:number) => void;
+
+  constructor(memsize:number, readIO:(a:number) => number, writeIO:(a:number, v:number) => void, addrbits?:number) {
+    this.mem = new Uint8Array(memsize);
+    this.rpages = new Int32Array(1 << ((addrbits || 16) - 8)).fill(-1);
+    this.wpages = new Int32Array(this.rpages.length).fill(-1);
+    this.readIO = readIO;
+    this.writeIO = writeIO;
+  }
+  alloc(size:number) : Uint8Array {
+    if (this.top + size > this.mem.length) throw new Error("PageTableBus: out of memory");
+    var view = this.mem.subarray(this.top, this.top + size);
+    this.top += size;
+    return view;
+  }
+  // map pages start..end to view[ofs..], repeating if the range is bigger than the view
+  setPages(pages:Int32Array, start:number, end:number, view:Uint8Array, ofs:number) {
+    if (view && view.buffer !== this.mem.buffer) throw new Error("PageTableBus: view not from alloc()");
+    for (var a = start; a <= end; a += 0x100) {
+      pages[a >>> 8] = view ? view.byteOffset + (a - start + ofs) % view.length : -1;
+    }
+  }
+  mapRead(start:number, end:number, view:Uint8Array, ofs?:number) {
+    this.setPages(this.rpages, start, end, view, ofs || 0);
+  }
+  mapWrite(start:number, end:number, view:Uint8Array, ofs?:number) {
+    this.setPages(this.wpages, start, end, view, ofs || 0);
+  }
+  map(start:number, end:number, view:Uint8Array, ofs?:number) {
+    this.mapRead(start, end, view, ofs);
+    this.mapWrite(start, end, view, ofs);
+  }
+  unmap(start:number, end:number) {
+    this.map(start, end, null);
+  }
+  read = (a:number) : number => {
+    var o = this.rpages[a >>> 8];
+    return o >= 0 ? this.mem[o + (a & 0xff)] : this.readIO(a);
+  }
+  write = (a:number, v:number) : void => {
+    var o = this.wpages[a >>> 8];
+    if (o >= 0) this.mem[o + (a & 0xff)] = v;
+    else this.writeIO(a, v);
+  }
+}
+
 
 // https://stackoverflow.com/questions/17130395/real-mouse-position-in-canvas
 export function getMousePos(canvas : HTMLCanvasElement, evt) : {x:number,y:number} {
@@ -0,0 +1,47 @@
+// Runs binaryen optimization passes for HDLModuleWASM, whose passes are
+// synchronous and would otherwise stall the main thread for large designs.
+// Gets an unoptimized wasm binary and a pass list, sends back the optimized
+// binary, or an error message if the passes throw or the result doesn't validate.
+//
+// bundled separately, as its own entry point next to the build worker's:
+//   esbuild src/common/hdl/hdloptworker.ts --bundle --format=iife --outfile=./gen/hdloptworker.js
+// The bundle isn't built yet, so HDLModuleWASM.tiered defaults to false.
+
+import * as binaryen from 'binaryen';
+
+declare function postMessage(msg, transfer?: Transferable[]);
+
+export interface HDLOptimizeRequest {
+    id: number;
+    wasm: Uint8Array;
+    passes: string[];
+}
+
+export interface HDLOptimizeResult {
+    id: number;
+    wasm?: Uint8Array;
+    error?: string;
+}
+
+function optimize(req: HDLOptimizeRequest): HDLOptimizeResult {
+    var bmod: binaryen.Module;
+    try {
+        bmod = binaryen.readBinary(req.wasm);
+        bmod.setFeatures(binaryen.Features.SignExt);
+        var size = req.wasm.length;
+        bmod.runPasses(req.passes);
+        if (!bmod.validate()) throw new Error(`could not validate optimized wasm module`);
+        var wasm = bmod.emitBinary();
+        console.log('optimize', size, '->', wasm.length);
+        return { id: req.id, wasm };
+    } catch (e) {
+        return { id: req.id, error: e + "" };
+    } finally {
+        if (bmod) bmod.dispose();
+    }
+}
+
+onmessage = (e: MessageEvent<HDLOptimizeRequest>) => {
+    var result = optimize(e.data);
+    postMessage(result, result.wasm ? [result.wasm.buffer] : []);
+};
@@ -21,6 +21,14 @@ export interface HDLModuleTrace extends HDLModuleRunner {
     nextTrace() : void;
 }
 
+// captures selected signals after each tick2() cycle, into a ring buffer in module memory
+export interface HDLModuleScope extends HDLModuleRunner {
+    setScopeSignals(names: string[]) : boolean;
+    getScopeBuffer() : Uint32Array;
+    startScope(index: number, maxRecords: number) : void;
+    stopScope() : number;
+}
+
 ///
 
 export interface HDLLogicType extends HDLSourceObject {
@@ -222,6 +230,7 @@ export interface HDLUnit {
     dtypes: { [id: string]: HDLDataType };
     modules: { [id: string]: HDLModuleDef };
     hierarchies: { [id: string]: HDLHierarchyDef };
+    hash?: string; // of the source, for caching compiled modules
 }
 
 export type HDLValue = number | bigint | Uint8Array | Uint16Array | Uint32Array | HDLValue[];
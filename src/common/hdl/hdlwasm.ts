@@ -1,8 +1,9 @@
 
 import * as binaryen from 'binaryen';
 //import binaryen = require("binaryen");
-import { hasDataType, HDLBinop, HDLBlock, HDLConstant, HDLDataType, HDLDataTypeObject, HDLExpr, HDLExtendop, HDLFuncCall, HDLModuleDef, HDLModuleRunner, HDLSourceLocation, HDLSourceObject, HDLTriop, HDLUnop, HDLValue, HDLVariableDef, HDLVarRef, HDLWhileOp, isArrayItem, isArrayType, isBigConstExpr, isBinop, isBlock, isConstExpr, isFuncCall, isLogicType, isTriop, isUnop, isVarDecl, isVarRef, isWhileop } from "./hdltypes";
+import { hasDataType, HDLBinop, HDLBlock, HDLConstant, HDLDataType, HDLDataTypeObject, HDLExpr, HDLExtendop, HDLFuncCall, HDLModuleDef, HDLModuleRunner, HDLModuleScope, HDLSourceLocation, HDLSourceObject, HDLTriop, HDLUnop, HDLValue, HDLVariableDef, HDLVarRef, HDLWhileOp, isArrayItem, isArrayType, isBigConstExpr, isBinop, isBlock, isConstExpr, isFuncCall, isLogicType, isTriop, isUnop, isVarDecl, isVarRef, isWhileop } from "./hdltypes";
 import { HDLError } from "./hdlruntime";
+import type { HDLOptimizeRequest, HDLOptimizeResult } from "./hdloptworker";
 
 const VERILATOR_UNIT_FUNCTIONS = [
     "_ctor_var_reset",
@@ -27,6 +28,69 @@ const TRACERECLEN = "$$treclen";
 const TRACEOFS = "$$tofs";
 const TRACEEND = "$$tend";
 const TRACEBUF = "$$tbuf";
+const SCOPELEFT = "$$sleft";
+const SCOPEOFS = "$$sofs";
+const SCOPEEND = "$$send";
+const SCOPENSIGS = "$$snsigs";
+const SCOPESIGS = "$$ssigs";
+const SCOPEBUF = "$$sbuf";
+const MAX_SCOPE_SIGNALS = 1024;
+
+// default passes crash binaryen.js, so we pick our own
+// https://github.com/WebAssembly/binaryen/blob/369b8bdd3d9d49e4d9e0edf62e14881c14d9e352/src/passes/pass.cpp#L396
+const OPTIMIZE_PASSES = ['dce','optimize-instructions','precompute','simplify-locals','simplify-globals','rse','vacuum'/*,'dae-optimizing','inlining-optimizing'*/];
+
+// compiled modules by hash of the Verilator XML, least recently used first
+// (failed: optimizing this source failed, so don't try again)
+const MODULE_CACHE_SIZE = 8;
+const moduleCache = new Map<string, { module: WebAssembly.Module, optimized: boolean, failed?: boolean }>();
+
+function getCachedModule(key: string) {
+    var entry = moduleCache.get(key);
+    if (entry) {
+        moduleCache.delete(key);
+        moduleCache.set(key, entry);
+    }
+    return entry;
+}
+
+function putCachedModule(key: string, module: WebAssembly.Module, optimized: boolean) {
+    moduleCache.delete(key);
+    moduleCache.set(key, { module, optimized });
+    while (moduleCache.size > MODULE_CACHE_SIZE) {
+        moduleCache.delete(moduleCache.keys().next().value);
+    }
+}
+
+// binaryen passes are synchronous, so tiered optimization runs them in a worker
+const OPTIMIZE_WORKER_URL = "./gen/hdloptworker.js";
+var optimizeWorker: Worker = null;
+var optimizeRequests = new Map<number, { resolve: (wasm: Uint8Array) => void, reject: (e: Error) => void }>();
+var nextOptimizeId = 0;
+
+function optimizeInWorker(wasm: Uint8Array): Promise<Uint8Array> {
+    if (!optimizeWorker) {
+        optimizeWorker = new Worker(OPTIMIZE_WORKER_URL);
+        optimizeWorker.onmessage = (e: MessageEvent<HDLOptimizeResult>) => {
+            var req = optimizeRequests.get(e.data.id);
+            optimizeRequests.delete(e.data.id);
+            if (e.data.error) req.reject(new Error(e.data.error));
+            else req.resolve(e.data.wasm);
+        };
+        // e.g. the worker didn't load: fail what's pending, start a new worker next time
+        optimizeWorker.onerror = (e) => {
+            for (var req of optimizeRequests.values()) req.reject(new Error("optimizer worker: " + e.message));
+            optimizeRequests.clear();
+            optimizeWorker.terminate();
+            optimizeWorker = null;
+        };
+    }
+    var msg: HDLOptimizeRequest = { id: nextOptimizeId++, wasm, passes: OPTIMIZE_PASSES };
+    return new Promise((resolve, reject) => {
+        optimizeRequests.set(msg.id, { resolve, reject });
+        optimizeWorker.postMessage(msg, [wasm.buffer]);
+    });
+}
 
 ///
 
@@ -169,7 +233,7 @@ class Struct {
 
 ///
 
-export class HDLModuleWASM implements HDLModuleRunner {
+export class HDLModuleWASM implements HDLModuleRunner, HDLModuleScope {
 
     bmod: binaryen.Module;
     instance: WebAssembly.Instance;
@@ -184,7 +248,13 @@ export class HDLModuleWASM implements HDLModuleRunner {
     data32: Uint32Array;
     getFileData = null;
     maxMemoryMB: number;
-    optimize: boolean = false;
+    optimize: boolean = false; // optimize before the first compile
+    tiered: boolean = false;   // start unoptimized, then swap in a module optimized in a worker
+                               // (off until the build emits gen/hdloptworker.js, see OPTIMIZE_WORKER_URL)
+    optimized: boolean = false;
+    optimizeFailed: boolean = false;
+    optimizing: Promise<void>;
+    cacheKey: string;
     maxEvalIterations: number = 8;
 
     state: any;
@@ -198,15 +268,21 @@ export class HDLModuleWASM implements HDLModuleRunner {
     traceEndOffset: number;
     trace: any;
 
+    scopeBufferSize: number = 0x100000;
+    scopeSignals: number = 0;
+
     randomizeOnReset: boolean = false;
     finished: boolean;
     stopped: boolean;
     resetStartTimeMsec : number;
 
-    constructor(moddef: HDLModuleDef, constpool: HDLModuleDef, maxMemoryMB?: number) {
+    // cacheKey identifies the source (e.g. a hash of the XML) so compiled modules can be reused;
+    // the binaryen module is still generated, it determines the memory layout
+    constructor(moddef: HDLModuleDef, constpool: HDLModuleDef, maxMemoryMB?: number, cacheKey?: string) {
         this.hdlmod = moddef;
         this.constpool = constpool;
         this.maxMemoryMB = maxMemoryMB || 16;
+        this.cacheKey = cacheKey;
         this.genMemory();
         this.genFuncs();
         this.validate();
@@ -216,6 +292,9 @@ export class HDLModuleWASM implements HDLModuleRunner {
         await this.genModule();
         this.genStateInterface();
         this.enableTracing();
+        if (this.tiered && !this.optimized && !this.optimizeFailed && typeof Worker !== 'undefined') {
+            this.optimizing = this.optimizeModule();
+        }
     }
 
     initSync() {
@@ -312,6 +391,43 @@ export class HDLModuleWASM implements HDLModuleRunner {
         return this.traceRecordSize;
     }
 
+    // returns false if the signals can't be captured
+    setScopeSignals(names: string[]) : boolean {
+        if (names.length > MAX_SCOPE_SIGNALS) return false;
+        var sigs = this.globals.lookup(SCOPESIGS).offset >> 2;
+        for (var i=0; i<names.length; i++) {
+            var rec = this.globals.lookup(names[i]);
+            if (rec == null || (rec.type && isArrayType(rec.type))) return false;
+            // address << 2 | log2(size), larger values are truncated to 32 bits
+            this.data32[sigs + i] = (rec.offset << 2) | (rec.size == 1 ? 0 : rec.size == 2 ? 1 : 2);
+        }
+        this.scopeSignals = names.length;
+        var bufofs = this.globals.lookup(SCOPEBUF).offset;
+        this.state[SCOPENSIGS] = names.length;
+        // wraps at the same index as the JS version
+        this.state[SCOPEEND] = bufofs + (this.scopeBufferSize - names.length * 4);
+        this.state[SCOPEOFS] = bufofs;
+        this.state[SCOPELEFT] = 0;
+        return true;
+    }
+
+    // view into module memory, get again after swapping modules
+    getScopeBuffer() : Uint32Array {
+        return new Uint32Array(this.databuf, this.globals.lookup(SCOPEBUF).offset, this.scopeBufferSize >> 2);
+    }
+
+    // capture up to maxRecords cycles, starting at index (in dwords)
+    startScope(index: number, maxRecords: number) {
+        this.state[SCOPEOFS] = this.globals.lookup(SCOPEBUF).offset + index * 4;
+        this.state[SCOPELEFT] = this.scopeSignals ? maxRecords : 0;
+    }
+
+    // stop capturing, returns the next index
+    stopScope() : number {
+        this.state[SCOPELEFT] = 0;
+        return (this.state[SCOPEOFS] - this.globals.lookup(SCOPEBUF).offset) >> 2;
+    }
+
     dispose() {
         if (this.bmod) {
             this.bmod.dispose();
@@ -382,6 +498,13 @@ export class HDLModuleWASM implements HDLModuleRunner {
         state.addEntry(TRACEOFS, 4, binaryen.i32);
         state.addEntry(TRACEEND, 4, binaryen.i32);
         state.addEntry(TRACEBUF, this.traceBufferSize);
+        // and the scope buffer
+        state.addEntry(SCOPELEFT, 4, binaryen.i32);
+        state.addEntry(SCOPEOFS, 4, binaryen.i32);
+        state.addEntry(SCOPEEND, 4, binaryen.i32);
+        state.addEntry(SCOPENSIGS, 4, binaryen.i32);
+        state.addEntry(SCOPESIGS, MAX_SCOPE_SIGNALS * 4);
+        state.addEntry(SCOPEBUF, this.scopeBufferSize);
         this.traceRecordSize = this.outputbytes;
     }
 
@@ -401,14 +524,13 @@ export class HDLModuleWASM implements HDLModuleRunner {
     }
 
     private validate() {
-        // optimize wasm module (default passes crash binaryen.js)
+        // optimize wasm module
         if (this.optimize) {
             var size = this.bmod.emitBinary().length;
-            // TODO: more passes?
-            // https://github.com/WebAssembly/binaryen/blob/369b8bdd3d9d49e4d9e0edf62e14881c14d9e352/src/passes/pass.cpp#L396
-            this.bmod.runPasses(['dce','optimize-instructions','precompute','simplify-locals','simplify-globals','rse','vacuum'/*,'dae-optimizing','inlining-optimizing'*/])
+            this.bmod.runPasses(OPTIMIZE_PASSES);
             var optsize = this.bmod.emitBinary().length;
-            console.log('optimize', size, '->', optsize)
+            console.log('optimize', size, '->', optsize);
+            this.optimized = true;
         }
         // validate wasm module
         if (!this.bmod.validate()) {
@@ -448,8 +570,16 @@ export class HDLModuleWASM implements HDLModuleRunner {
     }
 
     private async genModule() {
-        var wasmData = this.bmod.emitBinary();
-        var compiled = await WebAssembly.compile(wasmData);
+        var cached = this.cacheKey && getCachedModule(this.cacheKey);
+        var compiled;
+        if (cached) {
+            compiled = cached.module;
+            this.optimized = cached.optimized;
+            this.optimizeFailed = cached.failed;
+        } else {
+            compiled = await WebAssembly.compile(this.bmod.emitBinary());
+            if (this.cacheKey) putCachedModule(this.cacheKey, compiled, this.optimized);
+        }
         this.instance = await WebAssembly.instantiate(compiled, this.getImportObject());
     }
 
@@ -459,12 +589,41 @@ export class HDLModuleWASM implements HDLModuleRunner {
         this.instance = new WebAssembly.Instance(compiled, this.getImportObject());
     }
 
-    private genStateInterface() {
+    // optimizes the module in a worker, then swaps it in with the current memory, between calls;
+    // if anything fails, the unoptimized module keeps running
+    private async optimizeModule() {
+        var compiled, instance;
+        try {
+            compiled = await WebAssembly.compile(await optimizeInWorker(this.bmod.emitBinary()));
+            instance = await WebAssembly.instantiate(compiled, this.getImportObject());
+        } catch (e) {
+            console.log(e);
+            if (!this.bmod) return; // disposed
+            this.optimizeFailed = true;
+            var cached = this.cacheKey && getCachedModule(this.cacheKey);
+            if (cached) cached.failed = true;
+            return;
+        }
+        if (!this.bmod) return; // disposed
+        this.optimized = true;
+        if (this.cacheKey) putCachedModule(this.cacheKey, compiled, true);
+        // no wasm globals, so memory is all the state
+        new Uint8Array((instance.exports[MEMORY] as any).buffer).set(this.data8);
+        this.instance = instance;
+        this.connectMemory();
+    }
+
+    private connectMemory() {
         this.databuf = (this.instance.exports[MEMORY] as any).buffer;
         this.data8 = new Uint8Array(this.databuf);
         this.data16 = new Uint16Array(this.databuf);
         this.data32 = new Uint32Array(this.databuf);
+    }
+
+    private genStateInterface() {
+        this.connectMemory();
         // proxy object to access globals (starting from 0)
+        // (reads the current memory, so it survives swapping modules)
         this.state = this.makeScopeProxy(() => { return 0 });
     }
 
@@ -574,6 +733,7 @@ export class HDLModuleWASM implements HDLModuleRunner {
 
     private addHelperFunctions() {
         this.addCopyTraceRecFunction();
+        this.addCopyScopeRecFunction();
         this.addEvalFunction();
         this.addTick2Function();
     }
@@ -672,6 +832,53 @@ export class HDLModuleWASM implements HDLModuleRunner {
         );
     }
 
+    private addCopyScopeRecFunction() {
+        const m = this.bmod;
+        const o_SCOPELEFT = this.globals.lookup(SCOPELEFT).offset;
+        const o_SCOPEOFS = this.globals.lookup(SCOPEOFS).offset;
+        const o_SCOPEEND = this.globals.lookup(SCOPEEND).offset;
+        const o_SCOPENSIGS = this.globals.lookup(SCOPENSIGS).offset;
+        const o_SCOPESIGS = this.globals.lookup(SCOPESIGS).offset;
+        const o_SCOPEBUF = this.globals.lookup(SCOPEBUF).offset;
+        var i32 = binaryen.i32;
+        var none = binaryen.none;
+        var l_loop = this.label("@loop");
+        var v_addr = () => m.i32.shr_u(m.local.get(3, i32), m.i32.const(2));
+        var v_sizecode = () => m.i32.and(m.local.get(3, i32), m.i32.const(3));
+        m.addFunction("copyScopeRec",
+            binaryen.createType([]),
+            none,
+            [i32, i32, i32, i32], // count, sigptr, dest, desc
+            m.block(null, [
+                // SCOPELEFT--
+                m.i32.store(0, 4, m.i32.const(o_SCOPELEFT),
+                    m.i32.sub(m.i32.load(0, 4, m.i32.const(o_SCOPELEFT)), m.i32.const(1))),
+                m.local.set(0, m.i32.load(0, 4, m.i32.const(o_SCOPENSIGS))),
+                m.local.set(1, m.i32.const(o_SCOPESIGS)),
+                m.local.set(2, m.i32.load(0, 4, m.i32.const(o_SCOPEOFS))),
+                // while ($0--) [$2]++ = value of signal [$1]++
+                m.loop(l_loop, m.block(null, [
+                    m.local.set(3, m.i32.load(0, 4, m.local.get(1, i32))),
+                    m.i32.store(0, 4, m.local.get(2, i32),
+                        m.if(m.i32.eqz(v_sizecode()),
+                            m.i32.load8_u(0, 1, v_addr()),
+                            m.if(m.i32.eq(v_sizecode(), m.i32.const(1)),
+                                m.i32.load16_u(0, 2, v_addr()),
+                                m.i32.load(0, 4, v_addr())))),
+                    m.local.set(1, m.i32.add(m.local.get(1, i32), m.i32.const(4))),
+                    m.local.set(2, m.i32.add(m.local.get(2, i32), m.i32.const(4))),
+                    m.br_if(l_loop, m.local.tee(0, m.i32.sub(m.local.get(0, i32), m.i32.const(1)), i32))
+                ])),
+                // SCOPEOFS = $2 < SCOPEEND ? $2 : @SCOPEBUF
+                m.i32.store(0, 4, m.i32.const(o_SCOPEOFS),
+                    m.select(
+                        m.i32.lt_u(m.local.get(2, i32), m.i32.load(0, 4, m.i32.const(o_SCOPEEND))),
+                        m.local.get(2, i32),
+                        m.i32.const(o_SCOPEBUF)))
+            ])
+        );
+    }
+
     private addTick2Function() {
         const m = this.bmod;
         var l_loop = this.label("@loop");
@@ -683,6 +890,9 @@ export class HDLModuleWASM implements HDLModuleRunner {
                 binaryen.none,
                 [],
                 m.loop(l_loop, m.block(null, [
+                    // call copyScopeRec if capturing, before the tick like snapshotTrace()
+                    m.if(m.i32.load(0, 4, m.i32.const(this.globals.lookup(SCOPELEFT).offset)),
+                        m.call("copyScopeRec", [], binaryen.none)),
                     this.makeSetVariableFunction("clk", 0),
                     m.drop(m.call("eval", [v_dseg], binaryen.i32)),
                     this.makeSetVariableFunction("clk", 1),
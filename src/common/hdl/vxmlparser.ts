@@ -32,6 +32,7 @@ export class VerilogXMLParser implements HDLUnit {
     dtypes: { [id: string]: HDLDataType } = {};
     modules: { [id: string]: HDLModuleDef } = {};
     hierarchies: { [id: string]: HDLHierarchyDef } = {};
+    hash: string;
 
     cur_node : XMLNode;
     cur_module : HDLModuleDef;
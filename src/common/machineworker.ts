@@ -0,0 +1,162 @@
+
+// Runs a Machine in a dedicated worker, so the editor, debug views and
+// build results don't compete with emulation for the main thread.
+// Video goes to an OffscreenCanvas and is sent as an ImageBitmap each frame,
+// audio goes through a SampleRing shared with the main thread's AudioWorklet.
+// The main thread keeps a mirror of the machine and takes over when debugging
+// (see BaseMachinePlatform). Saving the state costs a copy of all of memory, so
+// it is only sent when asked for, on recorder checkpoints and when stopping.
+//
+// bundled separately, as its own entry point next to the build worker's:
+//   esbuild src/common/machineworker.ts --bundle --format=iife --outfile=./gen/machineworker.js
+// the bundle loads TSS with importScripts, so it has to stay in gen/.
+// It isn't checked in; without it, options=worker falls back to the main thread.
+
+import { hasAudio, hasBIOS, hasKeyInput, hasPaddleInput, hasVideo, Machine } from "./baseplatform";
+import { AnimationTimer } from "./emu";
+import { SampleRing, SampleRingSink } from "./audio";
+
+declare var WorkerGlobalScope;
+declare function postMessage(msg, transfer?: Transferable[]);
+declare function importScripts(...urls: string[]);
+
+// module and class in src/machine, with constructor arguments
+export type WorkerMachineSpec = [string, string, any[]?];
+
+// main thread -> worker, fields are handled in this order
+export interface MachineWorkerCommand {
+  gen: number;         // generation, bumped whenever the main thread changes the machine
+  init?: {
+    machine: WorkerMachineSpec;
+    frameRate: number;
+    audio?: { buffer: SharedArrayBuffer, sampleRate: number };
+  };
+  bios?: { title: string, data: Uint8Array };
+  rom?: { title: string, data: Uint8Array };
+  state?: any;
+  controls?: any;
+  reset?: boolean;
+  key?: [number, number, number];
+  paddles?: number[];
+  checkpoints?: { every: number, next: number }; // send the state with frame #next from now, then every n (0 = off)
+  sendState?: boolean; // with the next frame
+  run?: boolean;       // false sends the state it stopped at
+}
+
+// worker -> main thread
+export interface MachineWorkerResult {
+  gen: number;
+  state?: any;          // machine state after the frame, only if asked for
+  frame?: ImageBitmap;  // transferred
+  error?: string;       // emulation stopped
+}
+
+async function loadMachineModule(name: string) {
+  switch (name) {
+    case 'apple2': return import('../machine/apple2');
+    case 'astrocade': return import('../machine/astrocade');
+    case 'atari7800': return import('../machine/atari7800');
+    case 'atari8': return import('../machine/atari8');
+    case 'coleco': return import('../machine/coleco');
+    case 'exidy': return import('../machine/exidy');
+    case 'galaxian': return import('../machine/galaxian');
+    case 'msx': return import('../machine/msx');
+    case 'mw8080bw': return import('../machine/mw8080bw');
+    case 'sms': return import('../machine/sms');
+    case 'vicdual': return import('../machine/vicdual');
+  }
+  throw new Error("Machine not available in worker: " + name);
+}
+
+class MachineWorker {
+  machine: Machine;
+  timer: AnimationTimer;
+  gen = 0;
+  canvas: OffscreenCanvas;
+  ctx: OffscreenCanvasRenderingContext2D;
+  imageData: ImageData;
+  loading: Promise<void>;
+  stateRequested = false;
+  checkpointEvery = 0;
+  checkpointNext = -1;
+
+  async init(cmd: MachineWorkerCommand['init']) {
+    var [modname, clsname, args] = cmd.machine;
+    var mod = await loadMachineModule(modname);
+    var m: Machine = new mod[clsname](...(args || []));
+    if (hasVideo(m)) {
+      var vp = m.getVideoParams();
+      this.canvas = new OffscreenCanvas(vp.width, vp.height);
+      this.ctx = this.canvas.getContext('2d');
+      this.imageData = this.ctx.createImageData(vp.width, vp.height);
+      m.connectVideo(new Uint32Array(this.imageData.data.buffer));
+    }
+    if (hasAudio(m) && cmd.audio) {
+      var ring = new SampleRing(cmd.audio.buffer);
+      m.connectAudio(new SampleRingSink(ring, m.getAudioParams().sampleRate, cmd.audio.sampleRate));
+    }
+    this.machine = m;
+    this.timer = new AnimationTimer(cmd.frameRate, this.nextFrame.bind(this));
+  }
+  async handle(cmd: MachineWorkerCommand) {
+    if (cmd.init) this.loading = this.init(cmd.init);
+    await this.loading; // commands queue up behind init
+    var m = this.machine;
+    this.gen = cmd.gen;
+    if (cmd.bios && hasBIOS(m)) m.loadBIOS(cmd.bios.data, cmd.bios.title);
+    if (cmd.rom) m.loadROM(cmd.rom.data, cmd.rom.title);
+    if (cmd.state) m.loadState(cmd.state);
+    if (cmd.controls) m.loadControlsState(cmd.controls);
+    if (cmd.reset) m.reset();
+    if (cmd.key && hasKeyInput(m)) m.setKeyInput(cmd.key[0], cmd.key[1], cmd.key[2]);
+    if (cmd.paddles && hasPaddleInput(m)) {
+      cmd.paddles.forEach((value, i) => m['setPaddleInput'](i, value));
+    }
+    if (cmd.checkpoints) {
+      this.checkpointEvery = cmd.checkpoints.every;
+      this.checkpointNext = cmd.checkpoints.next;
+    }
+    if (cmd.sendState) this.stateRequested = true;
+    if (cmd.run === true) this.timer.start();
+    if (cmd.run === false) {
+      this.timer.stop();
+      postMessage({ gen: this.gen, state: m.saveState() });
+    }
+  }
+  // is this frame a recorder checkpoint?
+  isCheckpoint() {
+    if (this.checkpointEvery <= 0 || this.checkpointNext-- > 0) return false;
+    this.checkpointNext = this.checkpointEvery - 1;
+    return true;
+  }
+  nextFrame() {
+    var result: MachineWorkerResult = { gen: this.gen };
+    try {
+      this.machine.advanceFrame(null);
+    } catch (e) {
+      this.timer.stop();
+      result.error = e.message || e + "";
+    }
+    if (this.isCheckpoint() || this.stateRequested || result.error) {
+      result.state = this.machine.saveState();
+      this.stateRequested = false;
+    }
+    if (this.ctx) {
+      this.ctx.putImageData(this.imageData, 0, 0);
+      result.frame = this.canvas.transferToImageBitmap();
+    }
+    postMessage(result, result.frame ? [result.frame] : []);
+  }
+}
+
+if (typeof WorkerGlobalScope !== 'undefined') {
+  // sound chips use the TSS globals, as loaded by index.html (paths are relative to gen/)
+  importScripts('../tss/js/tss/PsgDeviceChannel.js', '../tss/js/tss/MasterChannel.js',
+    '../tss/js/tss/AudioLooper.js', '../tss/js/Log.js');
+  var worker = new MachineWorker();
+  onmessage = (e) => {
+    worker.handle(e.data).catch((err) => {
+      postMessage({ gen: e.data.gen, error: err.message || err + "" });
+    });
+  };
+}
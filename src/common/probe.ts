@@ -17,6 +17,7 @@ export enum ProbeFlags {
   VRAM_WRITE= 0x17000000,
   DMA_READ  = 0x18000000,
   DMA_WRITE = 0x19000000,
+  EXECUTE_READ = 0x1a000000, // EXECUTE + MEM_READ of the opcode at the same address
   WAIT      = 0x1f000000,
   SCANLINE	= 0x7e000000,
   FRAME		  = 0x7f000000,
@@ -35,6 +36,15 @@ export class ProbeRecorder implements ProbeAll {
   sl : number = 0;    // scanline
   cur_sp = -1;        // last stack pointer
   singleFrame : boolean = true; // clear between frames
+  // ring mode: keep the last N frames instead of stopping when full
+  ringFrames : number = 0;
+  head : number = 0;        // index of oldest word
+  wrapped : boolean = false; // true if buf[head..] precedes buf[..idx]
+  frameStarts : number[] = []; // indices of FRAME words after head
+  limit : number = 0;       // log() takes the slow path at this index
+  // streaming: called with each frame's words, in order (a view into buf, only valid during the call)
+  onChunk : (words: Uint32Array) => void = null;
+  chunkStart : number = 0;  // first word not yet passed to onChunk
 
   constructor(m:Probeable, buflen?:number) {
     this.m = m;
@@ -47,44 +57,105 @@ export class ProbeRecorder implements ProbeAll {
     this.m.connectProbe(null);
   }
   reset(newbuflen? : number) {
+    this.flushChunk();
     if (newbuflen) this.buf = new Uint32Array(newbuflen);
     this.sl = 0;
     this.cur_sp = -1;
     this.clear();
   }
   clear() {
+    this.flushChunk();
     this.idx = 0;
+    this.chunkStart = 0;
+    this.head = 0;
+    this.wrapped = false;
+    this.frameStarts = [];
+    this.updateLimit();
+  }
+  setRingFrames(frames : number) {
+    this.ringFrames = frames;
+    this.singleFrame = !frames;
+    this.clear();
+  }
+  streamTo(fn : (words: Uint32Array) => void) {
+    this.flushChunk();
+    this.onChunk = fn;
+  }
+  // pass on the words logged since the last chunk (merges never reach back past a frame or a wrap)
+  flushChunk() {
+    if (this.onChunk && this.idx > this.chunkStart)
+      this.onChunk(this.buf.subarray(this.chunkStart, this.idx));
+    this.chunkStart = this.idx;
+  }
+  updateLimit() {
+    this.limit = this.wrapped ? this.head : this.buf.length;
+  }
+  // drop the oldest frame (or part of it, if there's only one)
+  dropFrame() {
+    var head = this.frameStarts.length ? this.frameStarts.shift() : this.idx + (this.buf.length >> 4) + 1;
+    if (head >= this.buf.length) head = 0;
+    if (head <= this.idx) this.wrapped = false;
+    this.head = head;
+  }
+  // returns false if the word can't be logged
+  makeRoom() : boolean {
+    if (this.idx >= this.buf.length) {
+      if (!this.ringFrames) return false;
+      this.flushChunk();
+      this.idx = this.chunkStart = 0;
+      this.wrapped = true;
+    }
+    while (this.wrapped && this.idx == this.head) this.dropFrame();
+    this.updateLimit();
+    return true;
   }
   logData(a:number) {
     this.log(a);
   }
   log(a:number) {
-    // TODO: coalesce READ and EXECUTE and PUSH/POP
-    if (this.idx >= this.buf.length) return;
+    if (this.idx >= this.limit && !this.makeRoom()) return;
     this.buf[this.idx++] = a;
   }
   relog(a:number) {
     this.buf[this.idx-1] = a;
   }
+  // is buf[idx-n] a logged word?
+  hasPrev(n:number) : boolean {
+    return this.idx >= n && (this.wrapped || this.idx - n >= this.head);
+  }
   lastOp() {
-    if (this.idx > 0)
+    if (this.hasPrev(1))
       return this.buf[this.idx-1] & 0xff000000;
     else
       return -1;
   }
   lastAddr() {
-    if (this.idx > 0)
+    if (this.hasPrev(1))
       return this.buf[this.idx-1] & 0xffffff;
     else
       return -1;
   }
   addLogBuffer(src: Uint32Array) {
+    if (this.ringFrames) {
+      for (var i=0; i<src.length; i++) this.log(src[i]);
+      return;
+    }
     if (this.idx + src.length > this.buf.length) {
       src = src.slice(0, this.buf.length - this.idx);
     }
     this.buf.set(src, this.idx);
     this.idx += src.length;
-}
+  }
+  // logged words in order, as one or two views into the buffer
+  getSegments() : Uint32Array[] {
+    if (this.wrapped)
+      return [this.buf.subarray(this.head), this.buf.subarray(0, this.idx)];
+    else
+      return [this.buf.subarray(this.head, this.idx)];
+  }
+  isEmpty() : boolean {
+    return !this.wrapped && this.idx == this.head;
+  }
   logClocks(clocks:number) {
     clocks |= 0;
     if (clocks > 0) {
@@ -101,7 +172,14 @@ export class ProbeRecorder implements ProbeAll {
   logNewFrame() {
     this.log(ProbeFlags.FRAME);
     this.sl = 0;
-    if (this.singleFrame) this.clear();
+    if (this.ringFrames) {
+      this.flushChunk();
+      if (this.hasPrev(1) && this.idx-1 != this.head) this.frameStarts.push(this.idx-1);
+      while (this.frameStarts.length > this.ringFrames) this.dropFrame();
+      this.updateLimit();
+    } else if (this.singleFrame) {
+      this.clear();
+    }
   }
   logExecute(address:number, SP:number) {
     // record stack pushes/pops (from last instruction)
@@ -113,6 +191,12 @@ export class ProbeRecorder implements ProbeAll {
         this.log(ProbeFlags.SP_POP | SP);
       }
       this.cur_sp = SP;
+    } else if (address < 0x10000) {
+      // merge with the opcode fetch, if it came just before
+      if (this.hasPrev(1) && (this.buf[this.idx-1] & 0xff00ffff) == (address | ProbeFlags.MEM_READ)) {
+        this.buf[this.idx-1] ^= ProbeFlags.MEM_READ ^ ProbeFlags.EXECUTE_READ;
+        return;
+      }
     }
     this.log(address | ProbeFlags.EXECUTE);
   }
@@ -123,6 +207,11 @@ export class ProbeRecorder implements ProbeAll {
     this.log((address & 0xffff) | ((value & 0xff)<<16) | op);
   }
   logRead(address:number, value:number) {
+    // merge with the EXECUTE just before, if this is the opcode fetch
+    if (this.hasPrev(1) && this.buf[this.idx-1] === ((address & 0xffff) | ProbeFlags.EXECUTE)) {
+      this.relog((address & 0xffff) | ((value & 0xff)<<16) | ProbeFlags.EXECUTE_READ);
+      return;
+    }
     this.logValue(address, value, ProbeFlags.MEM_READ);
   }
   logWrite(address:number, value:number) {
@@ -154,19 +243,65 @@ export class ProbeRecorder implements ProbeAll {
   }
   countEvents(op : number) : number {
     var count = 0;
-    for (var i=0; i<this.idx; i++) {
-      if ((this.buf[i] & 0xff000000) == op)
-        count++;
+    var merged = (op == ProbeFlags.EXECUTE || op == ProbeFlags.MEM_READ) ? ProbeFlags.EXECUTE_READ : op;
+    for (var seg of this.getSegments()) {
+      for (var i=0; i<seg.length; i++) {
+        var o = seg[i] & 0xff000000;
+        if (o == op || o == merged)
+          count++;
+      }
     }
     return count;
   }
   countClocks() : number {
     var count = 0;
-    for (var i=0; i<this.idx; i++) {
-      if ((this.buf[i] & 0xff000000) == ProbeFlags.CLOCKS)
-        count += this.buf[i] & 0xffff;
+    for (var seg of this.getSegments()) {
+      for (var i=0; i<seg.length; i++) {
+        if ((seg[i] & 0xff000000) == ProbeFlags.CLOCKS)
+          count += seg[i] & 0xffff;
+      }
     }
     return count;
   }
 
 }
+
+// Folds streamed probe words (see ProbeRecorder.streamTo) into counts per
+// event type and address, for views that total more frames than the
+// recorder keeps. No DOM dependencies.
+export class ProbeAggregator {
+  counts = new Map<number, Uint32Array>(); // event type -> count per address
+  frames = 0;
+
+  add(words: Uint32Array) {
+    for (var i=0; i<words.length; i++) {
+      var word = words[i];
+      var op = word & 0xff000000;
+      switch (op) {
+        case ProbeFlags.FRAME: this.frames++; break;
+        case ProbeFlags.SCANLINE:
+        case ProbeFlags.CLOCKS: break;
+        case ProbeFlags.EXECUTE_READ:
+          this.count(ProbeFlags.EXECUTE, word & 0xffff);
+          this.count(ProbeFlags.MEM_READ, word & 0xffff);
+          break;
+        default:
+          this.count(op, word & 0xffff);
+          break;
+      }
+    }
+  }
+  count(op : number, addr : number) {
+    var counts = this.counts.get(op);
+    if (!counts) this.counts.set(op, counts = new Uint32Array(0x10000));
+    counts[addr]++;
+  }
+  get(op : number, addr : number) : number {
+    var counts = this.counts.get(op);
+    return counts ? counts[addr & 0xffff] : 0;
+  }
+  clear() {
+    this.counts.clear();
+    this.frames = 0;
+  }
+}
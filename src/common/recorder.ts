@@ -6,15 +6,146 @@ import { getNoiseSeed, setNoiseSeed } from "./emu";
 
 type FrameRec = {controls:EmuControlsState, seed:number};
 
+// CHECKPOINT DELTAS
+
+// typed array stored as XOR against the keyframe's array at the same path
+class XORDelta {
+    constructor(public data : Uint8Array) { }
+}
+
+type Checkpoint = {
+    key : EmuState;     // keyframe state (the full state, if this is a keyframe)
+    delta : any;        // null for keyframes
+    size : number;      // approx. bytes retained by this checkpoint
+};
+
+const MIN_ZERO_RUN = 4; // shorter runs of unchanged bytes stay in the literals
+
+var scratch = new Uint8Array(0);
+
+function asBytes(v : ArrayBufferView) : Uint8Array {
+    return new Uint8Array(v.buffer, v.byteOffset, v.byteLength);
+}
+
+function writeVarint(out : Uint8Array, pos : number, n : number) : number {
+    while (n >= 0x80) {
+        out[pos++] = (n & 0x7f) | 0x80;
+        n >>>= 7;
+    }
+    out[pos++] = n;
+    return pos;
+}
+
+// XOR a with b, run-length encoded as [zero run][literal count][literals]...
+export function xorEncode(a : Uint8Array, b : Uint8Array) : Uint8Array {
+    var n = a.length;
+    if (scratch.length < n + (n >> 1) + 16) scratch = new Uint8Array(n + (n >> 1) + 16);
+    var out = scratch;
+    var pos = 0;
+    var i = 0;
+    while (i < n) {
+        var z = i;
+        while (i < n && a[i] === b[i]) i++;
+        if (i == n) break;
+        var lit = i;
+        var zeros = 0;
+        while (i < n) {
+            if (a[i] === b[i]) {
+                if (++zeros >= MIN_ZERO_RUN) break;
+            } else {
+                zeros = 0;
+            }
+            i++;
+        }
+        if (zeros >= MIN_ZERO_RUN) i -= zeros - 1; else i -= zeros;
+        pos = writeVarint(out, pos, lit - z);
+        pos = writeVarint(out, pos, i - lit);
+        for (var j = lit; j < i; j++) out[pos++] = a[j] ^ b[j];
+    }
+    return out.slice(0, pos);
+}
+
+export function xorDecode(enc : Uint8Array, b : Uint8Array) : Uint8Array {
+    var out = b.slice(0);
+    var pos = 0;
+    var i = 0;
+    while (pos < enc.length) {
+        for (var k = 0; ; k += 7) {
+            var c = enc[pos++];
+            i += (c & 0x7f) * Math.pow(2, k);
+            if (c < 0x80) break;
+        }
+        var len = 0;
+        for (var k = 0; ; k += 7) {
+            var c = enc[pos++];
+            len += (c & 0x7f) * Math.pow(2, k);
+            if (c < 0x80) break;
+        }
+        while (len-- > 0) out[i++] ^= enc[pos++];
+    }
+    return out;
+}
+
+function isPlainObject(v) : boolean {
+    return v !== null && typeof v === 'object' && (Array.isArray(v) || Object.getPrototypeOf(v) === Object.prototype);
+}
+
+// walk state and key together, replacing typed arrays with XOR deltas
+function encodeState(state, key, sizes : {size:number}) {
+    if (ArrayBuffer.isView(state)) {
+        if (key && key.constructor === state.constructor && key.byteLength === state.byteLength) {
+            var d = new XORDelta(xorEncode(asBytes(state), asBytes(key)));
+            sizes.size += d.data.length;
+            return d;
+        }
+        sizes.size += state.byteLength;
+        return state;
+    }
+    if (isPlainObject(state)) {
+        var o = Array.isArray(state) ? [] : {};
+        var k2 = isPlainObject(key) ? key : {};
+        for (var k in state) o[k] = encodeState(state[k], k2[k], sizes);
+        sizes.size += 16;
+        return o;
+    }
+    return state;
+}
+
+function decodeState(delta, key) {
+    if (delta instanceof XORDelta) {
+        var bytes = xorDecode(delta.data, asBytes(key));
+        return key instanceof Uint8Array ? bytes : new key.constructor(bytes.buffer);
+    }
+    if (isPlainObject(delta)) {
+        var o = Array.isArray(delta) ? [] : {};
+        var k2 = isPlainObject(key) ? key : {};
+        for (var k in delta) o[k] = decodeState(delta[k], k2[k]);
+        return o;
+    }
+    return delta;
+}
+
+function stateSize(state) : number {
+    var sizes = {size:0};
+    encodeState(state, null, sizes);
+    return sizes.size;
+}
+
 export class StateRecorderImpl implements EmuRecorder {
   
     checkpointInterval : number = 10;
     callbackStateChanged : () => void;
     callbackNewCheckpoint : (state:EmuState) => void;
     maxCheckpoints : number = 300;
+    keyframeInterval : number = 10; // checkpoints per keyframe, the rest are deltas
+    maxMemory : number = 64*1024*1024; // approx. bytes of checkpoints to keep
     
     platform : Platform;
-    checkpoints : EmuState[];
+    ring : Checkpoint[];    // checkpoints, oldest at ringStart
+    ringStart : number;
+    numCheckpoints : number;
+    memoryUsed : number;
+    decodeCache : Map<Checkpoint,EmuState>; // recently decoded checkpoints, for scrubbing
     framerecs : FrameRec[];
     frameCount : number;
     lastSeekFrame : number;
@@ -27,7 +158,11 @@ export class StateRecorderImpl implements EmuRecorder {
     }
 
     reset() {
-        this.checkpoints = [];
+        this.ring = [];
+        this.ringStart = 0;
+        this.numCheckpoints = 0;
+        this.memoryUsed = 0;
+        this.decodeCache = new Map();
         this.framerecs = [];
         this.frameCount = 0;
         this.lastSeekFrame = 0;
@@ -71,28 +206,76 @@ export class StateRecorderImpl implements EmuRecorder {
       return this.lastSeekStep;
   }
 
+    checkpointAt(i : number) : Checkpoint {
+        return this.ring[(this.ringStart + i) % this.ring.length];
+    }
+
     recordFrame(state : EmuState) {
-        this.checkpoints.push(state);
+        var cp : Checkpoint;
+        var last = this.numCheckpoints && this.checkpointAt(this.numCheckpoints-1);
+        if (this.numCheckpoints % this.keyframeInterval == 0 || !last) {
+            cp = {key:state, delta:null, size:stateSize(state)};
+        } else {
+            var sizes = {size:0};
+            cp = {key:last.key, delta:encodeState(state, last.key, sizes), size:sizes.size};
+        }
+        // ring full? double its size
+        if (this.numCheckpoints == this.ring.length) {
+            var ring = new Array(Math.max(16, this.ring.length * 2)).fill(null);
+            for (var i = 0; i < this.numCheckpoints; i++) ring[i] = this.checkpointAt(i);
+            this.ring = ring;
+            this.ringStart = 0;
+        }
+        this.ring[(this.ringStart + this.numCheckpoints) % this.ring.length] = cp;
+        this.numCheckpoints++;
+        this.memoryUsed += cp.size;
         if (this.callbackNewCheckpoint) this.callbackNewCheckpoint(state);
-        // checkpoints full?
-        if (this.checkpoints.length > this.maxCheckpoints) {
-            this.checkpoints.shift(); // remove 1st checkpoint
-            this.framerecs = this.framerecs.slice(this.checkpointInterval);
-            this.lastSeekFrame -= this.checkpointInterval;
-            this.frameCount -= this.checkpointInterval;
+        // checkpoints full? drop the oldest keyframe and its deltas
+        while (this.numCheckpoints > this.keyframeInterval
+            && (this.numCheckpoints > this.maxCheckpoints || this.memoryUsed > this.maxMemory)) {
+            var n = this.keyframeInterval;
+            for (var i = 0; i < n; i++) {
+                var old = this.checkpointAt(0);
+                this.memoryUsed -= old.size;
+                this.decodeCache.delete(old);
+                this.ring[this.ringStart] = null;
+                this.ringStart = (this.ringStart + 1) % this.ring.length;
+                this.numCheckpoints--;
+            }
+            this.framerecs = this.framerecs.slice(this.checkpointInterval * n);
+            this.lastSeekFrame -= this.checkpointInterval * n;
+            this.frameCount -= this.checkpointInterval * n;
             if (this.callbackStateChanged) this.callbackStateChanged();
         }
     }
 
+    getCheckpoint(i : number) : EmuState {
+        var cp = this.checkpointAt(i);
+        if (!cp.delta) return cp.key;
+        var state = this.decodeCache.get(cp);
+        if (!state) {
+            state = decodeState(cp.delta, cp.key);
+            if (this.decodeCache.size >= 8) this.decodeCache.delete(this.decodeCache.keys().next().value);
+            this.decodeCache.set(cp, state);
+        }
+        return state;
+    }
+
+    getCheckpoints() : EmuState[] {
+        var states = [];
+        for (var i = 0; i < this.numCheckpoints; i++) states.push(this.getCheckpoint(i));
+        return states;
+    }
+
     getStateAtOrBefore(frame : number) : {frame : number, state : EmuState} {
         // initial frame?
-        if (frame <= 0 && this.checkpoints.length > 0)
-          return {frame:0, state:this.checkpoints[0]};
+        if (frame <= 0 && this.numCheckpoints > 0)
+          return {frame:0, state:this.getCheckpoint(0)};
 
         var bufidx = Math.floor(frame / this.checkpointInterval);
-        var foundidx = bufidx < this.checkpoints.length ? bufidx : this.checkpoints.length-1;
+        var foundidx = bufidx < this.numCheckpoints ? bufidx : this.numCheckpoints-1;
         var foundframe = foundidx * this.checkpointInterval;
-        return {frame:foundframe, state:this.checkpoints[foundidx]};
+        return {frame:foundframe, state:foundidx >= 0 ? this.getCheckpoint(foundidx) : null};
     }
 
     loadFrame(seekframe : number, seekstep? : number) : number {
@@ -142,7 +325,7 @@ export class StateRecorderImpl implements EmuRecorder {
     }
     
     getLastCheckpoint() : EmuState {
-        return this.checkpoints.length && this.checkpoints[this.checkpoints.length-1];
+        return this.numCheckpoints && this.getCheckpoint(this.numCheckpoints-1);
     }
 }
 
@@ -0,0 +1,225 @@
+
+import { NullProbe, ProbeAll } from "./devices";
+import { Segment } from "./workertypes";
+
+// Reverse execution for the debugger.
+// Sits in front of the probe while single-stepping and logs, for each
+// instruction in a window before the target clock, the CPU state before it
+// and the previous contents of every RAM location it writes. Undoing an
+// instruction then only costs its own writes, instead of replaying the frame
+// up to the previous clock. Device state (I/O, VRAM, DMA, bank switches)
+// isn't logged, so instructions that touch it, or write outside of RAM,
+// are marked impure and the caller has to fall back to replaying.
+
+export interface UndoableMachine {
+  cpu: { saveState(): any, loadState(state: any): void };
+  readConst?(a: number): number;
+  write(a: number, v: number): void; // only called for RAM addresses
+}
+
+// RAM segments of a memory map (see Platform.getMemoryMap)
+export function isRAMIn(segments: Segment[]): (a: number) => boolean {
+  var ram = segments.filter((seg) => seg.type == 'ram');
+  return (a: number) => {
+    for (var seg of ram) {
+      if (a >= seg.start && a < seg.start + seg.size) return true;
+    }
+    return false;
+  };
+}
+
+export interface UndoStep {
+  clock: number;  // debug clock before the instruction
+  cpu: any;       // CPU state before the instruction
+}
+
+export class UndoLog implements ProbeAll {
+
+  m: UndoableMachine;
+  getClock: () => number;
+  isRAM: (a: number) => boolean;
+  minClock = 0;     // instructions before this clock aren't logged
+  nullProbe = new NullProbe();
+  next: ProbeAll = this.nullProbe; // probe to forward events to
+  // ring of steps
+  maxSteps: number;
+  clocks: Float64Array;
+  cpus: any[];
+  wstarts: Float64Array;  // write counter at start of step
+  pure: Uint8Array;
+  first = 0;
+  count = 0;
+  // ring of writes, indexed by a running counter
+  waddr: Int32Array;
+  wold: Int32Array;
+  wnew: Int32Array;
+  wcount = 0;
+  open = false;     // newest step is still executing
+  sealed = false;   // stopped at a breakpoint, ignore everything until clear()
+
+  constructor(m: UndoableMachine, getClock: () => number, isRAM: (a: number) => boolean, maxSteps?: number, maxWrites?: number) {
+    this.m = m;
+    this.getClock = getClock;
+    this.isRAM = isRAM;
+    this.maxSteps = maxSteps || 10000;
+    this.clocks = new Float64Array(this.maxSteps);
+    this.cpus = new Array(this.maxSteps);
+    this.wstarts = new Float64Array(this.maxSteps);
+    this.pure = new Uint8Array(this.maxSteps);
+    maxWrites = maxWrites || 0x10000;
+    this.waddr = new Int32Array(maxWrites);
+    this.wold = new Int32Array(maxWrites);
+    this.wnew = new Int32Array(maxWrites);
+    this.clear();
+  }
+  clear() {
+    this.first = 0;
+    this.count = 0;
+    this.wcount = 0;
+    this.open = false;
+    this.sealed = false;
+    this.cpus.fill(null);
+  }
+  // stop logging, e.g. when a breakpoint is hit
+  seal() {
+    this.closeStep();
+    this.sealed = true;
+  }
+  last(): number {
+    return (this.first + this.count - 1) % this.maxSteps;
+  }
+  canUndo(): boolean {
+    return this.count > 0 && !this.open && this.pure[this.last()] != 0;
+  }
+  // clock of the step that undo() would restore, or -1
+  peekClock(): number {
+    return this.canUndo() ? this.clocks[this.last()] : -1;
+  }
+  markImpure() {
+    if (this.open) this.pure[this.last()] = 0;
+  }
+  closeStep() {
+    if (!this.open) return;
+    this.open = false;
+    var i = this.last();
+    if (!this.pure[i]) return;
+    // writes must have stuck (the map can list write-protected banks as RAM)
+    // (only the last write to each address, RMW instructions write twice)
+    var start = this.wstarts[i];
+    var len = this.waddr.length;
+    for (var w = this.wcount - 1; w >= start; w--) {
+      var a = this.waddr[w % len];
+      var later = false;
+      for (var w2 = w + 1; w2 < this.wcount; w2++) {
+        if (this.waddr[w2 % len] == a) { later = true; break; }
+      }
+      if (!later && this.m.readConst(a) != this.wnew[w % len]) {
+        this.pure[i] = 0;
+        return;
+      }
+    }
+  }
+  dropOldest() {
+    this.cpus[this.first] = null;
+    this.first = (this.first + 1) % this.maxSteps;
+    this.count--;
+  }
+  // restores the state before the newest step and removes it from the log
+  // returns null if there's nothing to undo, or the step can't be undone
+  undo(): UndoStep {
+    if (!this.canUndo()) return null;
+    var i = this.last();
+    var start = this.wstarts[i];
+    var len = this.waddr.length;
+    for (var w = this.wcount - 1; w >= start; w--) {
+      var a = this.waddr[w % len];
+      var v = this.wold[w % len];
+      this.m.write(a, v);
+      if (this.m.readConst(a) != v) {
+        this.clear();
+        return null;
+      }
+    }
+    var step = { clock: this.clocks[i], cpu: this.cpus[i] };
+    this.m.cpu.loadState(step.cpu);
+    this.cpus[i] = null;
+    this.count--;
+    this.wcount = start;
+    return step;
+  }
+
+  logExecute(address: number, SP: number) {
+    this.next.logExecute(address, SP);
+    if (this.sealed) return;
+    this.closeStep();
+    var clock = this.getClock();
+    if (clock < this.minClock) return;
+    if (this.count == this.maxSteps) this.dropOldest();
+    var i = (this.first + this.count++) % this.maxSteps;
+    this.clocks[i] = clock;
+    this.cpus[i] = this.m.cpu.saveState();
+    this.wstarts[i] = this.wcount;
+    this.pure[i] = 1;
+    this.open = true;
+  }
+  logWrite(address: number, value: number) {
+    this.next.logWrite(address, value);
+    if (!this.open || this.sealed) return;
+    var i = this.last();
+    if (!this.pure[i]) return;
+    // writing it back could have side effects
+    if (!this.isRAM(address)) {
+      this.pure[i] = 0;
+      return;
+    }
+    var len = this.waddr.length;
+    // make room by dropping the oldest steps
+    while (this.count > 1 && this.wcount - this.wstarts[this.first] >= len) {
+      this.dropOldest();
+    }
+    if (this.wcount - this.wstarts[i] >= len) {
+      this.pure[i] = 0;
+      return;
+    }
+    var w = this.wcount++ % len;
+    this.waddr[w] = address;
+    this.wold[w] = this.m.readConst(address);
+    this.wnew[w] = value;
+  }
+  logIORead(address: number, value: number) {
+    this.next.logIORead(address, value);
+    this.markImpure();
+  }
+  logIOWrite(address: number, value: number) {
+    this.next.logIOWrite(address, value);
+    this.markImpure();
+  }
+  logVRAMWrite(address: number, value: number) {
+    this.next.logVRAMWrite(address, value);
+    this.markImpure();
+  }
+  logDMAWrite(address: number, value: number) {
+    this.next.logDMAWrite(address, value);
+    this.markImpure();
+  }
+  logIllegal(address: number) {
+    this.next.logIllegal(address);
+    this.markImpure();
+  }
+  logClocks(clocks: number) { this.next.logClocks(clocks); }
+  logNewScanline() { this.next.logNewScanline(); }
+  logNewFrame() { this.next.logNewFrame(); }
+  logInterrupt(type: number) { this.next.logInterrupt(type); }
+  logWait(address: number) { this.next.logWait(address); }
+  logRead(address: number, value: number) { this.next.logRead(address, value); }
+  logDMARead(address: number, value: number) { this.next.logDMARead(address, value); }
+  logVRAMRead(address: number, value: number) { this.next.logVRAMRead(address, value); }
+  logData(data: number) {
+    this.next.logData(data);
+    this.markImpure();
+  }
+  addLogBuffer(src: Uint32Array) {
+    this.next.addLogBuffer(src);
+    this.markImpure();
+  }
+}
@@ -511,6 +511,29 @@ export function convertDataToString(data: string|Uint8Array) : string {
   return (data instanceof Uint8Array) ? byteArrayToUTF8(data) : data;
 }
 
+// fast non-cryptographic 64-bit content hash, returned as 16 hex digits
+// (strings hash by UTF-16 code unit, so include the encoding in keys if it matters)
+export function hashData(data: string|Uint8Array, seed: number = 0) : string {
+  let h1 = 0xdeadbeef ^ seed;
+  let h2 = 0x41c6ce57 ^ seed;
+  if (typeof data === 'string') {
+    for (let i = 0; i < data.length; i++) {
+      let ch = data.charCodeAt(i);
+      h1 = Math.imul(h1 ^ ch, 2654435761);
+      h2 = Math.imul(h2 ^ ch, 1597334677);
+    }
+  } else {
+    for (let i = 0; i < data.length; i++) {
+      let ch = data[i];
+      h1 = Math.imul(h1 ^ ch, 2654435761);
+      h2 = Math.imul(h2 ^ ch, 1597334677);
+    }
+  }
+  h1 = Math.imul(h1 ^ (h1 >>> 16), 2246822507) ^ Math.imul(h2 ^ (h2 >>> 13), 3266489909);
+  h2 = Math.imul(h2 ^ (h2 >>> 16), 2246822507) ^ Math.imul(h1 ^ (h1 >>> 13), 3266489909);
+  return hex(h2 >>> 0, 8) + hex(h1 >>> 0, 8);
+}
+
 export function byteToASCII(b: number) : string {
   if (b < 32)
     return String.fromCharCode(b + 0x2400);
@@ -36,6 +36,12 @@ export class TMS9918A {
   ram = new Uint8Array(16384); // VDP RAM
   registers = new Uint8Array(8);
   spriteBuffer = new Uint8Array(256);
+  spriteBufferUsed = true;
+  // sprites on each line (in priority order), rebuilt when the SAT or registers change
+  spriteLines = new Uint8Array(192 * 32);
+  spriteLineCounts = new Uint8Array(192);
+  spriteEnd = 32; // loop index after the end marker
+  spriteLinesValid = false;
   addressRegister : number;
   statusRegister : number;
 
@@ -124,6 +130,7 @@ export class TMS9918A {
 
         this.flicker = this.enableFlicker;
         this.redrawRequired = true;
+        this.spriteLinesValid = false;
 
         this.width = 304;
         this.height = 240;
@@ -162,67 +169,79 @@ export class TMS9918A {
             // Pre-process sprites
             if (!textMode) {
                 var spriteBuffer = this.spriteBuffer;
-                spriteBuffer.fill(0);
+                if (this.spriteBufferUsed) {
+                    spriteBuffer.fill(0);
+                    this.spriteBufferUsed = false;
+                }
                 var spritesOnLine = 0;
-                var endMarkerFound = false;
-                var spriteAttributeAddr = spriteAttributeTable;
                 var s;
-                for (s = 0; s < 32 && spritesOnLine <= maxSpritesOnLine && !endMarkerFound; s++) {
-                    var sy = ram[spriteAttributeAddr];
-                    if (sy !== 0xD0) {
+                if (!bitmapMode) {
+                    // no duplication bug, so the line buckets have the sprites in order
+                    if (!this.spriteLinesValid) {
+                        this.buildSpriteLines(spriteDimension);
+                    }
+                    var lineCount = this.spriteLineCounts[y1];
+                    var lineBase = y1 << 5;
+                    var n = Math.min(lineCount, maxSpritesOnLine);
+                    for (var i = 0; i < n; i++) {
+                        var spriteAddr = spriteAttributeTable + (this.spriteLines[lineBase + i] << 2);
+                        var sy = ram[spriteAddr];
                         if (sy > 0xD0) {
                             sy -= 256;
                         }
                         sy++;
-                        var sy1 = sy + spriteDimension;
-                        var y2 = -1;
-                        if (s < 8 || !bitmapMode) {
-                            if (y1 >= sy && y1 < sy1) {
-                                y2 = y1;
-                            }
+                        if (this.drawSpriteLine(spriteAddr, (y1 - sy) >> spriteMagnify, drawWidth)) {
+                            collision = true;
                         }
-                        else {
-                            // Emulate sprite duplication bug
-                            var yMasked = y1 & (((this.registers[4] & 0x03) << 6) | 0x3F);
-                            if (yMasked >= sy && yMasked < sy1) {
-                                y2 = yMasked;
+                    }
+                    // same spritesOnLine and index as the scan below would leave
+                    if (lineCount > maxSpritesOnLine) {
+                        spritesOnLine = maxSpritesOnLine + 1;
+                        s = this.spriteLines[lineBase + maxSpritesOnLine] + 1;
+                    } else {
+                        spritesOnLine = lineCount;
+                        s = this.spriteEnd;
+                    }
+                } else {
+                    var endMarkerFound = false;
+                    var spriteAttributeAddr = spriteAttributeTable;
+                    for (s = 0; s < 32 && spritesOnLine <= maxSpritesOnLine && !endMarkerFound; s++) {
+                        var sy = ram[spriteAttributeAddr];
+                        if (sy !== 0xD0) {
+                            if (sy > 0xD0) {
+                                sy -= 256;
                             }
-                            else if (y1 >= 64 && y1 < 128 && y1 >= sy && y1 < sy1) {
-                                y2 = y1;
+                            sy++;
+                            var sy1 = sy + spriteDimension;
+                            var y2 = -1;
+                            if (s < 8) {
+                                if (y1 >= sy && y1 < sy1) {
+                                    y2 = y1;
+                                }
                             }
-                        }
-                        if (y2 !== -1) {
-                            if (spritesOnLine < maxSpritesOnLine) {
-                                var sx = ram[spriteAttributeAddr + 1];
-                                var sPatternNo = ram[spriteAttributeAddr + 2] & (spriteSize ? 0xFC : 0xFF);
-                                var sColor = ram[spriteAttributeAddr + 3] & 0x0F;
-                                if ((ram[spriteAttributeAddr + 3] & 0x80) !== 0) {
-                                    sx -= 32;
+                            else {
+                                // Emulate sprite duplication bug
+                                var yMasked = y1 & (((this.registers[4] & 0x03) << 6) | 0x3F);
+                                if (yMasked >= sy && yMasked < sy1) {
+                                    y2 = yMasked;
                                 }
-                                var sLine = (y2 - sy) >> spriteMagnify;
-                                var sPatternBase = spritePatternTable + (sPatternNo << 3) + sLine;
-                                for (var sx1 = 0; sx1 < spriteDimension; sx1++) {
-                                    var sx2 = sx + sx1;
-                                    if (sx2 >= 0 && sx2 < drawWidth) {
-                                        var sx3 = sx1 >> spriteMagnify;
-                                        var sPatternByte = ram[sPatternBase + (sx3 >= 8 ? 16 : 0)];
-                                        if ((sPatternByte & (0x80 >> (sx3 & 0x07))) !== 0) {
-                                            if (spriteBuffer[sx2] === 0) {
-                                                spriteBuffer[sx2] = sColor + 1;
-                                            }
-                                            else {
-                                                collision = true;
-                                            }
-                                        }
+                                else if (y1 >= 64 && y1 < 128 && y1 >= sy && y1 < sy1) {
+                                    y2 = y1;
+                                }
+                            }
+                            if (y2 !== -1) {
+                                if (spritesOnLine < maxSpritesOnLine) {
+                                    if (this.drawSpriteLine(spriteAttributeAddr, (y2 - sy) >> spriteMagnify, drawWidth)) {
+                                        collision = true;
                                     }
                                 }
+                                spritesOnLine++;
                             }
-                            spritesOnLine++;
+                            spriteAttributeAddr += 4;
+                        }
+                        else {
+                            endMarkerFound = true;
                         }
-                        spriteAttributeAddr += 4;
-                    }
-                    else {
-                        endMarkerFound = true;
                     }
                 }
                 if (spritesOnLine > 4) {
@@ -233,7 +252,10 @@ export class TMS9918A {
             // Draw
             var rowOffset = !textMode ? (y1 >> 3) << 5 : (y1 >> 3) * 40;
             var lineOffset = y1 & 7;
-            for (x = 0; x < width; x++) {
+            if (screenMode === TMS9918A_Mode.GRAPHICS || screenMode === TMS9918A_Mode.BITMAP) {
+                this.drawTileLine(imageDataAddr, y1, rowOffset, lineOffset, hBorder);
+            }
+            else for (x = 0; x < width; x++) {
                 if (x >= hBorder && x < hBorder + drawWidth) {
                     var x1 = x - hBorder;
                     // Tiles
@@ -321,6 +343,124 @@ export class TMS9918A {
         }
     }
 
+    // graphics and bitmap modes, one pattern/color lookup per 8 pixels
+    drawTileLine(imageDataAddr:number, y1:number, rowOffset:number, lineOffset:number, hBorder:number) {
+        var imageData = this.fb32,
+            ram = this.ram,
+            palette = this.palette,
+            bgColor = this.bgColor,
+            bgRGB = palette[bgColor],
+            spriteBuffer = this.spriteBuffer,
+            sprites = this.spriteBufferUsed,
+            bitmapMode = this.screenMode === TMS9918A_Mode.BITMAP,
+            nameAddr = this.nameTable + rowOffset,
+            colorTable = this.colorTable,
+            charPatternTable = this.charPatternTable,
+            colorTableMask = this.colorTableMask,
+            patternTableMask = this.patternTableMask,
+            bitmapOffset = (y1 & 0xC0) << 5,
+            x, x1 = 0;
+        for (x = 0; x < hBorder; x++) {
+            imageData[imageDataAddr++] = bgRGB;
+        }
+        for (var col = 0; col < 32; col++) {
+            var name = ram[nameAddr + col];
+            var colorByte, patternByte;
+            if (bitmapMode) {
+                var tableOffset = bitmapOffset + (name << 3);
+                colorByte = ram[colorTable + (tableOffset & colorTableMask) + lineOffset];
+                patternByte = ram[charPatternTable + (tableOffset & patternTableMask) + lineOffset];
+            } else {
+                colorByte = ram[colorTable + (name >> 3)];
+                patternByte = ram[charPatternTable + (name << 3) + lineOffset];
+            }
+            var fg = colorByte >> 4 || bgColor;
+            var bg = colorByte & 0x0F || bgColor;
+            if (!sprites) {
+                var fgRGB = palette[fg];
+                var bgTileRGB = palette[bg];
+                for (var mask = 0x80; mask; mask >>= 1) {
+                    imageData[imageDataAddr++] = (patternByte & mask) ? fgRGB : bgTileRGB;
+                }
+                x1 += 8;
+            } else {
+                for (var mask = 0x80; mask; mask >>= 1) {
+                    var color = (patternByte & mask) ? fg : bg;
+                    var spriteColor = spriteBuffer[x1++] - 1;
+                    if (spriteColor > 0) {
+                        color = spriteColor;
+                    }
+                    imageData[imageDataAddr++] = palette[color];
+                }
+            }
+        }
+        for (x = hBorder + 256; x < this.width; x++) {
+            imageData[imageDataAddr++] = bgRGB;
+        }
+    }
+
+    // returns true on collision
+    drawSpriteLine(spriteAttributeAddr:number, sLine:number, drawWidth:number) : boolean {
+        var ram = this.ram,
+            spriteBuffer = this.spriteBuffer,
+            spriteSize = (this.registers[1] & 0x2) !== 0,
+            spriteMagnify = this.registers[1] & 0x1,
+            spriteDimension = (spriteSize ? 16 : 8) << (spriteMagnify ? 1 : 0),
+            collision = false;
+        var sx = ram[spriteAttributeAddr + 1];
+        var sPatternNo = ram[spriteAttributeAddr + 2] & (spriteSize ? 0xFC : 0xFF);
+        var sColor = ram[spriteAttributeAddr + 3] & 0x0F;
+        if ((ram[spriteAttributeAddr + 3] & 0x80) !== 0) {
+            sx -= 32;
+        }
+        var sPatternBase = this.spritePatternTable + (sPatternNo << 3) + sLine;
+        for (var sx1 = 0; sx1 < spriteDimension; sx1++) {
+            var sx2 = sx + sx1;
+            if (sx2 >= 0 && sx2 < drawWidth) {
+                var sx3 = sx1 >> spriteMagnify;
+                var sPatternByte = ram[sPatternBase + (sx3 >= 8 ? 16 : 0)];
+                if ((sPatternByte & (0x80 >> (sx3 & 0x07))) !== 0) {
+                    if (spriteBuffer[sx2] === 0) {
+                        spriteBuffer[sx2] = sColor + 1;
+                    }
+                    else {
+                        collision = true;
+                    }
+                }
+            }
+        }
+        this.spriteBufferUsed = true;
+        return collision;
+    }
+
+    // buckets sprites by line, in the order the scan in drawScanline() visits them
+    // (only valid when not in bitmap mode, which has the duplication bug)
+    buildSpriteLines(spriteDimension:number) {
+        var ram = this.ram,
+            lines = this.spriteLines,
+            counts = this.spriteLineCounts,
+            addr = this.spriteAttributeTable,
+            s;
+        counts.fill(0);
+        for (s = 0; s < 32; s++, addr += 4) {
+            var sy = ram[addr];
+            if (sy === 0xD0) {
+                break;
+            }
+            if (sy > 0xD0) {
+                sy -= 256;
+            }
+            sy++;
+            var y0 = Math.max(sy, 0);
+            var y1 = Math.min(sy + spriteDimension, 192);
+            for (var y = y0; y < y1; y++) {
+                lines[(y << 5) + counts[y]++] = s;
+            }
+        }
+        this.spriteEnd = s < 32 ? s + 1 : 32;
+        this.spriteLinesValid = true;
+    }
+
     setReadAddress(i:number) {
         this.addressRegister = ((i & 0x3f) << 8) | (this.addressRegister & 0x00FF);
         this.prefetchByte = this.ram[this.addressRegister++];
@@ -334,6 +474,7 @@ export class TMS9918A {
     setVDPWriteRegister(i:number) {
         var regmask = this.registers.length-1;
         this.registers[i & regmask] = this.addressRegister & 0x00FF;
+        this.spriteLinesValid = false;
         switch (i & regmask) {
             // Mode
             case 0:
@@ -494,6 +635,11 @@ export class TMS9918A {
 
     writeData(i:number) {
         this.probe.logVRAMWrite(this.addressRegister, i);
+        // sprite Y (or end marker) changed?
+        var satOffset = this.addressRegister - this.spriteAttributeTable;
+        if (satOffset >= 0 && satOffset < 128 && (satOffset & 3) === 0) {
+            this.spriteLinesValid = false;
+        }
         this.ram[this.addressRegister++] = i;
         this.prefetchByte = i;
         this.addressRegister &= this.ramMask;
@@ -669,6 +815,7 @@ export class TMS9918A {
         this.bgColor = state.bgColor;
         this.flicker = state.flicker;
         this.redrawRequired = true;
+        this.spriteLinesValid = false;
     }
 };
 
@@ -679,6 +826,10 @@ export class SMSVDP extends TMS9918A {
     cpalette = new Uint32Array(32); // color RAM (RGBA)
     registers = new Uint8Array(16); // 8 more registers (actually only 5)
     vramUntwiddled = new Uint8Array(0x8000);
+    // sprites found on the current line, reused every line
+    activeX = new Uint8Array(8);
+    activeN = new Uint8Array(8);
+    activeY = new Int16Array(8);
     numVisibleLines = 192;
     lineCounter = 0; // TODO: state
     lineInterruptPending = false; // TODO: state
@@ -759,6 +910,9 @@ export class SMSVDP extends TMS9918A {
     restoreState(state) {
         super.restoreState(state);
         this.cram.set(state.cram);
+        for (var a = 0; a < this.ram.length; a += 4) {
+            this.writeTwiddled(a, 0);
+        }
     }
     drawScanline(y:number) {
         if (this.screenMode == TMS9918A_Mode.MODE4)
@@ -767,9 +921,10 @@ export class SMSVDP extends TMS9918A {
             super.drawScanline(y);
     }
 
-    findSprites(line:number) {
+    // fills activeX/N/Y, returns the number of sprites
+    findSprites(line:number) : number {
         var spriteInfo = this.spriteAttributeTable;
-        var active = [];
+        var count = 0;
         var spriteHeight = 8;
         var i;
         if (this.registers[1] & 2) {
@@ -782,17 +937,17 @@ export class SMSVDP extends TMS9918A {
             }
             if (y >= 240) y -= 256;
             if (line >= y && line < (y + spriteHeight)) {
-                if (active.length === 8) {
+                if (count === 8) {
                     this.statusRegister |= 0x40;  // Sprite overflow
                     break;
                 }
-                active.push([
-                    this.ram[spriteInfo + 128 + i * 2],
-                    this.ram[spriteInfo + 128 + i * 2 + 1],
-                    y]);
+                this.activeX[count] = this.ram[spriteInfo + 128 + i * 2];
+                this.activeN[count] = this.ram[spriteInfo + 128 + i * 2 + 1];
+                this.activeY[count] = y;
+                count++;
             }
         }
-        return active;
+        return count;
     }
 
 
@@ -884,7 +1039,7 @@ export class SMSVDP extends TMS9918A {
     }
 
 
-    rasterize_sprites(line:number, lineAddr:number, pixelOffset:number, sprites) {
+    rasterize_sprites(line:number, lineAddr:number, pixelOffset:number, numSprites:number) {
         lineAddr = lineAddr | 0;
         pixelOffset = pixelOffset | 0;
         const spriteBase = (this.registers[6] & 4) ? 0x2000 : 0;
@@ -895,9 +1050,8 @@ export class SMSVDP extends TMS9918A {
             var spriteFoundThisX = false;
             var writtenTo = false;
             var minDistToNext = 256;
-            for (var k = 0; k < sprites.length; k++) {
-                var sprite = sprites[k];
-                var offset = xPos - sprite[0];
+            for (var k = 0; k < numSprites; k++) {
+                var offset = xPos - this.activeX[k];
                 // Sprite to the right of the current X?
                 if (offset < 0) {
                     // Find out how far it would be to skip to this sprite
@@ -908,8 +1062,8 @@ export class SMSVDP extends TMS9918A {
                 }
                 if (offset >= 8) continue;
                 spriteFoundThisX = true;
-                var spriteLine = line - sprite[2];
-                var spriteAddr = spriteBase + sprite[1] * 32 + spriteLine * 4;
+                var spriteLine = line - this.activeY[k];
+                var spriteAddr = spriteBase + this.activeN[k] * 32 + spriteLine * 4;
                 var untwiddledAddr = spriteAddr * 2 + offset;
                 var index = this.vramUntwiddled[untwiddledAddr];
                 if (index === 0) {
@@ -958,13 +1112,13 @@ export class SMSVDP extends TMS9918A {
             if (effectiveLine >= 224) {
                 effectiveLine -= 224;
             }
-            const sprites = this.findSprites(line);
+            const numSprites = this.findSprites(line);
             const pixelOffset = ((vdp_regs[0] & 64) && line < 16) ? 0 : vdp_regs[8];
             const nameAddr = this.nameTable + (effectiveLine >>> 3) * 64;
             const yMod = effectiveLine & 7;
 
             this.rasterize_background_line(lineAddr, pixelOffset, nameAddr, yMod);
-            this.rasterize_sprites(line, lineAddr, pixelOffset, sprites);
+            this.rasterize_sprites(line, lineAddr, pixelOffset, numSprites);
             this.rasterize_foreground_line(lineAddr, pixelOffset, nameAddr, yMod);
 
             this.border_clear(startAddr, hBorder);
@@ -76,7 +76,8 @@ export interface Dependency {
 
 export interface WorkerFileUpdate {
   path:string
-  data:FileData
+  data:FileData // null if unchanged since last sent (worker matches on hash)
+  hash?:string
 };
 export interface WorkerBuildStep {
   path?:string
@@ -100,6 +101,9 @@ export interface WorkerMessage {
   reset?:boolean
   code?:string
   setitems?:WorkerItemUpdate[]
+  substep?:WorkerBuildStep // from coordinating worker (see workerpool.ts)
+  preloadfs?:string[] // filesystems a substep may need
+  gen?:number // build generation, a newer one cancels this build
 }
 
 export interface WorkerError extends SourceLocation {
@@ -129,12 +133,18 @@ export type Segment = {
   source?:'native'|'linker'
 };
 
-export type WorkerResult = WorkerErrorResult | WorkerOutputResult<any> | WorkerUnchangedResult;
+export type WorkerResult = (WorkerErrorResult | WorkerOutputResult<any> | WorkerUnchangedResult | WorkerResendResult)
+  & { gen?:number }; // copied from the WorkerMessage
 
 export interface WorkerUnchangedResult {
   unchanged: true;
 }
 
+// worker lost files that were sent by hash only, send them again with data
+export interface WorkerResendResult {
+  resend: string[];
+}
+
 export interface WorkerErrorResult {
   errors: WorkerError[]
   listings?: CodeListingMap
@@ -153,6 +163,10 @@ export function isUnchanged(result: WorkerResult) : result is WorkerUnchangedRes
   return ('unchanged' in result);
 }
 
+export function isResendResult(result: WorkerResult) : result is WorkerResendResult {
+  return ('resend' in result);
+}
+
 export function isErrorResult(result: WorkerResult) : result is WorkerErrorResult {
   return ('errors' in result);
 }
@@ -250,7 +250,7 @@ function receiveMessage(event) {
     else if (cmd == 'getReplay') {
       var replay = {
         frameCount: stateRecorder.frameCount,
-        checkpoints: stateRecorder.checkpoints,
+        checkpoints: stateRecorder.getCheckpoints(),
         framerecs: stateRecorder.framerecs,
         checkpointInterval: stateRecorder.checkpointInterval,
         maxCheckpoints: stateRecorder.maxCheckpoints,
@@ -1,7 +1,8 @@
 
-import { FileData, Dependency, SourceLine, SourceFile, CodeListing, CodeListingMap, WorkerError, Segment, WorkerResult, WorkerOutputResult, isUnchanged, isOutputResult, WorkerMessage, WorkerItemUpdate, WorkerErrorResult, isErrorResult } from "../common/workertypes";
-import { getFilenamePrefix, getFolderForPath, isProbablyBinary, getBasePlatform, getWithBinary } from "../common/util";
+import { FileData, Dependency, SourceLine, SourceFile, CodeListing, CodeListingMap, WorkerError, Segment, WorkerResult, WorkerOutputResult, isUnchanged, isOutputResult, WorkerMessage, WorkerItemUpdate, WorkerErrorResult, isErrorResult, WorkerFileUpdate, isResendResult } from "../common/workertypes";
+import { getFilenamePrefix, getFolderForPath, isProbablyBinary, getBasePlatform, getWithBinary, hashData } from "../common/util";
 import { Platform } from "../common/baseplatform";
+import { parseIncludeDependencies, parseLinkDependencies } from "../common/dependencies";
 import localforage from "localforage";
 
 export interface ProjectFilesystem {
@@ -92,7 +93,11 @@ export class CodeProject {
   listings : CodeListingMap;
   segments : Segment[];
   mainPath : string;
-  pendingWorkerMessages = 0;
+  buildGen = 0; // generation of the last build sent, results of older ones are dropped
+  // background build while auto-compile is off, reused if Build has the same inputs
+  speculative : {key:string, gen:number, result?:WorkerResult, promotedGen?:number};
+  speculativeDelay = 1500; // msec after last edit
+  speculativeTimer = null;
   hasDoneInitialCompilation = false;
   tools_preloaded = {};
   worker : Worker;
@@ -103,6 +108,8 @@ export class CodeProject {
   filesystem : ProjectFilesystem;
   dataItems : WorkerItemUpdate[];
   remoteTool? : string;
+  fileHashes : {[path:string]:{data:FileData, hash:string}} = {}; // hashed once per file version
+  workerHashes : {[path:string]:string} = {}; // what the worker's store has
 
   callbackBuildResult : BuildResultCallback;
   callbackBuildStatus : BuildStatusCallback;
@@ -119,17 +126,37 @@ export class CodeProject {
   }
 
   receiveWorkerMessage(data : WorkerResult) {
-    var notfinal = this.pendingWorkerMessages > 1;
-    if (notfinal) {
+    // worker doesn't have some files we skipped, send everything again
+    if (data && isResendResult(data)) {
+      if (this.speculative && data.gen == this.speculative.gen) {
+        var promotedGen = this.speculative.promotedGen;
+        this.workerHashes = {}; // the real build will send everything
+        this.speculative = null;
+        // a Build is waiting on this result, so run it for real now
+        if (promotedGen != null && promotedGen == this.buildGen) this.sendBuild();
+        return;
+      }
+      if (data.gen != null && data.gen != this.buildGen) return; // the newer build will ask too
+      console.log("worker needs files", data.resend);
+      this.workerHashes = {};
       this.sendBuild();
-      this.pendingWorkerMessages = 1;
-    } else {
-      if (this.callbackBuildStatus) this.callbackBuildStatus(false);
-      if (!this.isCompiling) { console.log(this.pendingWorkerMessages); console.trace(); } // debug compile problems
-      this.isCompiling = false;
-      this.pendingWorkerMessages = 0;
-      this.hasDoneInitialCompilation = true; // Mark that we've done the initial compilation
+      return;
+    }
+    // keep background build result until Build asks for it
+    if (data && this.speculative && data.gen == this.speculative.gen) {
+      this.speculative.result = data;
+      if (this.speculative.promotedGen != this.buildGen) return;
+      this.speculative = null;
+      data.gen = this.buildGen;
     }
+    // superseded by a newer build (the worker usually drops those itself)
+    if (data && data.gen != null && data.gen != this.buildGen) {
+      return;
+    }
+    if (this.callbackBuildStatus) this.callbackBuildStatus(false);
+    if (!this.isCompiling) { console.trace(); } // debug compile problems
+    this.isCompiling = false;
+    this.hasDoneInitialCompilation = true; // Mark that we've done the initial compilation
     if (data && isOutputResult(data)) {
       this.processBuildResult(data);
     } else if (isErrorResult(data)) {
@@ -163,83 +190,17 @@ export class CodeProject {
       files.push(dir + '/' + fn);
   }
 
-  // TODO: use tool id to parse files, not platform
   parseIncludeDependencies(text:string):string[] {
     let files = [];
-    let m;
-    if (this.platform_id.startsWith('verilog')) {
-      // include verilog includes
-      let re1 = /^\s*(`include|[.]include)\s+"(.+?)"/gmi;
-      while (m = re1.exec(text)) {
-        this.pushAllFiles(files, m[2]);
-      }
-      // for Silice
-      let re1a = /^\s*\$(include|\$dofile|\$write_image_in_table)\('(.+?)'/gmi;
-      while (m = re1a.exec(text)) {
-        this.pushAllFiles(files, m[2]);
-      }
-      // include .arch (json) statements
-      let re2 = /^\s*([.]arch)\s+(\w+)/gmi;
-      while (m = re2.exec(text)) {
-        this.pushAllFiles(files, m[2]+".json");
-      }
-      // include $readmem[bh] (TODO)
-      let re3 = /\$readmem[bh]\("(.+?)"/gmi;
-      while (m = re3.exec(text)) {
-        this.pushAllFiles(files, m[1]);
-      }
-    } else {
-      // for .asm -- [.%]include "file"
-      // for .c -- #include "file"
-      let re2 = /^\s*[.#%]?(include|incbin|embed)\s+"(.+?)"/gmi;
-      while (m = re2.exec(text)) {
-        this.pushAllFiles(files, m[2]);
-      }
-      // for .c -- //#resource "file" (or ;resource or #resource)
-      let re3 = /^\s*([;']|[/][/])#(resource)\s+"(.+?)"/gm;
-      while (m = re3.exec(text)) {
-        this.pushAllFiles(files, m[3]);
-      }
-      // for XASM only (USE include.ext)
-      // for merlin32 (ASM include.ext)
-      let re4 = /^\s+(USE|ASM)\s+(\S+[.]\S+)/gm;
-      while (m = re4.exec(text)) {
-        this.pushAllFiles(files, m[2]);
-      }
-      // for wiz
-      let re5 = /^\s*(import|embed)\s*"(.+?)";/gmi;
-      while (m = re5.exec(text)) {
-        if (m[1] == 'import')
-          this.pushAllFiles(files, m[2] + ".wiz");
-        else
-          this.pushAllFiles(files, m[2]);
-      }
-      // for ecs
-      let re6 = /^\s*(import)\s*"(.+?)"/gmi;
-      while (m = re6.exec(text)) {
-        this.pushAllFiles(files, m[2]);
-      }
-      // for acme
-      let re7 = /^[!]src\s+"(.+?)"/gmi;
-      while (m = re7.exec(text)) {
-        this.pushAllFiles(files, m[1]);
-      }
-    }
+    for (let fn of parseIncludeDependencies(text, this.platform_id.startsWith('verilog')))
+      this.pushAllFiles(files, fn);
     return files;
   }
 
   parseLinkDependencies(text:string):string[] {
     let files = [];
-    let m;
-    if (this.platform_id.startsWith('verilog')) {
-      //
-    } else {
-      // for .c -- //#link "file" (or ;link or #link)
-      let re = /^\s*([;]|[/][/])#link\s+"(.+?)"/gm;
-      while (m = re.exec(text)) {
-        this.pushAllFiles(files, m[2]);
-      }
-    }
+    for (let fn of parseLinkDependencies(text, this.platform_id.startsWith('verilog')))
+      this.pushAllFiles(files, fn);
     return files;
   }
   
@@ -264,9 +225,9 @@ export class CodeProject {
     const isInitialCompilation = !this.hasDoneInitialCompilation;
     
     // Only proceed if we have a main path and either auto-compile is enabled OR this is the initial compilation
+    // builds in progress are superseded, not waited for
     if (this.mainPath != null && (autoCompileEnabled || isInitialCompilation)) {
-      // Increment the counter and return true only if it was 0 (first call)
-      return this.pendingWorkerMessages++ == 0;
+      return true;
     }
     
     return false;
@@ -276,6 +237,19 @@ export class CodeProject {
     this.filesystem.setFileData(path, text);
   }
 
+  // omit data for files the worker already has (matched by content hash)
+  makeFileUpdate(path:string, data:FileData) : WorkerFileUpdate {
+    var cached = this.fileHashes[path];
+    if (!cached || cached.data !== data) {
+      cached = this.fileHashes[path] = {data:data, hash:hashData(data)};
+    }
+    if (this.workerHashes[path] == cached.hash) {
+      return {path:path, data:null, hash:cached.hash};
+    }
+    this.workerHashes[path] = cached.hash;
+    return {path:path, data:data, hash:cached.hash};
+  }
+
   // TODO: test duplicate files, local paths mixed with presets
   buildWorkerMessage(depends:Dependency[]) : WorkerMessage {
     this.preloadWorker(this.mainPath);
@@ -284,14 +258,14 @@ export class CodeProject {
     var mainfilename = this.stripLocalPath(this.mainPath);
     var maintext = this.getFile(this.mainPath);
     var depfiles = [];
-    msg.updates.push({path:mainfilename, data:maintext});
+    msg.updates.push(this.makeFileUpdate(mainfilename, maintext));
     this.filename2path[mainfilename] = this.mainPath;
     const tool = this.getToolForFilename(this.mainPath);
     let usesRemoteTool = tool.startsWith('remote:');
     for (var dep of depends) {
       // remote tools send both includes and linked files in one build step
       if (!dep.link || usesRemoteTool) {
-        msg.updates.push({path:dep.filename, data:dep.data});
+        msg.updates.push(this.makeFileUpdate(dep.filename, dep.data));
         depfiles.push(dep.filename);
       }
       this.filename2path[dep.filename] = dep.path;
@@ -305,7 +279,7 @@ export class CodeProject {
     for (var dep of depends) {
       if (dep.data && dep.link) {
         this.preloadWorker(dep.filename);
-        msg.updates.push({path:dep.filename, data:dep.data});
+        msg.updates.push(this.makeFileUpdate(dep.filename, dep.data));
         msg.buildsteps.push({
           path:dep.filename,
           files:[dep.filename].concat(depfiles),
@@ -359,13 +333,23 @@ export class CodeProject {
     }
   }
 
-  sendBuild() {
+  // identifies the inputs of a build
+  getBuildKey(msg : WorkerMessage) : string {
+    var keydata = JSON.stringify([msg.updates.map((u) => [u.path, u.hash]), msg.buildsteps, msg.setitems]);
+    return hashData(keydata) + hashData(keydata, keydata.length);
+  }
+
+  // speculative: build in the background, only deliver the result if a later build has the same inputs
+  sendBuild(speculative? : boolean) {
     if (!this.mainPath) throw Error("need to call setMainFile first");
     var maindata = this.getFile(this.mainPath);
+    if (speculative && maindata instanceof Uint8Array) return;
+    var gen = ++this.buildGen;
     // if binary blob, just return it as ROM
     if (maindata instanceof Uint8Array) {
       this.isCompiling = true;
       this.receiveWorkerMessage({
+        gen:gen,
         output:maindata,
         errors:[],
         listings:null,
@@ -378,13 +362,35 @@ export class CodeProject {
     var text = typeof maindata === "string" ? maindata : '';
     // TODO: load dependencies of non-main files
     return this.loadFileDependencies(text).then( (depends) => {
+      if (gen != this.buildGen) return; // a newer build was started meanwhile
       if (!depends) depends = [];
       var workermsg = this.buildWorkerMessage(depends);
+      var key = this.getBuildKey(workermsg);
+      var spec = this.speculative;
+      if (speculative) {
+        this.speculative = {key:key, gen:gen};
+      } else if (spec && spec.key == key) {
+        // nothing changed since the background build, use its result (now or when it arrives)
+        this.isCompiling = true;
+        spec.promotedGen = gen;
+        if (spec.result) this.receiveWorkerMessage(spec.result);
+        return;
+      } else {
+        this.speculative = null;
+      }
+      workermsg.gen = gen;
       this.worker.postMessage(workermsg);
-      this.isCompiling = true;
+      if (!speculative) this.isCompiling = true;
     });
   }
 
+  scheduleSpeculativeBuild() {
+    clearTimeout(this.speculativeTimer);
+    this.speculativeTimer = setTimeout(() => {
+      if (this.mainPath != null && !this.isCompiling) this.sendBuild(true);
+    }, this.speculativeDelay);
+  }
+
   updateFile(path:string, text:FileData) {
     if (this.filedata[path] == text) return; // unchanged, don't update
     this.updateFileInStore(path, text); // TODO: isBinary
@@ -392,6 +398,8 @@ export class CodeProject {
     if (this.okToSend()) {
       if (this.callbackBuildStatus) this.callbackBuildStatus(true);
       this.sendBuild();
+    } else if (this.hasDoneInitialCompilation) {
+      this.scheduleSpeculativeBuild(); // auto-compile is off
     }
   };
 
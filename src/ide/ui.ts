@@ -101,7 +101,7 @@ const isEmbed = parseBool(qs.embed);
 
 type DebugCommandType = null 
   | 'toline' | 'step' | 'stepout' | 'stepover' 
-  | 'tovsync' | 'stepback' | 'restart';
+  | 'tovsync' | 'stepback' | 'backtoline' | 'restart';
 
 var lastDebugInfo;		// last debug info (CPU text)
 var debugCategory;		// current debug category
@@ -1199,6 +1199,14 @@ export function runToPC(pc: number) {
   }
 }
 
+function runBackToPC(pc: number) {
+  if (!checkRunReady() || !(pc >= 0)) return;
+  setupBreakpoint("backtoline");
+  platform.runEvalBackward((c) => {
+    return c.PC == pc;
+  });
+}
+
 function restartAtCursor() {
   if (platform.restartAtPC(getEditorPC())) {
     resume();
@@ -1209,6 +1217,10 @@ function runToCursor() {
   runToPC(getEditorPC());
 }
 
+function runBackToCursor() {
+  runBackToPC(getEditorPC());
+}
+
 function runUntilReturn() {
   if (!checkRunReady()) return;
   setupBreakpoint("stepout");
@@ -1268,6 +1280,11 @@ function _breakExpression() {
     modal.modal('hide');
     breakExpression(exprs);
   });
+  $("#debugExprBackward").toggle(platform.runEvalBackward != null).off('click').on('click', () => {
+    var exprs = $("#debugExprInput").val()+"";
+    modal.modal('hide');
+    breakExpression(exprs, true);
+  });
 }
 
 function getDebugExprExamples() : string {
@@ -1284,10 +1301,13 @@ function getDebugExprExamples() : string {
   return s;
 }
 
-function breakExpression(exprs : string) {
+function breakExpression(exprs : string, backward? : boolean) {
   var fn = new Function('c', 'return (' + exprs + ');').bind(platform);
   setupBreakpoint();
-  platform.runEval(fn as DebugEvalCondition);
+  if (backward)
+    platform.runEvalBackward(fn as DebugEvalCondition);
+  else
+    platform.runEval(fn as DebugEvalCondition);
   lastBreakExpr = exprs;
 }
 
@@ -1540,6 +1560,9 @@ function setupDebugControls() {
   if ((platform.runEval || platform.runToPC) && !platform_id.startsWith('verilog')) {
     uitoolbar.add('ctrl+alt+l', 'Run To Line', 'glyphicon-save', runToCursor).prop('id','dbg_toline');
   }
+  if (platform.runEvalBackward && !platform_id.startsWith('verilog')) {
+    uitoolbar.add('ctrl+alt+k', 'Run Back To Line', 'glyphicon-open', runBackToCursor).prop('id','dbg_backtoline');
+  }
   uitoolbar.newGroup();
   uitoolbar.grp.prop('id','xtra_bar');
   
@@ -5,7 +5,7 @@ import { platform, current_project, projectWindows, runToPC, setupBreakpoint, ge
 import { hex, lpad, rpad } from "../../common/util";
 import { VirtualList } from "../../common/vlist";
 import { getMousePos, getVisibleEditorLineHeight, VirtualTextLine, VirtualTextScroller } from "../../common/emu";
-import { ProbeFlags, ProbeRecorder } from "../../common/probe";
+import { ProbeAggregator, ProbeFlags, ProbeRecorder } from "../../common/probe";
 import { BaseZ80MachinePlatform, BaseZ80Platform } from "../../common/baseplatform";
 
 ///
@@ -71,6 +71,7 @@ export class MemoryView implements ProjectView {
   }
 
   tick() {
+    platform.requestState && platform.requestState(); // for the next tick
     if (this.memorylist) {
       $(this.maindiv).find('[data-index]').each( (i,e) => {
         var div = $(e);
@@ -310,6 +311,7 @@ export class MemoryMapView implements ProjectView {
 // TODO: clear buffer when scrubbing
 
 const OPAQUE_BLACK = 0xff000000;
+const CUMULATIVE_FRAMES = 600; // frames kept by views with cumulativeData
 
 export abstract class ProbeViewBaseBase {
   probe : ProbeRecorder;
@@ -362,10 +364,10 @@ export abstract class ProbeViewBaseBase {
   setVisible(showing : boolean) : void {
     if (showing) {
       this.probe = platform.startProbing();
-      this.probe.singleFrame = !this.cumulativeData;
+      this.probe.setRingFrames(this.cumulativeData ? CUMULATIVE_FRAMES : 0);
       this.tick();
     } else {
-      if (this.probe) this.probe.singleFrame = true;
+      if (this.probe) this.probe.setRingFrames(0);
       platform.stopProbing();
       this.probe = null;
     }
@@ -373,26 +375,32 @@ export abstract class ProbeViewBaseBase {
 
   redraw( eventfn:(op,addr,col,row,clk,value) => void ) {
     var p = this.probe;
-    if (!p || !p.idx) return; // if no probe, or if empty
+    if (!p || p.isEmpty()) return; // if no probe, or if empty
     var row=0;
     var col=0;
     var clk=0;
     this.sp = 0;
-    for (var i=0; i<p.idx; i++) {
-      var word = p.buf[i];
-      var addr = word & 0xffff;
-      var value = (word >> 16) & 0xff;
-      var op = word & OPAQUE_BLACK;
-      switch (op) {
-        case ProbeFlags.SCANLINE:	row++; col=0; break;
-        case ProbeFlags.FRAME:		row=0; col=0; break;
-        case ProbeFlags.CLOCKS:		col += addr; clk += addr; break;
-        case ProbeFlags.SP_PUSH:
-        case ProbeFlags.SP_POP:
-          this.sp = addr;
-        default:
-          eventfn(op, addr, col, row, clk, value);
-          break;
+    for (var seg of p.getSegments()) {
+      for (var i=0; i<seg.length; i++) {
+        var word = seg[i];
+        var addr = word & 0xffff;
+        var value = (word >> 16) & 0xff;
+        var op = word & OPAQUE_BLACK;
+        switch (op) {
+          case ProbeFlags.SCANLINE:	row++; col=0; break;
+          case ProbeFlags.FRAME:		row=0; col=0; break;
+          case ProbeFlags.CLOCKS:		col += addr; clk += addr; break;
+          case ProbeFlags.EXECUTE_READ:
+            eventfn(ProbeFlags.EXECUTE, addr, col, row, clk, value);
+            eventfn(ProbeFlags.MEM_READ, addr, col, row, clk, value);
+            break;
+          case ProbeFlags.SP_PUSH:
+          case ProbeFlags.SP_POP:
+            this.sp = addr;
+          default:
+            eventfn(op, addr, col, row, clk, value);
+            break;
+        }
       }
     }
   }
@@ -842,12 +850,15 @@ export class ScanlineIOView extends ProbeViewBaseBase {
 
 ///
 
+// events that give a symbol a line in ProbeSymbolView
+const SYMBOL_VIEW_OPS = [ProbeFlags.EXECUTE, ProbeFlags.MEM_READ, ProbeFlags.MEM_WRITE, ProbeFlags.IO_READ, ProbeFlags.IO_WRITE];
+
+// totals since the view was shown, from each frame as the probe finishes it
 export class ProbeSymbolView extends ProbeViewBaseBase {
   vlist : VirtualTextScroller;
   keys : string[];
   recreateOnResize = true;
-  dumplines;
-  cumulativeData = true;
+  totals = new ProbeAggregator();
 
   // TODO: auto resize
   createDiv(parent : HTMLElement) {
@@ -868,20 +879,21 @@ export class ProbeSymbolView extends ProbeViewBaseBase {
       return {text: lpad("Symbol",35)+lpad("Reads",8)+lpad("Writes",8)};
     }
     var sym = this.keys[row-1];
-    var line = this.dumplines && this.dumplines[sym];
+    var addr = platform.debugSymbols && platform.debugSymbols.symbolmap[sym];
+    var totals = this.totals;
     function getop(op) {
-      var n = line[op] | 0;
+      var n = totals.get(op, addr);
       return lpad(n ? n.toString() : "", 8);
     }
     var s : string;
     var c : string;
-    if (line != null) {
+    if (typeof addr === 'number' && SYMBOL_VIEW_OPS.some((op) => totals.get(op, addr))) {
       s = lpad(sym, 35) 
         + getop(ProbeFlags.MEM_READ)
         + getop(ProbeFlags.MEM_WRITE);
-      if (line[ProbeFlags.EXECUTE])
+      if (totals.get(ProbeFlags.EXECUTE, addr))
         c = 'seg_code';
-      else if (line[ProbeFlags.IO_READ] || line[ProbeFlags.IO_WRITE])
+      else if (totals.get(ProbeFlags.IO_READ, addr) || totals.get(ProbeFlags.IO_WRITE, addr))
         c = 'seg_io';
       else
         c = 'seg_data';
@@ -892,26 +904,21 @@ export class ProbeSymbolView extends ProbeViewBaseBase {
     return {text:s, clas:c};
   }
 
+  setVisible(showing : boolean) : void {
+    if (!showing && this.probe) this.probe.streamTo(null);
+    super.setVisible(showing);
+    if (showing) {
+      this.totals.clear();
+      this.probe.streamTo((words) => this.totals.add(words));
+    }
+  }
+
   refresh() {
     this.tick();
   }
 
   tick() {
-    // cache each line in frame
-    this.dumplines = {};
-    this.redraw((op,addr,col,row,clk,value) => {
-      var sym = platform.debugSymbols.addr2symbol[addr];
-      if (sym != null) {
-        var line = this.dumplines[sym];
-        if (line == null) {
-          line = {};
-          this.dumplines[sym] = line;
-        }
-        line[op] = (line[op] | 0) + 1;
-      }
-    });
     this.vlist.refresh();
-    if (this.probe) this.probe.clear(); // clear cumulative data (TODO: doesnt work with seeking or debugging)
   }
 }
 
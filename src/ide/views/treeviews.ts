@@ -192,6 +192,7 @@ export abstract class TreeViewBase implements ProjectView {
   }
 
   tick() {
+    platform.requestState && platform.requestState(); // for the next tick
     this.root.update(this.getRootObject());
   }
 
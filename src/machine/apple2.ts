@@ -148,6 +148,7 @@ export class AppleII extends BasicScanlineMachine implements AcceptsBIOS {
     this.auxRAMbank = s.auxRAMbank;
     this.writeinhibit = s.writeinhibit;
     this.setupLanguageCardConstants();
+    this.invalidateJIT();
     for (var i=0; i<this.slots.length; i++)
        if (this.slots[i] && this.slots[i]['loadState'])
           this.slots[i]['loadState'](s.slots[i]);
@@ -165,6 +166,7 @@ export class AppleII extends BasicScanlineMachine implements AcceptsBIOS {
           console.log("will load BIOS to end of memory anyway...");
       }
       this.bios = Uint8Array.from(data);
+      this.invalidateJIT();
   }
    loadROM(data) {
       // is it a 16-sector 35-track disk image?
@@ -208,6 +210,7 @@ export class AppleII extends BasicScanlineMachine implements AcceptsBIOS {
          this.ram[0xbf00] = 0x4c;
          this.ram[0xbf6f] = 0x01;
       }
+      this.invalidateJIT();
    }
   reset() {
     this.auxRAMselected = false;
@@ -353,6 +356,13 @@ export class AppleII extends BasicScanlineMachine implements AcceptsBIOS {
     this.audio.feedSample(this.soundstate, 1);
     return super.advanceCPU();
   }
+  // speaker clicks inside a compiled block land at its end (at most a scanline late)
+  advanceCPUBlock(maxCycles:number) {
+    var n = this.advanceJITBlock(maxCycles);
+    if (!n) return this.advanceCPU();
+    this.audio.feedSample(this.soundstate, n);
+    return n;
+  }
 
   setKeyInput(key:number, code:number, flags:number) : void {
    //console.log(`setKeyInput: ${key} ${code} ${flags}`);
@@ -408,6 +418,8 @@ export class AppleII extends BasicScanlineMachine implements AcceptsBIOS {
   }
   
   doLanguageCardIO(address:number) {
+     var oldselected = this.auxRAMselected;
+     var oldbank = this.auxRAMbank;
      // TODO: require two writes in a row for some things
      switch (address & 0x0f) {
          // Select aux RAM bank 2, write protected.
@@ -462,6 +474,9 @@ export class AppleII extends BasicScanlineMachine implements AcceptsBIOS {
            break;
      }
      this.setupLanguageCardConstants();
+     // code compiled from $D000-$FFFF came from the bank that was mapped in
+     if (this.auxRAMselected != oldselected || (this.auxRAMselected && this.auxRAMbank != oldbank))
+        this.invalidateJIT();
      return this.floatbus();
   }
 
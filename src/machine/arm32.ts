@@ -60,6 +60,7 @@ export class ARM32Machine extends BasicScanlineMachine
   cpuCyclesPerLine = Math.floor(CPU_FREQ / (256*60));
   defaultROMSize = RAM_SIZE - ROM_BASE;
   sampleRate = 1;
+  batchCPU = false; // readIO() returns the raster X position
   
   cpu: ARM32CPU = new ARM32CPU();
   ram = new Uint8Array(RAM_SIZE);
@@ -411,7 +411,7 @@ export class Atari7800 extends BasicMachine implements RasterFrameBased {
     this.write = newAddressDecoder([
         [0x0015, 0x001A,   0x1f, (a,v) => { this.xtracyc++; this.pokey1.setTIARegister(a, v); }],
         [0x0000, 0x001f,   0x1f, (a,v) => { this.xtracyc++; this.tia.write(a,v); }],
-        [0x0020, 0x003f,   0x1f, (a,v) => { this.maria.write(a,v); }],
+        [0x0020, 0x003f,   0x1f, (a,v) => { this.maria.write(a,v); if (this.maria.WSYNC) this.cpu.stopBlock(); }],
         [0x0040, 0x00ff,   0xff, (a,v) => { this.ram[a + 0x800] = v; }],
         [0x0100, 0x013f,   0xff, (a,v) => { this.write(a,v); }], // shadow
         [0x0140, 0x01ff,  0x1ff, (a,v) => { this.ram[a + 0x800] = v; }],
@@ -491,7 +491,15 @@ export class Atari7800 extends BasicMachine implements RasterFrameBased {
   }
 
   advanceCPU() : number {
-    var clk = super.advanceCPU();
+    return this.tickCPU(super.advanceCPU());
+  }
+  // a compiled block reads the PIA timer as of the block's start
+  advanceCPUBlock(maxCycles:number) : number {
+    var clk = this.advanceJITBlock(maxCycles);
+    return clk ? this.tickCPU(clk) : this.advanceCPU();
+  }
+  // run the timer for CPU clocks, plus the extra cycles TIA and PIA accesses took
+  tickCPU(clk:number) : number {
     this.tickPIATimer(clk); // TODO?
     if (this.xtracyc) {
       clk += this.xtracyc;
@@ -534,7 +542,7 @@ export class Atari7800 extends BasicMachine implements RasterFrameBased {
           this.lastFrameCycles = mc;
           break; // TODO?
         }
-        mc += this.advanceCPU() << 2;
+        mc += (trap ? this.advanceCPU() : this.advanceCPUBlock((colorClocksPreDMA - mc + 3) >> 2)) << 2;
         steps++;
       }
       // is this scanline visible?
@@ -572,7 +580,7 @@ export class Atari7800 extends BasicMachine implements RasterFrameBased {
           this.lastFrameCycles = mc;
           break;
         }
-        mc += this.advanceCPU() << 2;
+        mc += (trap ? this.advanceCPU() : this.advanceCPUBlock((colorClocksPerLine - mc + 3) >> 2)) << 2;
         steps++;
       }
       // audio
@@ -1,7 +1,7 @@
 import { newPOKEYAudio, TssChannelAdapter } from "../common/audio";
 import { MOS6502 } from "../common/cpu/MOS6502";
 import { AcceptsPaddleInput, BasicScanlineMachine } from "../common/devices";
-import { KeyFlags, Keys, makeKeycodeMap, newAddressDecoder, newKeyboardHandler } from "../common/emu";
+import { KeyFlags, Keys, makeKeycodeMap, newAddressDecoder, newKeyboardHandler, PageTableBus } from "../common/emu";
 import { hex } from "../common/util";
 import { ANTIC, MODE_LINES, MODE_SHIFT } from "./chips/antic";
 import { CONSOL, GTIA, TRIG0 } from "./chips/gtia";
@@ -58,7 +58,7 @@ export class Atari800 extends BasicScanlineMachine implements AcceptsPaddleInput
   cpu: MOS6502;
   ram: Uint8Array;
   bios: Uint8Array;
-  bus;
+  bus: PageTableBus;
   audio_pokey;
   audioadapter;
   antic: ANTIC;
@@ -78,9 +78,8 @@ export class Atari800 extends BasicScanlineMachine implements AcceptsPaddleInput
   constructor() {
     super();
     this.cpu = new MOS6502();
-    this.ram = new Uint8Array(0x10000);
-    this.bios = new Uint8Array(0x2800);
     this.bus = this.newBus();
+    this.updateCartMapping();
     this.connectCPUMemoryBus(this.bus);
     // create support chips
     this.antic = new ANTIC(this.readDMA.bind(this), this.antic_nmi.bind(this));
@@ -92,27 +91,35 @@ export class Atari800 extends BasicScanlineMachine implements AcceptsPaddleInput
       this.inputs, ATARI8_KEYCODE_MAP, this.getKeyboardFunction(), true);
   }
   newBus() {
-    return {
-      read: newAddressDecoder([
-        [0x0000, 0x7fff, 0xffff, (a) => { return this.ram[a]; }],
-        [0x8000, 0x9fff, 0xffff, (a) => { return this.cart_80 ? this.rom[a - 0x8000] : this.ram[a]; }],
-        [0xa000, 0xbfff, 0xffff, (a) => { return this.cart_a0 ? this.rom[a - 0x8000] : this.ram[a]; }],
+    // RAM, cartridge and BIOS are paged, only I/O goes through the decoders
+    var bus = new PageTableBus(0x10000 + 0x8000 + 0x2800,
+      newAddressDecoder([
         [0xd000, 0xd0ff, 0x1f, (a) => { return this.gtia.readReg(a); }],
         [0xd200, 0xd2ff, 0xf, (a) => { return this.readPokey(a); }],
         [0xd300, 0xd3ff, 0xf, (a) => { return this.readPIA(a); }],
         [0xd400, 0xd4ff, 0xf, (a) => { return this.antic.readReg(a); }],
         [0xd500, 0xd5ff, 0xff, (a) => { return this.d500[a]; }],
-        [0xd800, 0xffff, 0xffff, (a) => { return this.bios[a - 0xd800]; }],
       ]),
-      write: newAddressDecoder([
-        [0x0000, 0xbffa, 0xffff, (a, v) => { this.ram[a] = v; }],
+      newAddressDecoder([
+        [0xbf00, 0xbffa, 0xffff, (a, v) => { this.ram[a] = v; }],
         [0xbffb, 0xbfff, 0xffff, (a, v) => { this.ram[a] = v; this.initCartA(); }],
         [0xd000, 0xd0ff, 0x1f, (a, v) => { this.gtia.setReg(a, v); }],
         [0xd200, 0xd2ff, 0xf, (a, v) => { this.writePokey(a, v); }],
         [0xd400, 0xd4ff, 0xf, (a, v) => { this.antic.setReg(a, v); }],
         [0xd500, 0xd5ff, 0xff, (a, v) => { this.writeMapper(a, v); }],
-      ]),
-    };
+      ]));
+    this.ram = bus.alloc(0x10000);
+    this.rom = bus.alloc(0x8000);
+    this.bios = bus.alloc(0x2800);
+    bus.mapRead(0x0000, 0x7fff, this.ram);
+    bus.mapRead(0xd800, 0xffff, this.bios);
+    bus.mapWrite(0x0000, 0xbeff, this.ram);
+    return bus;
+  }
+  // page in cartridge or RAM at $8000-$BFFF
+  updateCartMapping() {
+    this.bus.mapRead(0x8000, 0x9fff, this.cart_80 ? this.rom : this.ram, this.cart_80 ? 0x0000 : 0x8000);
+    this.bus.mapRead(0xa000, 0xbfff, this.cart_a0 ? this.rom : this.ram, this.cart_a0 ? 0x2000 : 0xa000);
   }
 
   loadBIOS(bios: Uint8Array) {
@@ -242,6 +249,7 @@ export class Atari800 extends BasicScanlineMachine implements AcceptsPaddleInput
     this.lastdmabyte = state.lastdmabyte;
     this.cart_80 = state.cart_80;
     this.cart_a0 = state.cart_a0;
+    this.updateCartMapping();
   }
   saveState() {
     return {
@@ -349,6 +357,7 @@ export class Atari800 extends BasicScanlineMachine implements AcceptsPaddleInput
     this.run_address = rom2[0x7ffe] + rom2[0x7fff]*256;
     this.cart_a0 = true; // TODO
     this.cart_80 = rom.length == 0x4000;
+    this.updateCartMapping();
     super.loadROM(rom2);
   }
 
@@ -357,6 +366,7 @@ export class Atari800 extends BasicScanlineMachine implements AcceptsPaddleInput
     if (addr == 0xff) {
       if (value == 0x80) this.cart_80 = false;
       if (value == 0xa0) this.cart_a0 = false;
+      this.updateCartMapping();
     }
   }
 
@@ -462,22 +472,26 @@ export class Atari800 extends BasicScanlineMachine implements AcceptsPaddleInput
 
 export class Atari5200 extends Atari800 {
   newBus() {
-    return {
-      read: newAddressDecoder([
-        [0x0000, 0x3fff, 0xffff, (a) => { return this.ram[a]; }],
-        [0x4000, 0xbfff, 0xffff, (a) => { return this.rom ? this.rom[a - 0x4000] : 0; }],
+    var bus = new PageTableBus(0x10000 + 0x8000 + 0x2800,
+      newAddressDecoder([
         [0xc000, 0xcfff, 0x1f, (a) => { return this.gtia.readReg(a); }],
         [0xd400, 0xd4ff, 0xf, (a) => { return this.antic.readReg(a); }],
         [0xe800, 0xefff, 0xf, (a) => { return this.readPokey(a); }],
-        [0xf800, 0xffff, 0x7ff, (a) => { return this.bios[a]; }],
       ]),
-      write: newAddressDecoder([
-        [0x0000, 0x3fff, 0xffff, (a, v) => { this.ram[a] = v; }],
+      newAddressDecoder([
         [0xc000, 0xcfff, 0x1f, (a, v) => { this.gtia.setReg(a, v); }],
         [0xd400, 0xd4ff, 0xf, (a, v) => { this.antic.setReg(a, v); }],
         [0xe800, 0xefff, 0xf, (a, v) => { this.writePokey(a, v); }],
-      ]),
-    };
+      ]));
+    this.ram = bus.alloc(0x10000);
+    this.rom = bus.alloc(0x8000);
+    this.bios = bus.alloc(0x2800);
+    bus.map(0x0000, 0x3fff, this.ram);
+    bus.mapRead(0x4000, 0xbfff, this.rom);
+    bus.mapRead(0xf800, 0xffff, this.bios.subarray(0, 0x800));
+    return bus;
+  }
+  updateCartMapping() {
+    // cartridge is always mapped
   }
 }
-
@@ -46,7 +46,7 @@ export class Devel6502 extends BasicHeadlessMachine implements HasSerialIO {
     var clock = 0;
     while (clock < this.cpuFrequency/60) {
       if (trap && trap()) break;
-      clock += this.advanceCPU();
+      clock += trap ? this.advanceCPU() : this.advanceCPUBlock(this.cpuFrequency/60 - clock);
     }
     return clock;
   }
@@ -137,7 +137,7 @@ export class KIM1 extends BasicHeadlessMachine {
     var clock = 0;
     while (clock < this.cpuFrequency/60) {
       if (trap && trap()) break;
-      clock += this.advanceCPU();
+      clock += trap ? this.advanceCPU() : this.advanceCPUBlock(this.cpuFrequency/60 - clock);
     }
     return clock;
   }
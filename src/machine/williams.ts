@@ -2,7 +2,7 @@ import { MasterAudio, WorkerSoundChannel } from "../common/audio";
 import { MemoryBus } from "../common/baseplatform";
 import { CPU6809 } from "../common/cpu/6809";
 import { BasicScanlineMachine } from "../common/devices";
-import { Keys, makeKeycodeMap, newAddressDecoder, newKeyboardHandler, padBytes } from "../common/emu";
+import { Keys, makeKeycodeMap, newAddressDecoder, newKeyboardHandler, padBytes, PageTableBus } from "../common/emu";
 
 const INITIAL_WATCHDOG = 8;
 const SCREEN_HEIGHT = 304;
@@ -22,9 +22,10 @@ export class WilliamsMachine extends BasicScanlineMachine {
 
     cpu;
     membus: MemoryBus;
-    ram = new Uint8Array(0xc000);
+    pagebus: PageTableBus;
+    ram: Uint8Array;
     nvram = new Uint8Array(0x400);
-    rom = new Uint8Array(0xc000);
+    rom: Uint8Array;
     portsel = 0;
     banksel = 0;
     watchdog_counter = 0;
@@ -108,26 +109,16 @@ export class WilliamsMachine extends BasicScanlineMachine {
             [0x0, 0xfff, 0, (a, v) => { /* console.log('iowrite', hex(a), hex(v)); */ }],
         ]);
 
+        // RAM and ROM reads are paged (see updateBankMapping)
         var memread_defender = newAddressDecoder([
-            [0x0000, 0xbfff, 0xffff, (a) => { return this.ram[a]; }],
-            [0xc000, 0xcfff, 0x0fff, (a) => {
-                switch (this.banksel) {
-                    case 0: return ioread_defender(a);
-                    case 1: return this.rom[a + 0x3000];
-                    case 2: return this.rom[a + 0x4000];
-                    case 3: return this.rom[a + 0x5000];
-                    case 7: return this.rom[a + 0x6000];
-                    default: return 0; // TODO: error light
-                }
-            }],
-            [0xd000, 0xffff, 0xffff, (a) => { return this.rom ? this.rom[a - 0xd000] : 0; }],
+            [0xc000, 0xcfff, 0x0fff, (a) => { return this.banksel == 0 ? ioread_defender(a) : 0; }], // TODO: error light
         ]);
 
         var memwrite_defender = newAddressDecoder([
             [0x0000, 0x97ff, 0, this.write_display_byte.bind(this)],
             [0x9800, 0xbfff, 0, (a, v) => { this.ram[a] = v; }],
             [0xc000, 0xcfff, 0x0fff, iowrite_defender.bind(this)],
-            [0xd000, 0xdfff, 0, (a, v) => { this.banksel = v & 0x7; }],
+            [0xd000, 0xdfff, 0, (a, v) => { this.banksel = v & 0x7; this.updateBankMapping(); }],
             [0, 0xffff, 0, (a, v) => { /* console.log(hex(a), hex(v)); */ }],
         ]);
 
@@ -146,7 +137,7 @@ export class WilliamsMachine extends BasicScanlineMachine {
             [0x80c, 0x80c, 0xf, (a, v) => { if (this.worker) this.worker.postMessage({ command: v }); }],
             //[0x804, 0x807, 0x3,   function(a,v) { console.log('iowrite',a); }], // TODO: sound
             //[0x80c, 0x80f, 0x3,   function(a,v) { console.log('iowrite',a+4); }], // TODO: sound
-            [0x900, 0x9ff, 0, (a, v) => { this.banksel = v & 0x1; }],
+            [0x900, 0x9ff, 0, (a, v) => { this.banksel = v & 0x1; this.updateBankMapping(); }],
             [0xa00, 0xa07, 0x7, this.setBlitter.bind(this)],
             [0xbff, 0xbff, 0, (a, v) => { if (v == 0x39) { this.watchdog_counter = INITIAL_WATCHDOG; this.watchdog_enabled = true; } }],
             [0xc00, 0xfff, 0x3ff, (a, v) => { this.nvram[a] = v; }],
@@ -154,10 +145,7 @@ export class WilliamsMachine extends BasicScanlineMachine {
         ]);
 
         var memread_robotron = newAddressDecoder([
-            [0x0000, 0x8fff, 0xffff, (a) => { return this.banksel ? this.rom[a] : this.ram[a]; }],
-            [0x9000, 0xbfff, 0xffff, (a) => { return this.ram[a]; }],
             [0xc000, 0xcfff, 0x0fff, ioread_robotron],
-            [0xd000, 0xffff, 0xffff, (a) => { return this.rom ? this.rom[a - 0x4000] : 0; }],
         ]);
 
         var memwrite_robotron = newAddressDecoder([
@@ -169,12 +157,19 @@ export class WilliamsMachine extends BasicScanlineMachine {
 
         var memread_williams = isDefender ? memread_defender : memread_robotron;
         var memwrite_williams = isDefender ? memwrite_defender : memwrite_robotron;
-        this.membus = {
-            read: memread_williams,
-            write: memwrite_williams,
-        };
-        this.membus = this.probeMemoryBus(this.membus);
-        this.readAddress = this.membus.read;
+        this.pagebus = new PageTableBus(0xc000 + 0xc000, memread_williams, memwrite_williams);
+        this.ram = this.pagebus.alloc(0xc000);
+        this.rom = this.pagebus.alloc(this.defaultROMSize);
+        if (isDefender) {
+            this.pagebus.mapRead(0x0000, 0xbfff, this.ram);
+            this.pagebus.mapRead(0xd000, 0xffff, this.rom);
+        } else {
+            this.pagebus.mapRead(0x9000, 0xbfff, this.ram, 0x9000);
+            this.pagebus.mapRead(0xd000, 0xffff, this.rom, 0x9000);
+        }
+        this.updateBankMapping();
+        this.membus = this.probeSwitchedMemoryBus(this.pagebus);
+        this.readAddress = (a) => this.membus.read(a);
     }
 
     initAudio() {
@@ -184,15 +179,26 @@ export class WilliamsMachine extends BasicScanlineMachine {
         this.master.master.addChannel(workerchannel);
     }
 
+    // page ROM banks into the address space
+    updateBankMapping() {
+        var bus = this.pagebus;
+        if (this.isDefender) {
+            var bankofs = [-1, 0x3000, 0x4000, 0x5000, -1, -1, -1, 0x6000][this.banksel];
+            bus.mapRead(0xc000, 0xcfff, bankofs >= 0 ? this.rom : null, bankofs);
+        } else {
+            bus.mapRead(0x0000, 0x8fff, this.banksel ? this.rom : this.ram);
+        }
+    }
+
     initCPU() {
-        this.rom = new Uint8Array(this.defaultROMSize);
         this.cpu = this.newCPU(this.membus);
         //this.connectCPUMemoryBus(this);
     }
 
     newCPU(membus: MemoryBus) {
         var cpu = Object.create(CPU6809());
-        cpu.init(membus.write, membus.read, 0);
+        // the 6809 keeps the functions, so call through the bus to follow switchBuses()
+        cpu.init((a, v) => membus.write(a, v), (a) => membus.read(a), 0);
         return cpu;
     }
 
@@ -340,6 +346,7 @@ export class WilliamsMachine extends BasicScanlineMachine {
         this.watchdog_counter = INITIAL_WATCHDOG;
         this.watchdog_enabled = false;
         this.banksel = 1;
+        this.updateBankMapping();
     }
 
     loadSoundROM(data) {
@@ -372,6 +379,7 @@ export class WilliamsMachine extends BasicScanlineMachine {
         this.blitregs.set(state.blt);
         this.watchdog_counter = state.wdc;
         this.banksel = state.bs;
+        this.updateBankMapping();
         this.portsel = state.ps;
     }
     saveState() {
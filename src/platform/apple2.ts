@@ -1,5 +1,6 @@
 
 import { Platform, Preset, getOpcodeMetadata_6502, getToolForFilename_6502 } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { PLATFORMS } from "../common/emu";
 import { AppleII } from "../machine/apple2";
 import { Base6502MachinePlatform } from "../common/baseplatform";
@@ -62,6 +63,7 @@ class Apple2MAMEPlatform extends BaseMAME6502Platform implements Platform {
 class NewApple2Platform extends Base6502MachinePlatform<AppleII> implements Platform {
 
   newMachine()          { return new AppleII(); }
+  workerMachine : WorkerMachineSpec = ['apple2', 'AppleII'];
   getPresets()          { return APPLE2_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.readConst(a); }
@@ -1,6 +1,7 @@
 
 import { BallyAstrocade } from "../machine/astrocade";
 import { BaseZ80MachinePlatform } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { Platform } from "../common/baseplatform";
 import { PLATFORMS } from "../common/emu";
 
@@ -33,6 +34,7 @@ const ASTROCADE_ARCADE_PRESETS = [
 class BallyAstrocadePlatform extends BaseZ80MachinePlatform<BallyAstrocade> implements Platform {
 
   newMachine()          { return new BallyAstrocade(false); }
+  workerMachine : WorkerMachineSpec = ['astrocade', 'BallyAstrocade', [false]];
   getPresets()          { return ASTROCADE_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.read(a); }
@@ -56,6 +58,7 @@ class BallyAstrocadeBIOSPlatform extends BallyAstrocadePlatform implements Platf
 class BallyArcadePlatform extends BallyAstrocadePlatform implements Platform {
 
   newMachine()          { return new BallyAstrocade(true); }
+  workerMachine : WorkerMachineSpec = ['astrocade', 'BallyAstrocade', [true]];
   getPresets()          { return ASTROCADE_ARCADE_PRESETS; }
 
   getMemoryMap = function() { return { main:[
@@ -1,6 +1,7 @@
 
 import { Atari7800 } from "../machine/atari7800";
 import { Platform, Base6502MachinePlatform, getToolForFilename_6502 } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { PLATFORMS } from "../common/emu";
 
 var Atari7800_PRESETS = [
@@ -18,6 +19,7 @@ var Atari7800_PRESETS = [
 class Atari7800Platform extends Base6502MachinePlatform<Atari7800> implements Platform {
 
   newMachine()          { return new Atari7800(); }
+  workerMachine : WorkerMachineSpec = ['atari7800', 'Atari7800'];
   getPresets()          { return Atari7800_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.readConst(a); }
@@ -1,5 +1,6 @@
 
 import { Platform, getOpcodeMetadata_6502, getToolForFilename_6502, Base6502MachinePlatform, Preset } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { PLATFORMS } from "../common/emu";
 import { BaseMAME6502Platform } from "../common/mameplatform";
 import { Atari5200, Atari800 } from "../machine/atari8";
@@ -42,6 +43,7 @@ function getToolForFilename_Atari8(fn:string) {
 
 class Atari800Platform extends Base6502MachinePlatform<Atari800> {
   newMachine()          { return new Atari800(); }
+  workerMachine : WorkerMachineSpec = ['atari8', 'Atari800'];
   getPresets()          { return Atari800_PRESETS; }
   getDefaultExtension() { return ".c"; };
   getToolForFilename = getToolForFilename_Atari8;
@@ -73,6 +75,7 @@ class Atari800Platform extends Base6502MachinePlatform<Atari800> {
 class Atari5200Platform extends Atari800Platform {
   getPresets() { return Atari8_PRESETS; }
   newMachine() { return new Atari5200(); }
+  workerMachine : WorkerMachineSpec = ['atari8', 'Atari5200'];
   biosPath = 'res/altirra/superkernel.rom';
 }
 
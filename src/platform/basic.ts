@@ -116,6 +116,8 @@ const BASIC_PRESETS = [
     { id: 'wumpus.bas', name: 'wumpus' },
 ];
 
+const MAX_STATEMENTS_PER_ADVANCE = 10000;
+
 class BASICPlatform implements Platform {
     mainElement: HTMLElement;
     program: BASICProgram;
@@ -124,6 +126,7 @@ class BASICPlatform implements Platform {
     timer: AnimationTimer;
     tty: TeleTypeWithKeyboard;
     hotReload: boolean = true;
+    fastMode: boolean = true;
     animcount: number = 0;
     internalFiles : {[path:string] : FileData} = {};
     transcript: string[];
@@ -175,6 +178,7 @@ class BASICPlatform implements Platform {
         this.runtime.print = (s:string) => {
             // TODO: why null sometimes?
             this.animcount = 0; // exit advance loop when printing
+            this.runtime.breakRun = true;
             this.tty.print(s);
             this.transcript.push(s);
         }
@@ -185,9 +189,10 @@ class BASICPlatform implements Platform {
         if (this.tty.isBusy()) return;
         var ips = this.program.opts.commandsPerSec || 1000;
         this.animcount += ips / 60;
-        while (this.runtime.running && this.animcount-- > 0) {
-            if (!this.advance())
-                break;
+        while (this.runtime.running && this.animcount > 0) {
+            var n = this.advance();
+            if (!n) break;
+            if (this.animcount > 0) this.animcount -= n;
         }
     }
 
@@ -196,16 +201,21 @@ class BASICPlatform implements Platform {
         if (this.runtime.running) {
             if (this.checkDebugTrap())
                 return 0;
-            var more = this.runtime.step();
-            if (!more) {
+            var n = 1;
+            // single-step when debugging, otherwise run compiled blocks
+            if (this.debugTrap || !this.fastMode)
+                this.runtime.step();
+            else
+                n = this.runtime.run(Math.max(1, Math.min(this.animcount, MAX_STATEMENTS_PER_ADVANCE)));
+            if (!this.runtime.running) {
                 this.pause();
                 if (this.runtime.exited) {
                     this.exitmsg();
                     this.didExit();
                 }
             }
-            this.clock++;
-            return 1;
+            this.clock += n;
+            return n;
         } else {
             return 0;
         }
@@ -284,7 +294,7 @@ class BASICPlatform implements Platform {
     getDebugTree() {
         return {
             CurrentLine: this.runtime.getCurrentLabel(),
-            Variables: this.runtime.vars,
+            Variables: this.runtime.getVariables(),
             Arrays: this.runtime.arrays,
             Functions: this.runtime.defs,
             ForLoops: this.runtime.forLoops,
@@ -297,7 +307,7 @@ class BASICPlatform implements Platform {
         }
     }
     inspect(sym: string) {
-        let o = this.runtime.vars[sym];
+        let o = this.runtime.getVariables()[sym];
         if (o != null) return `${sym} = ${o}`;
     }
     showHelp() {
@@ -314,10 +324,9 @@ class BASICPlatform implements Platform {
     }
     varsToLongString() : string {
         var s = '';
-        var vars = Object.keys(this.runtime.vars);
-        vars.sort();
-        for (var name of vars) {
-            var value = this.runtime.vars[name];
+        var vars = this.runtime.getVariables();
+        for (var name of Object.keys(vars).sort()) {
+            var value = vars[name];
             var valstr = JSON.stringify(value);
             if (valstr.length > 24) valstr = `${valstr.substr(0,24)}...(${valstr.length})`;
             s += lpad(name,3) + " = " + valstr + "\n";
@@ -1,6 +1,7 @@
 
 import { ColecoVision } from "../machine/coleco";
 import { Platform, BaseZ80MachinePlatform, getToolForFilename_z80 } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { PLATFORMS } from "../common/emu";
 import { BaseMAMEZ80Platform } from "../common/mameplatform";
 
@@ -24,6 +25,7 @@ export var ColecoVision_PRESETS = [
 class ColecoVisionPlatform extends BaseZ80MachinePlatform<ColecoVision> implements Platform {
 
   newMachine()          { return new ColecoVision(); }
+  workerMachine : WorkerMachineSpec = ['coleco', 'ColecoVision'];
   getPresets()          { return ColecoVision_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.read(a); }
@@ -1,4 +1,5 @@
 import { Base6502MachinePlatform, Platform } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { PLATFORMS } from "../common/emu";
 import { ExidyUGBv2 } from "../machine/exidy";
 
@@ -9,6 +10,7 @@ var EXIDY_PRESETS = [
 class ExidyUGBPlatform extends Base6502MachinePlatform<ExidyUGBv2> implements Platform {
 
     newMachine() { return new ExidyUGBv2(); }
+    workerMachine : WorkerMachineSpec = ['exidy', 'ExidyUGBv2'];
     getPresets() { return EXIDY_PRESETS; }
     getDefaultExtension() { return ".dasm"; };
     readAddress(a) { return this.machine.readConst(a); }
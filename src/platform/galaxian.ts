@@ -1,5 +1,6 @@
 
 import { Platform } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { PLATFORMS } from "../common/emu";
 import { GalaxianMachine, GalaxianScrambleMachine } from "../machine/galaxian";
 import { BaseZ80MachinePlatform } from "../common/baseplatform";
@@ -12,6 +13,7 @@ const GALAXIAN_PRESETS = [
 class GalaxianPlatform extends BaseZ80MachinePlatform<GalaxianMachine> implements Platform {
 
   newMachine()          { return new GalaxianMachine(); }
+  workerMachine : WorkerMachineSpec = ['galaxian', 'GalaxianMachine'];
   getPresets()          { return GALAXIAN_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.readConst(a); }
@@ -28,6 +30,7 @@ class GalaxianPlatform extends BaseZ80MachinePlatform<GalaxianMachine> implement
 class GalaxianScramblePlatform extends GalaxianPlatform implements Platform {
 
   newMachine()          { return new GalaxianScrambleMachine(); }
+  workerMachine : WorkerMachineSpec = ['galaxian', 'GalaxianScrambleMachine'];
 
 }
 
@@ -1,6 +1,7 @@
 
 import { MSX1 } from "../machine/msx";
 import { Platform, BaseZ80MachinePlatform } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { PLATFORMS } from "../common/emu";
 
 // https://github.com/Konamiman/MSX2-Technical-Handbook
@@ -40,6 +41,7 @@ var LIBCV_PRESETS = [
 class MSXPlatform extends BaseZ80MachinePlatform<MSX1> implements Platform {
 
   newMachine()          { return new MSX1(); }
+  workerMachine : WorkerMachineSpec = ['msx', 'MSX1'];
   getPresets()          { return MSX_BIOS_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.read(a); }
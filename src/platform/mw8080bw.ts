@@ -1,6 +1,7 @@
 
 import { Midway8080 } from "../machine/mw8080bw";
 import { BaseZ80MachinePlatform } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { Platform } from "../common/baseplatform";
 import { PLATFORMS } from "../common/emu";
 
@@ -15,6 +16,7 @@ const MW8080BW_PRESETS = [
 class Midway8080BWPlatform extends BaseZ80MachinePlatform<Midway8080> implements Platform {
 
   newMachine()          { return new Midway8080(); }
+  workerMachine : WorkerMachineSpec = ['mw8080bw', 'Midway8080'];
   getPresets()          { return MW8080BW_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.read(a); }
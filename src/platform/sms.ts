@@ -1,6 +1,7 @@
 
 import { GameGear, SG1000, SMS } from "../machine/sms";
 import { Platform, BaseZ80MachinePlatform } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { PLATFORMS } from "../common/emu";
 
 // TODO: merge w/ coleco
@@ -31,6 +32,7 @@ export var SMS_PRESETS = [
 class SG1000Platform extends BaseZ80MachinePlatform<SG1000> implements Platform {
 
   newMachine()          { return new SG1000(); }
+  workerMachine : WorkerMachineSpec = ['sms', 'SG1000'];
   getPresets()          { return SG1000_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.read(a); }
@@ -40,6 +42,7 @@ class SG1000Platform extends BaseZ80MachinePlatform<SG1000> implements Platform
 class SMSPlatform extends BaseZ80MachinePlatform<SMS> implements Platform {
 
   newMachine()          { return new SMS(); }
+  workerMachine : WorkerMachineSpec = ['sms', 'SMS'];
   getPresets()          { return SMS_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.read(a); }
@@ -49,6 +52,7 @@ class SMSPlatform extends BaseZ80MachinePlatform<SMS> implements Platform {
 class GameGearPlatform extends BaseZ80MachinePlatform<GameGear> implements Platform {
 
   newMachine()          { return new GameGear(); }
+  workerMachine : WorkerMachineSpec = ['sms', 'GameGear'];
   getPresets()          { return SMS_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.read(a); }
@@ -3,7 +3,7 @@ import { Platform, BasePlatform } from "../common/baseplatform";
 import { PLATFORMS, setKeyboardFromMap, AnimationTimer, RasterVideo, Keys, makeKeycodeMap, getMousePos, KeyFlags } from "../common/emu";
 import { SampleAudio } from "../common/audio";
 import { WaveformView, WaveformProvider, WaveformMeta } from "../ide/waveform";
-import { HDLModuleRunner, HDLModuleTrace, HDLUnit, isLogicType } from "../common/hdl/hdltypes";
+import { HDLModuleRunner, HDLModuleScope, HDLModuleTrace, HDLUnit, isLogicType } from "../common/hdl/hdltypes";
 import { HDLModuleJS } from "../common/hdl/hdlruntime";
 import { HDLModuleWASM } from "../common/hdl/hdlwasm";
 import Split = require("split.js");
@@ -110,6 +110,7 @@ var VerilogPlatform = function(mainElement, options) {
   var trace_signals;
   var trace_buffer;
   var trace_index;
+  var scope : HDLModuleScope; // captures trace_signals in the module, if supported
 
   // for virtual CRT
   var framex=0;
@@ -346,9 +347,19 @@ var VerilogPlatform = function(mainElement, options) {
   updateVideoFrameCycles(ncycles:number, sync:boolean, trace:boolean) : void {
     ncycles |= 0;
     var inspect = inspect_obj != null && inspect_sym != null;
+    if (scope) trace_buffer = scope.getScopeBuffer(); // memory may have moved
     // use fast trace buffer-based update?
-    if (sync && !trace && !inspect && (top as HDLModuleTrace).trace != null && scanlineCycles > 0) {
-      this.updateVideoFrameFast((top as any) as HDLModuleTrace);
+    if (sync && (!trace || scope) && !inspect && (top as HDLModuleTrace).trace != null && scanlineCycles > 0) {
+      if (trace) {
+        // at most one pass through the ring per frame, like snapshotTrace()
+        var n = trace_signals.length;
+        scope.startScope(trace_index, Math.ceil((trace_buffer.length - n) / n));
+      }
+      try {
+        this.updateVideoFrameFast((top as any) as HDLModuleTrace);
+      } finally {
+        if (trace) trace_index = scope.stopScope();
+      }
       this.updateRecorder();
       return;
     }
@@ -566,8 +577,8 @@ var VerilogPlatform = function(mainElement, options) {
       {
         // initialize top module and constant pool
         var useWASM = true;
-        var topcons = useWASM ? HDLModuleWASM : HDLModuleJS;
-        var _top = new topcons(topmod, unit.modules['@CONST-POOL@']);
+        var constpool = unit.modules['@CONST-POOL@'];
+        var _top = useWASM ? new HDLModuleWASM(topmod, constpool, null, unit.hash) : new HDLModuleJS(topmod, constpool);
         _top.getFileData = this.sourceFileFetch;
         await _top.init();
         this.dispose();
@@ -604,6 +615,14 @@ var VerilogPlatform = function(mainElement, options) {
         } else {
           this.hideVideoControls();
         }
+        // capture the scope inside the module, so it can run whole scanlines
+        scope = null;
+        if (this.hasvideo && top instanceof HDLModuleWASM && top.setScopeSignals(trace_signals.map((v) => v.name))) {
+          scope = top;
+          trace_buffer = scope.getScopeBuffer();
+        } else {
+          trace_buffer = new Uint32Array(TRACE_BUFFER_DWORDS);
+        }
       }
     }
     // randomize values
@@ -1,6 +1,7 @@
 
 import { VicDual } from "../machine/vicdual";
 import { BaseZ80MachinePlatform } from "../common/baseplatform";
+import { WorkerMachineSpec } from "../common/machineworker";
 import { Platform } from "../common/baseplatform";
 import { PLATFORMS } from "../common/emu";
 
@@ -17,6 +18,7 @@ const VICDUAL_PRESETS = [
 class VicDualPlatform extends BaseZ80MachinePlatform<VicDual> implements Platform {
 
   newMachine()          { return new VicDual(); }
+  workerMachine : WorkerMachineSpec = ['vicdual', 'VicDual'];
   getPresets()          { return VICDUAL_PRESETS; }
   getDefaultExtension() { return ".c"; };
   readAddress(a)        { return this.machine.read(a); }
@@ -0,0 +1,8 @@
+// Seeded random numbers for tests, so a failing case can be replayed.
+// Returns a function yielding 15-bit values from a C-style LCG.
+export function random(seed: number) {
+  return () => {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    return seed >> 16;
+  };
+}
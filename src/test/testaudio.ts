@@ -0,0 +1,50 @@
+import assert from "assert";
+import { describe } from "mocha";
+import { SampleRing, SampleRingSink } from "../common/audio";
+
+// the worklet's side of the ring, without resampling
+function consume(ring: SampleRing, n: number) {
+  let r = Atomics.load(ring.idx, 1);
+  let out = [];
+  for (let i = 0; i < n; i++) out.push(ring.data[(r + i) & ring.mask]);
+  Atomics.store(ring.idx, 1, (r + n) | 0);
+  return out;
+}
+
+describe('sample ring', function () {
+
+  it('wraps around the buffer and the indices', function () {
+    let buffer = new SharedArrayBuffer(8 + 8 * 4);
+    new Int32Array(buffer, 0, 2).fill(0x7ffffffd); // close to overflowing
+    let ring = new SampleRing(buffer);
+    let next = 0;
+    for (let i = 0; i < 10; i++) {
+      for (let j = 0; j < 5; j++) ring.push(next++);
+      assert.strictEqual(ring.available(), 5);
+      assert.deepStrictEqual(consume(ring, 5), [0, 1, 2, 3, 4].map((k) => next - 5 + k));
+    }
+    assert.ok(ring.w < 0);
+    assert.strictEqual(ring.dropped, 0);
+  });
+
+  it('drops samples when full', function () {
+    let ring = new SampleRing(8);
+    for (let i = 0; i < 11; i++) ring.push(i);
+    assert.strictEqual(ring.available(), 8);
+    assert.strictEqual(ring.dropped, 3);
+    assert.deepStrictEqual(consume(ring, 2), [0, 1]);
+    ring.push(100);
+    assert.strictEqual(ring.dropped, 3);
+    assert.deepStrictEqual(consume(ring, 7), [2, 3, 4, 5, 6, 7, 100]);
+    assert.strictEqual(ring.available(), 0);
+  });
+
+  it('resamples a machine to the output rate', function () {
+    let ring = new SampleRing(1024);
+    let sink = new SampleRingSink(ring, 1000000, 44100);
+    for (let i = 0; i < 10; i++) sink.feedSample(0.5, 1000); // 10 ms
+    let n = ring.available();
+    assert.ok(n >= 440 && n <= 441, `${n} samples`);
+    for (let v of consume(ring, n)) assert.ok(Math.abs(v - 0.5) < 1e-6, `${v}`);
+  });
+});
@@ -0,0 +1,129 @@
+import assert from "assert";
+import { describe } from "mocha";
+import * as fs from "fs";
+import { BASICParser } from "../common/basic/compiler";
+import { BASICRuntime } from "../common/basic/runtime";
+
+const PRESET_DIR = 'presets/basic';
+const MAX_STATEMENTS = 100000;
+// answers to INPUT, in turn
+const ANSWERS = ['3', 'YES', '5', 'NO', '1', 'Y', '10', 'N', '2', '7'];
+const MAX_INPUTS = 100;
+// print the time they took
+const TIMED_PRESETS = ['sieve.bas'];
+
+function compile(source: string) {
+  let parser = new BASICParser();
+  let program = parser.parseFile(source, 'test.bas');
+  return parser.errors.length ? null : program;
+}
+
+// runs a program with step() or run(), answering INPUT from the list,
+// returns what it printed, how many statements it executed and where it stopped
+function runProgram(source: string, fast: boolean) {
+  let rt = new BASICRuntime();
+  let output = [];
+  let answers = 0;
+  rt.print = (s: string) => { output.push(s); };
+  // answers right away, so errors in INPUT are thrown from step() or run(),
+  // or never, to stop the program
+  rt.input = ((prompt: string, nargs: number) => {
+    output.push(prompt);
+    if (answers >= MAX_INPUTS) return { then: () => { } };
+    let vals = [];
+    for (let i = 0; i < (nargs || 1); i++) vals.push(ANSWERS[answers++ % ANSWERS.length]);
+    return { then: (fn) => fn({ line: vals.join(','), vals }) };
+  }) as any;
+  rt.load(compile(source));
+  rt.reset();
+  let count = 0;
+  let error = null;
+  try {
+    while (rt.running && count < MAX_STATEMENTS) {
+      if (fast) {
+        count += rt.run(MAX_STATEMENTS - count);
+      } else {
+        rt.step();
+        count++;
+      }
+    }
+  } catch (e) {
+    error = `${e.message} at line ${rt.getCurrentLabel()}`;
+  }
+  // (run() doesn't count the statements of a block that threw)
+  return { output: output.join(''), count: error ? null : count, error, pc: rt.curpc };
+}
+
+// with Math.random seeded, for RANDOMIZE
+function runSeeded(source: string, fast: boolean) {
+  let random = Math.random;
+  let seed = 1;
+  Math.random = () => (seed = (seed * 16807) % 2147483647) / 2147483647;
+  try {
+    return runProgram(source, fast);
+  } finally {
+    Math.random = random;
+  }
+}
+
+describe('BASIC runtime', function () {
+  this.timeout(120000);
+
+  it('runs the presets the same with compiled blocks', function () {
+    let ran = 0;
+    for (let fn of fs.readdirSync(PRESET_DIR)) {
+      if (!fn.endsWith('.bas') || TIMED_PRESETS.includes(fn)) continue;
+      let source = fs.readFileSync(PRESET_DIR + '/' + fn, 'utf-8');
+      if (!compile(source)) continue; // (a few use syntax the parser doesn't support)
+      let slow = runSeeded(source, false);
+      let fast = runSeeded(source, true);
+      assert.deepStrictEqual(fast, slow, fn);
+      ran++;
+    }
+    assert.ok(ran > 50, `only ${ran} presets ran`);
+  });
+
+  it('restores the variables SUB parameters shadow', function () {
+    // (a SUB has to be defined before it's called)
+    let source = [
+      'OPTION DIALECT MODERN',
+      'SUB INNER(B)',
+      '  PRINT "INNER ";A;" ";B',
+      'END SUB',
+      'SUB SHOW(A, B)',
+      '  PRINT "SHOW ";A;" ";B',
+      '  CALL INNER(A + 10)',
+      '  PRINT "BACK ";A;" ";B',
+      'END SUB',
+      'A = 1 : B = 2',
+      'CALL SHOW(B, A)',
+      'PRINT "AFTER ";A;" ";B',
+    ].join('\n');
+    for (let fast of [false, true]) {
+      let result = runProgram(source, fast);
+      assert.strictEqual(result.error, null);
+      assert.strictEqual(result.output, 'SHOW 2 1\nINNER 2 12\nBACK 2 1\nAFTER 1 2\n');
+    }
+  });
+
+  it('stops at the same statement with compiled blocks', function () {
+    // C only has a value inside the SUB, and the division fails after a loop
+    let program = (last: string) => [
+      '10 SUB SHOW(C)',
+      '20 PRINT C',
+      '30 END SUB',
+      '40 A = 1 : B = 0',
+      '50 FOR I = 1 TO 3 : A = A * 2 : NEXT I',
+      '60 CALL SHOW(A)',
+      '70 PRINT A : ' + last,
+    ].join('\n');
+    for (let [last, error] of [
+      ['PRINT C', "I haven't assigned a value to C. at line 70"],
+      ['PRINT A / B', "I can't divide by zero. at line 70"],
+    ]) {
+      let slow = runProgram(program(last), false);
+      assert.strictEqual(slow.error, error);
+      assert.deepStrictEqual(runProgram(program(last), true), slow);
+    }
+  });
+});
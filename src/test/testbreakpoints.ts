@@ -0,0 +1,92 @@
+import assert from "assert";
+import { describe } from "mocha";
+import { BaseDebugPlatform, BreakpointList, CpuState, EmuState } from "../common/baseplatform";
+
+// counts up from 0, one instruction per clock, instructions at odd PCs take two clocks
+class CounterPlatform extends BaseDebugPlatform {
+  pc = 0;
+  half = false;
+  hits: number[] = [];
+
+  constructor() {
+    super();
+    this.setupDebug(() => this.hits.push(this.pc));
+  }
+  getCPUState(): CpuState { return { PC: this.pc }; }
+  saveState(): EmuState { return { c: this.getCPUState(), o: { half: this.half } }; }
+  loadState(state: EmuState) { this.pc = state.c.PC; this.half = state.o['half']; }
+  getPC() { return this.pc; }
+  getSP() { return 0; }
+  isStable() { return !this.half; }
+  pause() { }
+  resume() { }
+  advance() {
+    for (let i = 0; i < 100; i++) {
+      if (this.debugCallback && this.debugCallback()) break;
+      if ((this.pc & 1) && !this.half) this.half = true;
+      else { this.half = false; this.pc++; }
+    }
+    return 100;
+  }
+  // runs a frame from the saved debug state, like the animation timer does
+  frame() {
+    this.nextFrame(true);
+  }
+}
+
+describe('breakpoints', function () {
+
+  it('evaluates every condition, in case they count clocks', function () {
+    let list = new BreakpointList();
+    let calls = [0, 0, 0];
+    list.set('a', { cond: () => { calls[0]++; return true; } });
+    list.set('b', { cond: () => { calls[1]++; return false; } });
+    list.set('c', { cond: () => { calls[2]++; return true; } });
+    assert.strictEqual(list.getDebugCondition()(), true);
+    assert.deepStrictEqual(calls, [1, 1, 1]);
+  });
+
+  it('checks PC breakpoints with a table, and recompiles when changed', function () {
+    let list = new BreakpointList();
+    let pc = 0;
+    let hits = 0;
+    list.set('pc', { pc: 3 });
+    let cond = list.getDebugCondition(() => pc, () => hits++);
+    assert.strictEqual(list.getDebugCondition(() => pc, () => hits++), cond);
+    assert.strictEqual(cond(), false);
+    pc = 3;
+    assert.strictEqual(cond(), true);
+    assert.strictEqual(hits, 1);
+    pc = -1; // between instructions
+    assert.strictEqual(cond(), false);
+    list.remove('pc');
+    pc = 3;
+    assert.strictEqual(list.getDebugCondition(() => pc, () => hits++), null);
+  });
+
+  it('runs to a PC like runEval() does', function () {
+    let p = new CounterPlatform();
+    p.runEval((c) => c.PC == 5);
+    p.frame();
+    let evalClock = p.debugClock;
+    assert.deepStrictEqual(p.hits, [5]);
+    p = new CounterPlatform();
+    p.runToPC(5);
+    assert.strictEqual(p.breakpoints.id2bp['debug'].pc, 5);
+    p.frame();
+    assert.deepStrictEqual(p.hits, [5]);
+    assert.strictEqual(p.debugClock, evalClock);
+  });
+
+  it("doesn't stop at the PC it was already at", function () {
+    let p = new CounterPlatform();
+    p.runToPC(5);
+    p.frame();
+    p.runToPC(5); // starts over from the frame's saved state
+    p.frame();
+    assert.deepStrictEqual(p.hits, [5]);
+    p.runToPC(8);
+    p.frame();
+    assert.deepStrictEqual(p.hits, [5, 8]);
+  });
+});
@@ -0,0 +1,208 @@
+import assert from "assert";
+import { describe } from "mocha";
+import * as fs from "fs";
+import * as os from "os";
+import * as path from "path";
+import { loadBuildWorker, NodeThreadWorker } from "../tools/workerenv";
+import type { Builder } from "../worker/builder";
+
+// two C files and a shared header, linked with cc65's c64.lib
+function c64Project(defines: string) {
+  let files = {
+    'main.c': defines + '\n#include "add.h"\nint main(void) { return add(1, 2); }\n',
+    'add.h': 'int add(int a, int b);\n',
+    'add.c': '#include "add.h"\nint add(int a, int b) { return a + b; }\n',
+  };
+  return {
+    updates: Object.entries(files).map(([path, data]) => ({ path, data })),
+    buildsteps: [
+      { path: 'main.c', files: ['main.c', 'add.h'], platform: 'c64', tool: 'cc65', mainfile: true },
+      { path: 'add.c', files: ['add.c', 'add.h'], platform: 'c64', tool: 'cc65' },
+    ],
+  };
+}
+
+describe('build worker', function () {
+  let send: (msg: any) => Promise<any[]>;
+  let builder: Builder;
+  let PLATFORM_PARAMS;
+  let defaultParams;
+
+  // a restarted worker has default params and an empty store, but keeps its build cache
+  async function restartWorker() {
+    PLATFORM_PARAMS['c64'] = structuredClone(defaultParams);
+    await send({ reset: true });
+  }
+  async function build(msg) {
+    let results = await send(msg);
+    assert.strictEqual(results.length, 1);
+    assert.deepStrictEqual(results[0].errors, []);
+    assert.ok(results[0].output);
+    return results[0];
+  }
+
+  before(async function () {
+    // workermain has to load first, it resolves the tool modules' import cycle
+    send = await loadBuildWorker();
+    builder = (await import("../worker/builder")).builder;
+    PLATFORM_PARAMS = (await import("../worker/platforms")).PLATFORM_PARAMS;
+    let { BuildCache, MemoryCacheStorage } = await import("../worker/buildcache");
+    builder.cache = new BuildCache(new MemoryCacheStorage());
+    defaultParams = structuredClone(PLATFORM_PARAMS['c64']);
+    await send({ preload: 'cc65', platform: 'c64' });
+  });
+
+  it('links a multi-file cc65 project', async function () {
+    let result = await build(c64Project(''));
+    assert.ok(result.segments.find((seg) => seg.name == 'CODE'));
+  });
+
+  it('links the same from the build cache', async function () {
+    // #define CFGFILE changes the params the ld65 step uses
+    await restartWorker();
+    let uncached = await build(c64Project('#define CFGFILE c64-overlay.cfg'));
+    await restartWorker();
+    let hits = builder.cache.hits;
+    let cached = await build(c64Project('#define CFGFILE c64-overlay.cfg'));
+    assert.ok(builder.cache.hits > hits);
+    assert.deepStrictEqual(cached.output, uncached.output);
+    assert.deepStrictEqual(cached.segments, uncached.segments);
+    assert.strictEqual(PLATFORM_PARAMS['c64'].cfgfile, 'c64-overlay.cfg');
+  });
+
+  it('is unchanged after editing a comment', async function () {
+    // cc65 emits the same .s, so ca65 and ld65 replay the steps they last ran
+    await restartWorker();
+    await build(c64Project('// one'));
+    let results = await send(c64Project('// two'));
+    assert.deepStrictEqual(results, [{ unchanged: true }]);
+    results = await send(c64Project('int changed;'));
+    assert.ok(results[0].output);
+  });
+
+  it('keys steps by tool and input contents', async function () {
+    let { store } = await import("../worker/builder");
+    store.putFile('key.c', 'int x;');
+    let step = { tool: 'cc65', platform: 'c64', path: 'key.c', params: PLATFORM_PARAMS['c64'] };
+    let key = builder.cache.computeKey(step, store);
+    store.putFile('key.c', 'int y;');
+    assert.notStrictEqual(builder.cache.computeKey(step, store), key);
+    store.putFile('key.c', 'int x;');
+    assert.strictEqual(builder.cache.computeKey(step, store), key);
+    assert.notStrictEqual(builder.cache.computeKey({ ...step, tool: 'ca65' }, store), key);
+    assert.strictEqual(builder.cache.computeKey({ ...step, path: 'missing.c' }, store), null);
+  });
+
+  it('evicts the least recently used cache entries', async function () {
+    let { MemoryCacheStorage } = await import("../worker/buildcache");
+    let mem = new MemoryCacheStorage();
+    mem.maxEntries = 2;
+    let entry = (n) => ({ result: { unchanged: true } as any, files: [{ path: 'f', data: 'v' + n }] });
+    await mem.put('a', entry(1));
+    await mem.put('b', entry(2));
+    await mem.get('a');
+    await mem.put('c', entry(3));
+    assert.ok(await mem.get('a'));
+    assert.strictEqual(await mem.get('b'), undefined);
+    assert.ok(await mem.get('c'));
+  });
+
+  it('links the same with a worker pool', async function () {
+    let { BuildWorkerPool } = await import("../worker/workerpool");
+    await restartWorker();
+    builder.cache = null;
+    let serial = await build(c64Project('#define CFGFILE c64-overlay.cfg'));
+    // sub-workers get an empty build cache, so they have to preload the filesystem
+    process.env.BUILD_CACHE_DIR = fs.mkdtempSync(path.join(os.tmpdir(), 'buildcache-'));
+    (globalThis as any).Worker = NodeThreadWorker;
+    let pool = builder.pool = new BuildWorkerPool((globalThis as any).location.href, 2);
+    try {
+      await restartWorker();
+      let parallel = await build(c64Project('#define CFGFILE c64-overlay.cfg'));
+      assert.strictEqual(pool.workers.length, 2);
+      assert.deepStrictEqual(parallel.output, serial.output);
+      assert.deepStrictEqual(parallel.segments, serial.segments);
+      assert.strictEqual(PLATFORM_PARAMS['c64'].cfgfile, 'c64-overlay.cfg');
+    } finally {
+      pool.workers.forEach((w) => w.worker.terminate());
+      builder.pool = null;
+      delete (globalThis as any).Worker;
+      fs.rmSync(process.env.BUILD_CACHE_DIR, { recursive: true });
+      delete process.env.BUILD_CACHE_DIR;
+    }
+  });
+
+  it('revalidates cached library files', async function () {
+    let { fetchExtraFile } = await import("../worker/builder");
+    let g = globalThis as any;
+    let stored = new Map<string, Response>();
+    g.caches = {
+      open: async () => ({
+        match: async (url) => stored.get(url)?.clone(),
+        put: async (url, response) => { stored.set(url, response); },
+      })
+    };
+    let etag = '"1"';
+    let conditional = [];
+    let fetchFile = g.fetch;
+    g.fetch = async (url, init) => {
+      let match = init?.headers?.['If-None-Match'];
+      conditional.push(match != null);
+      if (match == etag) return new Response(null, { status: 304 });
+      let data = await (await fetchFile(url)).arrayBuffer();
+      return new Response(data, { headers: { 'ETag': etag } });
+    };
+    try {
+      let xpath = 'lib/c64/sidmusic.bin';
+      let data = fs.readFileSync('src/worker/' + xpath);
+      assert.deepStrictEqual(Buffer.from(await fetchExtraFile(xpath)), data);
+      assert.deepStrictEqual(Buffer.from(await fetchExtraFile(xpath)), data); // 304
+      etag = '"2"';
+      assert.deepStrictEqual(Buffer.from(await fetchExtraFile(xpath)), data);
+      assert.deepStrictEqual(conditional, [false, true, true]);
+      assert.strictEqual(stored.values().next().value.headers.get('ETag'), '"2"');
+    } finally {
+      g.fetch = fetchFile;
+      delete g.caches;
+    }
+  });
+
+  after(async function () {
+    PLATFORM_PARAMS['c64'] = defaultParams;
+    await send({ reset: true });
+  });
+});
+
+// replies to each message on a later tick, and counts messages awaiting a reply
+class FakeWorker {
+  static maxPending = 0;
+  pending = 0;
+  onmessage: (e: { data: any }) => void = null;
+  onerror: (e: { message: string }) => void = null;
+  postMessage(msg: any) {
+    FakeWorker.maxPending = Math.max(FakeWorker.maxPending, ++this.pending);
+    setTimeout(() => {
+      this.pending--;
+      this.onmessage({ data: { files: [], result: { path: msg.substep.path } } });
+    }, 1);
+  }
+  terminate() { }
+}
+
+describe('build worker pool', function () {
+  it('gives each step a worker of its own', async function () {
+    let { BuildWorkerPool } = await import("../worker/workerpool");
+    let { FileWorkingStore } = await import("../worker/builder");
+    (globalThis as any).Worker = FakeWorker;
+    try {
+      let pool = new BuildWorkerPool('fake.js', 2);
+      let steps = ['a.c', 'b.c', 'c.c', 'd.c', 'e.c'].map((path) => ({ path, platform: 'c64', tool: 'cc65' }));
+      let results = await Promise.all(steps.map((step) => pool.execute(step, new FileWorkingStore(), [])));
+      assert.deepStrictEqual(results.map((r) => r.result.path), steps.map((step) => step.path));
+      assert.strictEqual(pool.workers.length, 2);
+      assert.strictEqual(FakeWorker.maxPending, 1);
+    } finally {
+      delete (globalThis as any).Worker;
+    }
+  });
+});
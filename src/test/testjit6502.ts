@@ -0,0 +1,139 @@
+import assert from "assert";
+import { describe } from "mocha";
+import { MOS6502 } from "../common/cpu/MOS6502";
+import { MOS6502Regs } from "../common/cpu/MOS6502JIT";
+import { OPS_6502 } from "../common/cpu/disasm6502";
+import { KIM1 } from "../machine/kim1";
+import { AppleII } from "../machine/apple2";
+import { random } from "./random";
+
+// a 6502 on 64K of RAM, logging its writes
+class TestCPU {
+  cpu = new MOS6502();
+  mem: Uint8Array;
+  writes: number[] = [];
+  clock = 0;
+
+  constructor(mem: Uint8Array, jit: boolean) {
+    this.mem = mem.slice(0);
+    if (jit) this.cpu.enableJIT((a) => this.mem[a]);
+    this.cpu.connectMemoryBus({
+      read: (a) => this.mem[a & 0xffff], // the core's PC can run past $ffff
+      write: (a, v) => { this.mem[a & 0xffff] = v; this.writes.push(a << 8 | v); },
+    });
+    this.cpu.reset();
+    this.step();
+  }
+  step() {
+    do { this.cpu.advanceClock(); this.clock++; } while (!this.cpu.isStable());
+  }
+  regs(): MOS6502Regs {
+    let r = {} as MOS6502Regs;
+    this.cpu.cpu.exportRegs(r);
+    return r;
+  }
+}
+
+// random bytes, all of them official opcodes so code can start anywhere
+function randomCode(rnd: () => number) {
+  let mem = new Uint8Array(0x10000);
+  for (let i = 0; i < mem.length; i++) {
+    do { mem[i] = rnd(); } while (OPS_6502[mem[i]].il);
+  }
+  return mem;
+}
+
+// runs compiled blocks on one CPU and the interpreter on the other,
+// comparing registers, writes and cycle counts at each block boundary
+function compareWithInterpreter(mem: Uint8Array, seed: number, cycles: number) {
+  let rnd = random(seed);
+  let jit = new TestCPU(mem, true);
+  let interp = new TestCPU(mem, false);
+  let nextIRQ = 1000;
+  let blocks = 0;
+  // (the code can write a KIL opcode and halt)
+  while (jit.clock < cycles && !jit.cpu.isHalted()) {
+    let n = jit.cpu.advanceBlock(1 + (rnd() & 63));
+    if (n) {
+      jit.clock += n;
+      blocks++;
+    } else {
+      jit.step();
+    }
+    while (interp.clock < jit.clock) interp.step();
+    let where = `at clock ${jit.clock}, seed ${seed}`;
+    assert.strictEqual(interp.clock, jit.clock, where);
+    assert.deepStrictEqual(jit.regs(), interp.regs(), where);
+    assert.deepStrictEqual(jit.writes, interp.writes, where);
+    if (jit.clock >= nextIRQ) {
+      jit.cpu.IRQ();
+      interp.cpu.IRQ();
+      nextIRQ += 1000;
+    }
+  }
+  assert.deepStrictEqual(jit.mem, interp.mem);
+  return blocks;
+}
+
+describe('6502 JIT', function () {
+
+  it('runs random code like the interpreter', function () {
+    for (let seed = 1; seed <= 20; seed++) {
+      let blocks = compareWithInterpreter(randomCode(random(seed)), seed, 50000);
+      assert.ok(blocks > 100, `only ${blocks} blocks compiled, seed ${seed}`);
+    }
+  });
+
+  it('recompiles code written by the interpreter', function () {
+    let mem = new Uint8Array(0x10000);
+    mem.set([0x00, 0x04], 0xfffc); // reset vector $400
+    mem.set([0xa9, 0x01, 0x4c, 0x10, 0x04], 0x400); // $400 LDA #1; JMP $410
+    mem.set([0xee, 0x01, 0x04, 0x4c, 0x00, 0x04], 0x410); // $410 INC $401; JMP $400
+    let t = new TestCPU(mem, true);
+    assert.ok(t.cpu.advanceBlock(100));
+    assert.strictEqual(t.regs().A, 1);
+    t.step(); // INC $401
+    t.step(); // JMP $400
+    assert.ok(t.cpu.advanceBlock(100));
+    assert.strictEqual(t.regs().A, 2);
+  });
+
+  it('drops compiled code when a machine loads memory', function () {
+    let m = new KIM1();
+    m.enableJIT(true);
+    m.loadROM(new Uint8Array([0xa9, 0x01, 0x4c, 0x00, 0x04])); // $400 LDA #1; JMP $400
+    let state = m.saveState();
+    let compile = () => {
+      let r = m.cpu.jit.regs;
+      m.cpu.cpu.exportRegs(r);
+      m.cpu.cpu.importRegs({ ...r, PC: 0x400 });
+      assert.ok(m.advanceCPUBlock(100) >= 100);
+      assert.ok(m.cpu.jit.blocks.size > 0);
+    };
+    compile();
+    m.loadState(state);
+    assert.strictEqual(m.cpu.jit.blocks.size, 0);
+    compile();
+    m.loadROM(new Uint8Array([0xa9, 0x02, 0x4c, 0x00, 0x04]));
+    assert.strictEqual(m.cpu.jit.blocks.size, 0);
+  });
+
+  it('drops compiled code when the Apple II switches language card banks', function () {
+    let m = new AppleII();
+    m.connectAudio({ feedSample() { } } as any);
+    m.connectVideo(new Uint32Array(280 * 192));
+    m.reset();
+    m.enableJIT(true);
+    m.doLanguageCardIO(0xc080); // read RAM bank 2
+    m.ram.set([0xa9, 0x01, 0x4c, 0x00, 0xd0], 0xd000 - 0x1000); // $d000 LDA #1; JMP $d000
+    let r = m.cpu.jit.regs;
+    m.cpu.cpu.exportRegs(r);
+    m.cpu.cpu.importRegs({ ...r, PC: 0xd000 });
+    assert.ok(m.advanceCPUBlock(100) >= 100);
+    assert.strictEqual(m.cpu.jit.regs.A, 1);
+    m.doLanguageCardIO(0xc084); // same mapping
+    assert.ok(m.cpu.jit.blocks.size > 0);
+    m.doLanguageCardIO(0xc082); // read ROM
+    assert.strictEqual(m.cpu.jit.blocks.size, 0);
+  });
+});
@@ -0,0 +1,137 @@
+import assert from "assert";
+import { describe } from "mocha";
+import * as fs from "fs";
+import * as vm from "vm";
+import { PageTableBus } from "../common/emu";
+import { ProbeFlags, ProbeRecorder } from "../common/probe";
+import { Atari800 } from "../machine/atari8";
+import { WilliamsMachine } from "../machine/williams";
+
+// the sound chips mix into TSS, which the page loads as a global script
+vm.runInThisContext(fs.readFileSync('tss/js/tss/MasterChannel.js', 'utf-8'));
+
+// a distinct byte for each address of each memory
+function fill(mem: Uint8Array, seed: number) {
+  for (let i = 0; i < mem.length; i++) mem[i] = (i * 7 + (i >> 8) + seed) & 0xff;
+}
+// the first and last byte of each page next to a boundary
+function edges(...boundaries: number[]) {
+  return boundaries.flatMap((a) => [a - 0x101, a - 0x100, a - 1, a, a + 0xff, a + 0x100])
+    .filter((a) => a >= 0 && a <= 0xffff);
+}
+function compare(bus: { read: (a: number) => number }, expected: (a: number) => number, addrs: number[], what: string) {
+  for (let a of addrs) {
+    assert.strictEqual(bus.read(a), expected(a), `${what} at $${a.toString(16)}`);
+  }
+}
+function williams(isDefender: boolean) {
+  // the sound board runs in a worker
+  (globalThis as any).Worker = class { postMessage() { } };
+  try {
+    let m = new WilliamsMachine(isDefender);
+    fill(m.ram, 1);
+    fill(m.rom, 2);
+    return m;
+  } finally {
+    delete (globalThis as any).Worker;
+  }
+}
+
+describe('page table bus', function () {
+
+  it('maps views and falls through to I/O', function () {
+    let io = [];
+    let bus = new PageTableBus(0x300, (a) => 0xee, (a, v) => { io.push([a, v]); });
+    let ram = bus.alloc(0x200);
+    let rom = bus.alloc(0x100);
+    fill(rom, 3);
+    bus.map(0x0000, 0x07ff, ram);       // repeats every $200
+    bus.mapRead(0x1000, 0x10ff, rom);
+    bus.write(0x0601, 0x55);
+    assert.strictEqual(ram[0x0001], 0x55);
+    assert.strictEqual(bus.read(0x0201), 0x55);
+    assert.strictEqual(bus.read(0x1042), rom[0x42]);
+    bus.write(0x1042, 0x66);
+    assert.deepStrictEqual(io, [[0x1042, 0x66]]);
+    assert.strictEqual(bus.read(0x1100), 0xee);
+    bus.unmap(0x0000, 0x00ff);
+    assert.strictEqual(bus.read(0x0001), 0xee);
+    assert.throws(() => bus.mapRead(0x2000, 0x20ff, new Uint8Array(0x100)));
+  });
+
+  it('matches the Atari 800 decoder at cartridge boundaries', function () {
+    let m = new Atari800();
+    fill(m.ram, 1);
+    fill(m.rom, 2);
+    fill(m.bios, 3);
+    let addrs = edges(0x8000, 0xa000, 0xc000, 0xd800, 0x10000);
+    for (let cart_80 of [false, true]) {
+      for (let cart_a0 of [false, true]) {
+        m.loadState({ ...m.saveState(), cart_80, cart_a0 });
+        compare(m.bus, (a) => {
+          if (a < 0x8000) return m.ram[a];
+          if (a < 0xa000) return cart_80 ? m.rom[a - 0x8000] : m.ram[a];
+          if (a < 0xc000) return cart_a0 ? m.rom[a - 0x8000] : m.ram[a];
+          if (a >= 0xd800) return m.bios[a - 0xd800];
+          return 0;
+        }, addrs.filter((a) => a < 0xc000 || a >= 0xd800), `cart_80=${cart_80} cart_a0=${cart_a0}`);
+      }
+    }
+    // RAM under the cartridge is still written, up to the cartridge init vector
+    m.bus.write(0xbeff, 0x11);
+    m.bus.write(0xbf00, 0x22);
+    m.bus.write(0xbffa, 0x33);
+    assert.deepStrictEqual([m.ram[0xbeff], m.ram[0xbf00], m.ram[0xbffa]], [0x11, 0x22, 0x33]);
+  });
+
+  it('matches the Defender decoder at bank switches', function () {
+    let m = williams(true);
+    let addrs = edges(0xc000, 0xd000, 0x10000);
+    for (let bank = 1; bank < 8; bank++) {
+      m.membus.write(0xd000, bank);
+      compare(m.membus, (a) => {
+        if (a < 0xc000) return m.ram[a];
+        if (a >= 0xd000) return m.rom[a - 0xd000];
+        switch (bank) {
+          case 1: return m.rom[(a & 0xfff) + 0x3000];
+          case 2: return m.rom[(a & 0xfff) + 0x4000];
+          case 3: return m.rom[(a & 0xfff) + 0x5000];
+          case 7: return m.rom[(a & 0xfff) + 0x6000];
+          default: return 0;
+        }
+      }, addrs, `banksel=${bank}`);
+    }
+  });
+
+  it('matches the Robotron decoder at bank switches', function () {
+    let m = williams(false);
+    let addrs = edges(0x9000, 0xc000, 0xd000, 0x10000).filter((a) => a < 0xc000 || a >= 0xd000);
+    for (let bank of [0, 1, 0]) {
+      m.membus.write(0xc900, bank);
+      compare(m.membus, (a) => {
+        if (a < 0x9000) return bank ? m.rom[a] : m.ram[a];
+        if (a < 0xc000) return m.ram[a];
+        return m.rom[a - 0x4000];
+      }, addrs, `banksel=${bank}`);
+    }
+  });
+
+  it('only probes Williams memory while a probe is connected', function () {
+    let m = williams(false);
+    m.rom.fill(0x12);  // NOPs, and a reset vector of $1212
+    m.reset();
+    let probe = new ProbeRecorder(m);
+    let reads = () => probe.getSegments().flatMap((seg) => Array.from(seg))
+      .filter((w) => (w & 0xff000000) == ProbeFlags.MEM_READ).length;
+    m.readAddress(0xd000);
+    m.connectProbe(probe);
+    m.readAddress(0xd000);
+    m.cpu.advanceInsn();
+    let probed = reads();
+    m.connectProbe(null);
+    m.readAddress(0xd000);
+    m.cpu.advanceInsn();
+    assert.ok(probed >= 2);  // readAddress and at least the opcode fetch
+    assert.strictEqual(reads(), probed);
+  });
+});
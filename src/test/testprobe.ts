@@ -0,0 +1,96 @@
+import assert from "assert";
+import { describe } from "mocha";
+import { ProbeAggregator, ProbeFlags, ProbeRecorder } from "../common/probe";
+
+function recorder(buflen?: number) {
+  return new ProbeRecorder({ connectProbe() { } }, buflen);
+}
+function words(p: ProbeRecorder) {
+  return p.getSegments().flatMap((seg) => Array.from(seg));
+}
+
+describe('probe recorder', function () {
+
+  it('merges an opcode fetch with the EXECUTE next to it', function () {
+    let p = recorder();
+    p.logExecute(0x100, 0xff);  // logs SP_POP, then EXECUTE
+    p.logRead(0x100, 0xa9);
+    p.logRead(0x200, 0x01);
+    p.logRead(0x300, 0x4c);
+    p.logExecute(0x300, 0xff);
+    assert.deepStrictEqual(words(p), [
+      ProbeFlags.SP_POP | 0xff,
+      ProbeFlags.EXECUTE_READ | 0xa90100,
+      ProbeFlags.MEM_READ | 0x010200,
+      ProbeFlags.EXECUTE_READ | 0x4c0300,
+    ]);
+  });
+
+  it("doesn't merge across clocks", function () {
+    let p = recorder();
+    p.logExecute(0x100, 0xff);
+    p.logClocks(2);
+    p.logRead(0x100, 0xa9);
+    p.logClocks(3);
+    p.logExecute(0x100, 0xff);
+    assert.deepStrictEqual(words(p), [
+      ProbeFlags.SP_POP | 0xff,
+      ProbeFlags.EXECUTE | 0x100,
+      ProbeFlags.CLOCKS | 2,
+      ProbeFlags.MEM_READ | 0xa90100,
+      ProbeFlags.CLOCKS | 3,
+      ProbeFlags.EXECUTE | 0x100,
+    ]);
+  });
+
+  it('keeps the last frames in a ring', function () {
+    let p = recorder(16);
+    p.setRingFrames(2);
+    for (let frame = 1; frame <= 10; frame++) {
+      for (let i = 0; i < 3; i++) p.logWrite(frame, i);
+      p.logNewFrame();
+    }
+    assert.ok(p.wrapped);
+    // each frame starts after the FRAME word of the one before
+    assert.deepStrictEqual(words(p).map((a) => a == ProbeFlags.FRAME ? 'F' : a & 0xffff),
+      ['F', 9, 9, 9, 'F', 10, 10, 10, 'F']);
+  });
+
+  it('streams every word once, across frames and ring wraps', function () {
+    for (let ring of [0, 2]) {
+      let p = recorder(16);
+      p.setRingFrames(ring);
+      let streamed = [];
+      p.streamTo((chunk) => streamed.push(...chunk));
+      for (let frame = 1; frame <= 10; frame++) {
+        for (let i = 0; i < frame % 4; i++) {
+          p.logExecute(frame, 0xff);
+          p.logRead(frame, i);
+          p.logWrite(0x200 + i, frame);
+        }
+        p.logNewFrame();
+      }
+      assert.strictEqual(streamed.filter((w) => w == ProbeFlags.FRAME).length, 10);
+      // each iteration logs an EXECUTE_READ and a write
+      assert.strictEqual(streamed.filter((w) => w != ProbeFlags.FRAME && (w & 0xff000000) != ProbeFlags.SP_POP).length, 30);
+    }
+  });
+
+  it('totals streamed frames by event and address', function () {
+    let p = recorder(16);
+    let totals = new ProbeAggregator();
+    p.streamTo((chunk) => totals.add(chunk));
+    for (let frame = 0; frame < 100; frame++) {
+      p.logExecute(0x100, 0xff);
+      p.logRead(0x100, 0xa9);
+      p.logWrite(0x200, frame);
+      p.logClocks(5);
+      p.logNewFrame();
+    }
+    assert.strictEqual(totals.frames, 100);
+    assert.strictEqual(totals.get(ProbeFlags.EXECUTE, 0x100), 100);
+    assert.strictEqual(totals.get(ProbeFlags.MEM_READ, 0x100), 100);
+    assert.strictEqual(totals.get(ProbeFlags.MEM_WRITE, 0x200), 100);
+    assert.strictEqual(totals.get(ProbeFlags.MEM_WRITE, 0x100), 0);
+  });
+});
@@ -0,0 +1,45 @@
+import assert from "assert";
+import { describe } from "mocha";
+import { CodeProject } from "../ide/project";
+
+// keeps the build messages posted to it
+class FakeWorker {
+  posted = [];
+  onmessage = null;
+  postMessage(msg) { if (msg.gen != null) this.posted.push(msg); }
+}
+
+function newProject() {
+  let worker = new FakeWorker();
+  let platform = { getToolForFilename: () => 'cc65' };
+  let project = new CodeProject(worker, 'c64', platform, null);
+  project.mainPath = 'main.c';
+  project.filedata['main.c'] = 'int main() { return 0; }';
+  project.callbackBuildResult = () => { };
+  return { worker, project };
+}
+
+describe('code project', function () {
+
+  it('uses the result of a background build with the same inputs', async function () {
+    let { worker, project } = newProject();
+    await project.sendBuild(true);
+    await project.sendBuild();
+    assert.strictEqual(worker.posted.length, 1);
+    assert.ok(project.isCompiling);
+    project.receiveWorkerMessage({ gen: worker.posted[0].gen, output: new Uint8Array(1), errors: [] } as any);
+    assert.ok(!project.isCompiling);
+  });
+
+  it('builds again when the promoted background build needs files', async function () {
+    let { worker, project } = newProject();
+    await project.sendBuild(true);
+    await project.sendBuild();
+    project.receiveWorkerMessage({ gen: worker.posted[0].gen, resend: ['main.c'] } as any);
+    await new Promise((resolve) => setTimeout(resolve, 0));
+    assert.strictEqual(worker.posted.length, 2);
+    assert.ok(project.isCompiling);
+    project.receiveWorkerMessage({ gen: worker.posted[1].gen, output: new Uint8Array(1), errors: [] } as any);
+    assert.ok(!project.isCompiling);
+  });
+});
@@ -0,0 +1,80 @@
+import assert from "assert";
+import { describe } from "mocha";
+import { StateRecorderImpl, xorDecode, xorEncode } from "../common/recorder";
+import { random } from "./random";
+
+// a copy of a with runs of changed bytes, some longer than a varint byte can count
+function mutate(a: Uint8Array, rnd: () => number, gap = 300, maxlen = 200) {
+  let b = a.slice(0);
+  for (let i = 0; i < b.length; i += rnd() % gap) {
+    let len = rnd() % maxlen;
+    for (let j = i; j < i + len && j < b.length; j++) b[j] = rnd();
+  }
+  return b;
+}
+
+// a few frames of a machine with RAM, VRAM and registers
+function makeStates(n: number) {
+  let rnd = random(1);
+  let ram = new Uint8Array(0x800).map(rnd);
+  let vram = new Uint16Array(0x400).map(rnd);
+  let states = [];
+  for (let i = 0; i < n; i++) {
+    ram = mutate(ram, rnd, 1000, 16);
+    vram[rnd() & 0x3ff] = i;
+    states.push({ c: { PC: i, SP: 0xff }, ram, vdp: { vram: vram.slice(0), regs: [i, 1, 2] } });
+  }
+  return states;
+}
+
+function recorder() {
+  let platform = { pause() { }, loadState() { }, advance() { return 0; } } as any;
+  return new StateRecorderImpl(platform);
+}
+
+describe('state recorder', function () {
+
+  it('XOR encodes and decodes arrays', function () {
+    let rnd = random(2);
+    for (let len of [0, 1, 3, 4, 5, 100, 0x10000]) {
+      let a = new Uint8Array(len).map(rnd);
+      for (let b of [a.slice(0), a.map((v) => ~v), mutate(a, rnd)]) {
+        let enc = xorEncode(b, a);
+        assert.deepStrictEqual(xorDecode(enc, a), b, `length ${len}`);
+      }
+      assert.strictEqual(xorEncode(a, a).length, 0);
+    }
+    // short runs of unchanged bytes stay in the literals
+    let a = new Uint8Array(10);
+    assert.deepStrictEqual(xorEncode(new Uint8Array([0, 1, 0, 1, 0, 0, 0, 0, 0, 1]), a),
+      new Uint8Array([1, 3, 1, 0, 1, 5, 1, 1]));
+  });
+
+  it('stores deltas that decode to the recorded states', function () {
+    let r = recorder();
+    let states = makeStates(25);
+    let full = 0;
+    states.forEach((s) => r.recordFrame(structuredClone(s)));
+    states.forEach((s) => full += s.ram.length + s.vdp.vram.byteLength);
+    assert.deepStrictEqual(r.getCheckpoints(), states);
+    assert.ok(r.getCheckpoint(1).vdp.vram instanceof Uint16Array);
+    assert.ok(r.memoryUsed < full / 2, `${r.memoryUsed} bytes used`);
+  });
+
+  it('drops the oldest keyframe and its deltas when full', function () {
+    let r = recorder();
+    r.maxCheckpoints = 20;
+    let states = makeStates(35);
+    states.forEach((s) => r.recordFrame(structuredClone(s)));
+    // dropped 10 at the 21st and the 31st
+    assert.strictEqual(r.numCheckpoints, 15);
+    assert.deepStrictEqual(r.getCheckpoints(), states.slice(20));
+    assert.strictEqual(r.getLastCheckpoint().c.PC, 34);
+    // over the memory limit, only the newest keyframe and its deltas are kept
+    r = recorder();
+    r.maxMemory = 1;
+    states.forEach((s) => r.recordFrame(structuredClone(s)));
+    assert.strictEqual(r.numCheckpoints, 5);
+    assert.deepStrictEqual(r.getCheckpoints(), states.slice(30));
+  });
+});
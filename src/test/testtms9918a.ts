@@ -0,0 +1,96 @@
+import assert from "assert";
+import { describe } from "mocha";
+import { SMSVDP, TMS9918A } from "../common/video/tms9918a";
+import { random } from "./random";
+
+function writeReg(vdp: TMS9918A, reg: number, val: number) {
+  vdp.writeAddress(val);
+  vdp.writeAddress(0x80 | reg);
+}
+
+function writeVRAM(vdp: TMS9918A, addr: number, vals: number[]) {
+  vdp.writeAddress(addr & 0xff);
+  vdp.writeAddress(0x40 | (addr >> 8));
+  for (let v of vals) vdp.writeData(v);
+}
+
+// FNV-1a
+function hash(h: number, v: number) {
+  return Math.imul(h ^ v, 0x01000193) >>> 0;
+}
+
+// draws a frame of random VRAM and registers, with sprites near the screen
+// and changes to the sprite table and registers mid-frame,
+// and hashes the pixels and the status after each line
+function renderTrial(vdpClass: typeof TMS9918A, trial: number) {
+  let rnd = random(trial + 1);
+  let fb = new Uint32Array(304 * 262);
+  let vdp = new vdpClass(fb, { setVDPInterrupt() { } }, (trial & 1) != 0);
+  vdp.reset();
+  let regs = [rnd() & 3, 0x40 | (rnd() & 0x1b), rnd() & 15, rnd() & 255, rnd() & 7, rnd() & 0x7f, rnd() & 7, rnd() & 255];
+  if (vdpClass === SMSVDP) regs[0] |= trial & 4; // mode 4 on half of them
+  let mem = [];
+  for (let i = 0; i < 0x4000; i++) mem.push(rnd() & 255);
+  let sat = regs[5] << 7;
+  for (let s = 0; s < 32; s++) {
+    let y = rnd() % 200;
+    if (rnd() % 40 == 0) y = 0xd0; // end marker
+    if (rnd() % 10 == 0) y = 0xe0 + (rnd() & 31); // partly above the screen
+    mem[(sat + s * 4) & 0x3fff] = y;
+  }
+  regs.forEach((val, reg) => writeReg(vdp, reg, val));
+  writeVRAM(vdp, 0, mem);
+  if (vdp instanceof SMSVDP) {
+    vdp.writeAddress(0);
+    vdp.writeAddress(0xc0); // CRAM
+    for (let i = 0; i < 32; i++) vdp.writeData(rnd() & 63);
+  }
+  let h = 0x811c9dc5;
+  for (let y = 0; y < 262; y++) {
+    if (y == 100 && trial % 3 == 0) writeVRAM(vdp, sat + 4 * (rnd() & 31), [rnd() % 190]);
+    if (y == 150 && trial % 5 == 0) writeReg(vdp, 1, regs[1] ^ 3); // sprite size and magnification
+    vdp.drawScanline(y);
+    h = hash(h, vdp.statusRegister);
+  }
+  for (let i = 0; i < fb.length; i++) h = hash(h, fb[i]);
+  return h;
+}
+
+// from the per-pixel renderer that scanned all sprites on each line
+const TMS9918A_HASHES = [
+  0x8b9f0bef, 0x234fafb3, 0x084aa3ef, 0xba5e50ce, 0xf84f4d32, 0xd21724aa,
+  0xfe55e95c, 0x894ac86f, 0xe7fa5039, 0x894ac86f, 0x63aa60ef, 0x7af25def,
+  0x5ddb286f, 0x1bc57bef, 0x07f993ef, 0x1cf48c39, 0x72a0810c, 0xfb4ad1af,
+  0x435efd2f, 0x1c7a966f, 0x86b0818f, 0xa871f5ef, 0x894ac86f, 0x1c784e6f,
+  0xd62fd66f, 0xbe850e6f, 0xbb124f8f, 0x26d6770f, 0xfb25f058, 0xf2c40aff,
+  0x26a34b42, 0x3019d36f, 0xbf8f506f, 0x442c906f, 0x1c7a966f, 0x1c7a966f,
+  0x32f7e38f, 0xd06f9bef, 0x07f993ef, 0xa7381a2f, 0xfde04b8f, 0xed81517c,
+  0x467d6f4f, 0xd861f866, 0xa58c9c6f, 0xa1c31123, 0xa871f5ef, 0x5379358f,
+  0x6a0e826f, 0xfedeee6f, 0xa615850f, 0x63280e6b, 0xd114e327, 0xf2a159ef,
+  0xc5aee4ff, 0x70f0f0ef, 0x3f5c10cf, 0xe327e0ef, 0x7218894f, 0xd9f2e06f,
+];
+const SMSVDP_HASHES = [
+  0x8b9f0bef, 0x1fca4321, 0x0ff690cb, 0x48bd6e30, 0x56193438, 0xfce972db,
+  0xfbd39adb, 0x1972fbf6, 0x610a9efa, 0x826c7d58, 0x63aa60ef, 0x7af25def,
+  0x7fe65fdc, 0x16ad2740, 0x6586e862, 0xd008388d, 0x59366551, 0x466bc731,
+  0x0239923c, 0x1c7a966f, 0x390ad8a3, 0x36a6a1e0, 0x5467a9ee, 0xdb054792,
+  0xd62fd66f, 0xbe850e6f, 0x7ea4e475, 0x5337d156, 0x020cc829, 0xd8bdf5ea,
+  0xe9e9c9f4, 0x424f49c9, 0xd0abef63, 0x153e6751, 0x403c245b, 0x1c7a966f,
+  0x77858fbd, 0x8a5fc828, 0x5c651b26, 0x343c5665, 0x7425bb59, 0xc00175e0,
+  0x19256a7c, 0x82f3c2f6, 0x5cde3705, 0xe5044caf, 0x859bba61, 0x6ab8ca0e,
+  0x6a0e826f, 0xfedeee6f, 0x6274ec49, 0x56bd1863, 0x0262055f, 0x08fa76b2,
+  0xbdc8961f, 0x8cd12be5, 0x1fde45bb, 0xd5e30e87, 0xfe31406f, 0xd9f2e06f,
+];
+
+describe('TMS9918A', function () {
+
+  it('draws the same pixels and status as the per-pixel renderer', function () {
+    let hashes = TMS9918A_HASHES.map((_, trial) => renderTrial(TMS9918A, trial));
+    assert.deepStrictEqual(hashes, TMS9918A_HASHES);
+  });
+
+  it('draws the same on the SMS VDP', function () {
+    let hashes = SMSVDP_HASHES.map((_, trial) => renderTrial(SMSVDP, trial));
+    assert.deepStrictEqual(hashes, SMSVDP_HASHES);
+  });
+});
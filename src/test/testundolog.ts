@@ -0,0 +1,95 @@
+import assert from "assert";
+import { describe } from "mocha";
+import { KIM1 } from "../machine/kim1";
+import { UndoLog, isRAMIn } from "../common/undolog";
+
+// same as the KIM-1 platform's memory map
+const KIM1_MEMORY_MAP = [
+  { name: 'RAM', start: 0x0000, size: 0x1400, type: 'ram' },
+  { name: '6530', start: 0x1700, size: 0x0040, type: 'io' },
+  { name: '6530', start: 0x1740, size: 0x0040, type: 'io' },
+  { name: 'RAM', start: 0x1780, size: 0x0080, type: 'ram' },
+  { name: 'BIOS', start: 0x1800, size: 0x0800, type: 'rom' },
+];
+
+// fills $200-$207 with 0-7 and counts in $10, then writes the 6530's DDR
+const PROGRAM = [
+  0xa2, 0x00,       // $400 LDX #0
+  0x8a,             // $402 TXA
+  0x9d, 0x00, 0x02, // $403 STA $200,X
+  0xe6, 0x10,       // $406 INC $10
+  0xe8,             // $408 INX
+  0xe0, 0x08,       // $409 CPX #8
+  0xd0, 0xf5,       // $40b BNE $402
+  0x8d, 0x01, 0x17, // $40d STA $1701
+  0x4c, 0x00, 0x04, // $410 JMP $400
+];
+const LOOP_INSNS = 1 + 8 * 6; // up to the STA $1701
+
+describe('undo log', function () {
+  let m: KIM1;
+  let log: UndoLog;
+  let clock: number;
+  let states: any[];
+
+  // runs n instructions, keeping the machine state before each
+  function run(n: number) {
+    for (let i = 0; i < n; i++) {
+      states[clock] = m.saveState();
+      do { m.advanceCPU(); } while (!m.cpu.isStable()); // one cycle at a time
+      clock++;
+    }
+  }
+  function start(minClock = 0) {
+    m = new KIM1();
+    m.loadROM(new Uint8Array(PROGRAM)); // at $400
+    while (!m.cpu.isStable()) m.advanceCPU(); // finish the reset
+    m.cpu.loadState({ ...m.cpu.saveState(), PC: 0x400 });
+    clock = 0;
+    states = [];
+    log = new UndoLog(m, () => clock, isRAMIn(KIM1_MEMORY_MAP));
+    log.minClock = minClock;
+    m.connectProbe(log);
+  }
+
+  it('restores the CPU and RAM before each instruction', function () {
+    start();
+    run(LOOP_INSNS);
+    log.seal();
+    while (clock > 0) {
+      let step = log.undo();
+      assert.ok(step, `undo at clock ${clock}`);
+      clock = step.clock;
+      assert.deepStrictEqual(m.cpu.saveState(), states[clock].c);
+      assert.deepStrictEqual(m.ram, states[clock].ram);
+    }
+    assert.strictEqual(log.undo(), null);
+    assert.strictEqual(m.ram[0x200 + 7], 0);
+    assert.strictEqual(m.ram[0x10], 0);
+  });
+
+  it("doesn't undo writes outside of RAM", function () {
+    start();
+    run(LOOP_INSNS + 1);
+    log.seal();
+    assert.strictEqual(m.rriot1.regs[1], 7);
+    assert.ok(!log.canUndo());
+    assert.strictEqual(log.undo(), null);
+    assert.strictEqual(m.rriot1.regs[1], 7);
+  });
+
+  it('only logs instructions from minClock on', function () {
+    start(LOOP_INSNS - 6);
+    let saves = 0;
+    let saveState = m.cpu.saveState.bind(m.cpu);
+    m.cpu.saveState = () => { saves++; return saveState(); };
+    run(LOOP_INSNS);
+    log.seal();
+    assert.strictEqual(log.count, 6);
+    assert.strictEqual(saves, LOOP_INSNS + 6); // run() saves every state itself
+    for (let i = 0; i < 6; i++) clock = log.undo().clock;
+    assert.strictEqual(clock, LOOP_INSNS - 6);
+    assert.deepStrictEqual(m.ram, states[clock].ram);
+    assert.strictEqual(log.undo(), null);
+  });
+});
@@ -0,0 +1,233 @@
+import fs from 'fs';
+import { PerformanceObserver } from 'perf_hooks';
+import { hasProbe, Machine } from "../common/baseplatform";
+import { NullProbe } from "../common/devices";
+import { Z80 } from "../common/cpu/ZilogZ80";
+import { MachineRunner } from "./runmachine";
+
+// Headless throughput benchmark for the machines in src/machine.
+//
+//   node gen/tools/benchmachine.js [options] [romdir]
+//
+//   --frames N          frames to time per ROM (default 600)
+//   --platform id       only run this platform (may be repeated)
+//   --jit               enable the CPU block JIT where supported
+//   --json file         write results as JSON
+//   --baseline file     compare against a previous --json run
+//   --max-drop pct      with --baseline, fail if fps drops by more than pct (default 10)
+//
+// ROMs are read from <romdir>/<platform>/*, e.g. presets compiled by buildroms:
+//
+//   node gen/tools/buildroms.js romdir && node gen/tools/benchmachine.js romdir
+//
+// Exits with an error if a ROM fails to run, or if a --baseline entry is missing or slower.
+// Z80 platforms without ROMs run a fixed instruction mix (z80mix), for changes to the core.
+// Other platforms without ROMs run with an empty ROM, which still exercises video and timing.
+
+const BENCH_MACHINES: { [platform: string]: [string, string, any[]?] } = {
+    'apple2': ['apple2', 'AppleII'],
+    'astrocade': ['astrocade', 'BallyAstrocade', [false]],
+    'atari7800': ['atari7800', 'Atari7800'],
+    'atari8-800': ['atari8', 'Atari800'],
+    'atari8-5200': ['atari8', 'Atari5200'],
+    'coleco': ['coleco', 'ColecoVision'],
+    'devel-6502': ['devel', 'Devel6502'],
+    'exidy': ['exidy', 'ExidyUGBv2'],
+    'galaxian': ['galaxian', 'GalaxianMachine'],
+    'galaxian-scramble': ['galaxian', 'GalaxianScrambleMachine'],
+    'kim1': ['kim1', 'KIM1'],
+    'msx': ['msx', 'MSX1'],
+    'mw8080bw': ['mw8080bw', 'Midway8080'],
+    'sms-sg1000-libcv': ['sms', 'SG1000'],
+    'sms-sms-libcv': ['sms', 'SMS'],
+    'sms-gg-libcv': ['sms', 'GameGear'],
+    'vicdual': ['vicdual', 'VicDual'],
+    'williams': ['williams', 'WilliamsMachine', [false]],
+};
+
+export interface BenchResult {
+    platform: string;
+    rom: string;
+    frames: number;
+    secs: number;
+    fps: number;
+    ips: number;         // instructions per second
+    gcs: number;         // garbage collections while timing
+    heapDelta: number;   // bytes of heap growth while timing
+}
+
+// register loads, ALU, (HL), CB, DD and ED prefixes, run from the start of ROM
+const Z80_MIX_PROGRAM = [
+    0xf3,               // DI
+    0x31, 0x00, 0xf0,   // LD SP,$F000
+    0x3a, 0x00, 0x78,   // loop: LD A,($7800) (Galaxian's watchdog)
+    0x21, 0x00, 0x01,   // LD HL,$0100
+    0x06, 0x40,         // LD B,64
+    0x7e,               // inner: LD A,(HL)
+    0x80,               // ADD A,B
+    0x4f,               // LD C,A
+    0xa9,               // XOR C
+    0xcb, 0x11,         // RL C
+    0xdd, 0x21, 0x10, 0x00, // LD IX,$0010
+    0xdd, 0x7e, 0x02,   // LD A,(IX+2)
+    0xed, 0x44,         // NEG
+    0x23,               // INC HL
+    0x10, 0xee,         // DJNZ inner
+    0xc3, 0x04, 0x00,   // JP loop
+];
+
+function makeZ80MixROM(size: number): Uint8Array {
+    var rom = new Uint8Array(size);
+    rom.set(Z80_MIX_PROGRAM);
+    // NMI lands back in the loop
+    rom.set([0xc3, 0x04, 0x00], 0x66);
+    return rom;
+}
+
+// counts executed instructions (only attached for the counting pass)
+class CountingProbe extends NullProbe {
+    insns = 0;
+    logExecute() { this.insns++; }
+}
+
+// Williams sound runs in a Web Worker, there's no audio to feed here
+class NullWorker {
+    onmessage = null;
+    postMessage() { }
+    terminate() { }
+}
+
+async function newMachine(platform: string): Promise<Machine> {
+    if (typeof Worker === 'undefined') global['Worker'] = NullWorker;
+    var [modname, clsname, args] = BENCH_MACHINES[platform];
+    var mod = await import('../machine/' + modname);
+    return new mod[clsname](...(args || []));
+}
+
+function listROMs(romdir: string, platform: string): string[] {
+    var dir = romdir + '/' + platform;
+    if (!romdir || !fs.existsSync(dir)) return [null];
+    var files = fs.readdirSync(dir).filter((fn) => !fn.startsWith('.')).sort();
+    return files.length ? files.map((fn) => dir + '/' + fn) : [null];
+}
+
+export async function benchROM(platform: string, rompath: string, frames: number, jit: boolean): Promise<BenchResult> {
+    var machine = await newMachine(platform);
+    if (jit && machine['enableJIT']) machine['enableJIT'](true);
+    var runner = new MachineRunner(machine);
+    runner.setup(false);
+    var m = machine as any;
+    var romname = rompath ? rompath.split('/').pop() : null;
+    if (rompath) {
+        m.loadROM(new Uint8Array(fs.readFileSync(rompath)));
+    } else if (m.cpu instanceof Z80) {
+        m.loadROM(makeZ80MixROM(m.defaultROMSize || 0x8000));
+        romname = 'z80mix';
+    }
+    machine.reset();
+    var warmup = Math.min(60, frames);
+    for (var i = 0; i < warmup; i++) runner.run();
+    // count instructions per frame in a separate pass, a probe slows things down
+    var ipf = 0;
+    if (hasProbe(machine)) {
+        var probe = new CountingProbe();
+        machine.connectProbe(probe);
+        for (var i = 0; i < warmup; i++) runner.run();
+        machine.connectProbe(null);
+        ipf = probe.insns / warmup;
+    }
+    // timed pass, with GCs counted as a measure of allocation
+    var gcs = 0;
+    var obs = new PerformanceObserver((list) => { gcs += list.getEntries().length; });
+    obs.observe({ entryTypes: ['gc'] });
+    var heap0 = process.memoryUsage().heapUsed;
+    var t0 = performance.now();
+    for (var i = 0; i < frames; i++) runner.run();
+    var secs = (performance.now() - t0) / 1000;
+    var heapDelta = process.memoryUsage().heapUsed - heap0;
+    await new Promise((resolve) => setTimeout(resolve, 0)); // deliver pending gc entries
+    obs.disconnect();
+    var fps = frames / secs;
+    return {
+        platform,
+        rom: romname,
+        frames,
+        secs: Math.round(secs * 1000) / 1000,
+        fps: Math.round(fps * 10) / 10,
+        ips: Math.round(ipf * fps),
+        gcs,
+        heapDelta,
+    };
+}
+
+// returns descriptions of results that got slower than allowed, or are missing
+export function compareResults(baseline: BenchResult[], results: BenchResult[], maxDropPct: number): string[] {
+    var failures = [];
+    for (var b of baseline) {
+        if (!results.find((r) => b.platform == r.platform && b.rom == r.rom)) {
+            failures.push(`${b.platform} ${b.rom || '(no rom)'}: missing`);
+        }
+    }
+    for (var r of results) {
+        var b = baseline.find((b) => b.platform == r.platform && b.rom == r.rom);
+        if (!b || !b.fps) continue;
+        var drop = (b.fps - r.fps) * 100 / b.fps;
+        if (drop > maxDropPct) {
+            failures.push(`${r.platform} ${r.rom || '(no rom)'}: ${b.fps} -> ${r.fps} fps (-${drop.toFixed(1)}%)`);
+        }
+    }
+    return failures;
+}
+
+function getOption(args: string[], name: string): string {
+    var i = args.indexOf(name);
+    if (i < 0) return null;
+    var val = args[i + 1];
+    args.splice(i, 2);
+    return val;
+}
+
+async function runBenchmarks() {
+    var args = process.argv.slice(2);
+    var frames = parseInt(getOption(args, '--frames')) || 600;
+    var jsonfile = getOption(args, '--json');
+    var basefile = getOption(args, '--baseline');
+    var maxDrop = parseFloat(getOption(args, '--max-drop') || '10');
+    var platforms = [];
+    var p;
+    while ((p = getOption(args, '--platform')) != null) platforms.push(p);
+    var jit = args.includes('--jit');
+    args = args.filter((a) => a != '--jit');
+    var romdir = args[0];
+    if (!platforms.length) platforms = Object.keys(BENCH_MACHINES);
+    var results: BenchResult[] = [];
+    var errors = 0;
+    for (var platform of platforms) {
+        if (!BENCH_MACHINES[platform]) throw new Error("Unknown platform: " + platform);
+        for (var rompath of listROMs(romdir, platform)) {
+            try {
+                var r = await benchROM(platform, rompath, frames, jit);
+                console.log(`${r.platform.padEnd(20)} ${(r.rom || '-').padEnd(24)} ${r.fps.toFixed(1).padStart(8)} fps ${(r.ips / 1e6).toFixed(2).padStart(7)} MIPS ${String(r.gcs).padStart(4)} GCs`);
+                results.push(r);
+            } catch (e) {
+                console.log(`ERROR: ${platform} ${rompath || '(no rom)'}: ${e}`);
+                errors++;
+            }
+        }
+    }
+    if (jsonfile) {
+        fs.writeFileSync(jsonfile, JSON.stringify(results, null, 2));
+    }
+    if (basefile) {
+        var baseline: BenchResult[] = JSON.parse(fs.readFileSync(basefile, 'utf-8'));
+        baseline = baseline.filter((b) => platforms.includes(b.platform));
+        var failures = compareResults(baseline, results, maxDrop);
+        for (var f of failures) console.log("REGRESSION: " + f);
+        if (failures.length) process.exit(1);
+    }
+    if (errors) process.exit(1);
+}
+
+if (require.main === module) {
+    runBenchmarks();
+}
@@ -0,0 +1,99 @@
+import fs from 'fs';
+import { getToolForFilename_6502, getToolForFilename_z80 } from "../common/baseplatform";
+import { parseIncludeDependencies, parseLinkDependencies } from "../common/dependencies";
+import { loadBuildWorker } from "./workerenv";
+
+// Compiles presets into a ROM set for benchmachine, with the build worker in this process.
+//
+//   node gen/tools/buildroms.js romdir [platform...]
+//
+// Writes <romdir>/<platform>/<preset>.bin, and exits with an error if any preset fails.
+
+const ROM_SET: { [platform: string]: [(fn: string) => string, string[]] } = {
+    'apple2': [getToolForFilename_6502, ['mandel.c', 'siegegame.c']],
+    'astrocade': [getToolForFilename_z80, ['rainbow.c', 'racing.c']],
+    'atari7800': [getToolForFilename_6502, ['sprites.c', 'scroll.c']],
+    'atari8-800': [getToolForFilename_6502, ['hello.dasm', 'hellopm.dasm']],
+    'coleco': [getToolForFilename_z80, ['stars.c', 'shoot.c']],
+    'exidy': [getToolForFilename_6502, ['minimal.c']],
+    'galaxian-scramble': [getToolForFilename_z80, ['gfxtest.c', 'shoot2.c']],
+    'msx': [getToolForFilename_z80, ['biostest.c', 'eliza.c']],
+    'mw8080bw': [getToolForFilename_z80, ['gfxtest.c', 'game2.c']],
+    'sms-sg1000-libcv': [getToolForFilename_z80, ['cursorsmooth.c', 'climber.c']],
+    'sms-sms-libcv': [getToolForFilename_z80, ['mode4test.c', 'climber.c']],
+    'vicdual': [getToolForFilename_z80, ['gfxtest.c', 'snake2.c']],
+};
+
+// files not in the preset directory (like system headers) come from the worker
+function readPresetFile(dir: string, fn: string) {
+    var path = dir + '/' + fn;
+    if (!fs.existsSync(path)) return null;
+    var data = fs.readFileSync(path);
+    return data.includes(0) ? new Uint8Array(data) : data.toString();
+}
+
+function makeBuildMessage(platform: string, dir: string, main: string, getTool: (fn: string) => string) {
+    var updates = [];
+    var depfiles = [];
+    var linkfiles = [];
+    var add = (fn: string, link: boolean) => {
+        if (fn == main || depfiles.includes(fn) || linkfiles.includes(fn)) return;
+        var data = readPresetFile(dir, fn);
+        if (data == null) return;
+        updates.push({ path: fn, data });
+        (link ? linkfiles : depfiles).push(fn);
+        if (typeof data === 'string') addAll(data);
+    };
+    var addAll = (text: string) => {
+        parseIncludeDependencies(text, false).forEach((fn) => add(fn, false));
+        parseLinkDependencies(text, false).forEach((fn) => add(fn, true));
+    };
+    var maintext = readPresetFile(dir, main);
+    if (maintext == null) throw new Error(`${dir}/${main} not found`);
+    updates.unshift({ path: main, data: maintext });
+    addAll(maintext as string);
+    var buildsteps = [{ path: main, files: [main].concat(depfiles), platform, tool: getTool(main), mainfile: true }];
+    for (var fn of linkfiles) {
+        buildsteps.push({ path: fn, files: [fn].concat(depfiles), platform, tool: getTool(fn), mainfile: false });
+    }
+    return { updates, buildsteps };
+}
+
+async function buildROMs() {
+    var [romdir, ...platforms] = process.argv.slice(2);
+    if (!romdir) throw new Error("Usage: buildroms romdir [platform...]");
+    if (!platforms.length) platforms = Object.keys(ROM_SET);
+    var send = await loadBuildWorker();
+    var failures = 0;
+    for (var platform of platforms) {
+        if (!ROM_SET[platform]) throw new Error("Unknown platform: " + platform);
+        var [getTool, presets] = ROM_SET[platform];
+        fs.mkdirSync(romdir + '/' + platform, { recursive: true });
+        for (var main of presets) {
+            var result;
+            try {
+                await send({ preload: getTool(main), platform });
+                await send({ reset: true });
+                var results = await send(makeBuildMessage(platform, 'presets/' + platform, main, getTool));
+                result = results[results.length - 1];
+            } catch (e) {
+                result = { errors: [{ path: main, line: 0, msg: e + '' }] };
+            }
+            if (result && result.output instanceof Uint8Array) {
+                var outpath = romdir + '/' + platform + '/' + main.replace(/\.\w+$/, '.bin');
+                fs.writeFileSync(outpath, result.output);
+                console.log(`${outpath}: ${result.output.length} bytes`);
+            } else {
+                var errors = result && result.errors || [];
+                console.log(`${platform} ${main}: build failed`);
+                for (var err of errors) console.log(`  ${err.path}:${err.line}: ${err.msg}`);
+                failures++;
+            }
+        }
+    }
+    if (failures) process.exit(1);
+}
+
+if (require.main === module) {
+    buildROMs();
+}
@@ -66,7 +66,8 @@ export class MachineRunner {
     constructor(machine: Machine) {
         this.machine = machine;
     }
-    setup() {
+    // (reset=false to load a ROM before resetting, some machines need video connected first)
+    setup(reset = true) {
         if (hasVideo(this.machine)) {
             var vid = this.machine.getVideoParams();
             this.pixels = new Uint32Array(vid.width * vid.height);
@@ -79,7 +80,7 @@ export class MachineRunner {
             this.serial = new SerialTestHarness();
             this.machine.connectSerialIO(this.serial);
         }
-        this.machine.reset();
+        if (reset) this.machine.reset();
     }
     run() {
         this.machine.advanceFrame(null);
@@ -95,6 +96,9 @@ async function loadMachine(modname: string, clsname: string): Promise<Machine> {
 
 async function runMachine() {
     var machine = await loadMachine(process.argv[2], process.argv[3]);
+    if (process.argv.includes('--jit') && machine['enableJIT']) {
+        machine['enableJIT'](true);
+    }
     var runner = new MachineRunner(machine);
     runner.setup();
     runner.run();
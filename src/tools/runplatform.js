@@ -181,6 +181,8 @@ function addRunStats(frame, ops) {
       case 0: // CLOCKS
         x += op & 0xffffff;
         break;
+      case 0x1a000000: // EXECUTE_READ
+        reads[op & 0xffff] = (op >> 16) & 0xff;
       case 0x01000000: // EXECUTE
         if (stat) {
           stat.insns++;
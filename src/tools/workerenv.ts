@@ -0,0 +1,128 @@
+// Runs the build worker (workermain) under Node, for tests and tools.
+// Emulates the worker globals it uses: importScripts, synchronous XHR,
+// FileReaderSync, fetch and postMessage, all reading from the repository.
+// NodeThreadWorker stands in for a Web Worker, using worker_threads.
+
+import * as fs from "fs";
+import * as path from "path";
+import * as vm from "vm";
+import { Worker as ThreadWorker } from "worker_threads";
+import { createRequire } from "module";
+
+// the worker bundle lives in gen/worker/, tools are fetched relative to it
+const WORKER_DIR = path.resolve('gen/worker') + '/';
+
+function resolveURL(url: string) {
+  url = url.replace(/^file:\/\//, '').split('?')[0];
+  return path.resolve(WORKER_DIR, url);
+}
+
+// emscripten's WORKERFS reads slices of a Blob with FileReaderSync
+class SyncBlob {
+  buf: Uint8Array;
+  size: number;
+  constructor(buf: Uint8Array) {
+    this.buf = buf;
+    this.size = buf.length;
+  }
+  slice(start: number, end: number) {
+    return new SyncBlob(this.buf.subarray(start, end));
+  }
+}
+
+class SyncXMLHttpRequest {
+  url: string;
+  responseType = '';
+  status = 0;
+  response: any = null;
+  responseText: string;
+  open(method: string, url: string) {
+    this.url = url;
+  }
+  send() {
+    let fn = resolveURL(this.url);
+    if (!fs.existsSync(fn)) {
+      this.status = 404;
+      return;
+    }
+    let buf = fs.readFileSync(fn);
+    this.status = 200;
+    switch (this.responseType) {
+      case 'json': this.response = JSON.parse(buf.toString()); break;
+      case 'blob': this.response = new SyncBlob(new Uint8Array(buf)); break;
+      case 'arraybuffer': this.response = buf.buffer.slice(buf.byteOffset, buf.byteOffset + buf.length); break;
+      default: this.response = this.responseText = buf.toString(); break;
+    }
+  }
+}
+
+// set up the globals before importing workermain
+export function setupWorkerGlobals(post: (msg: any) => void) {
+  let g = globalThis as any;
+  g.self = g;
+  g.location = { href: 'file://' + WORKER_DIR + 'bundle.js' };
+  g.require = createRequire(WORKER_DIR + 'bundle.js'); // for the emscripten modules
+  g.importScripts = (url: string) => {
+    vm.runInThisContext(fs.readFileSync(resolveURL(url), 'utf8'), { filename: url });
+  };
+  g.XMLHttpRequest = SyncXMLHttpRequest;
+  g.FileReaderSync = class {
+    readAsArrayBuffer(blob: SyncBlob) {
+      return blob.buf.buffer.slice(blob.buf.byteOffset, blob.buf.byteOffset + blob.buf.length);
+    }
+  };
+  g.fetch = async (url: string) => {
+    let fn = resolveURL(url + '');
+    if (!fs.existsSync(fn)) return new Response(null, { status: 404 });
+    return new Response(fs.readFileSync(fn));
+  };
+  g.postMessage = post;
+  g.onmessage = null;
+}
+
+// loads workermain in this thread, returns a function that sends it a message
+export async function loadBuildWorker(): Promise<(msg: any) => Promise<any[]>> {
+  let results = [];
+  setupWorkerGlobals((msg) => results.push(msg));
+  await import(path.resolve(__dirname, '../worker/workermain.js'));
+  let onmessage = (globalThis as any).onmessage;
+  return async (msg) => {
+    results = [];
+    await onmessage({ data: msg });
+    return results;
+  };
+}
+
+// a Web Worker running workermain in another thread (for BuildWorkerPool)
+export class NodeThreadWorker {
+  thread: ThreadWorker;
+  onmessage: (e: { data: any }) => void = null;
+  onerror: (e: { message: string }) => void = null;
+
+  constructor(url: string) {
+    let bootstrap = `
+      const { parentPort, workerData } = require('worker_threads');
+      (async () => {
+        const env = await import(workerData.env);
+        env.setupWorkerGlobals((msg) => parentPort.postMessage(msg));
+        await import(workerData.main);
+        parentPort.on('message', (data) => globalThis.onmessage({ data }));
+      })().catch((e) => { console.log(e); process.exit(1); });
+    `;
+    this.thread = new ThreadWorker(bootstrap, {
+      eval: true,
+      workerData: {
+        env: path.resolve(__dirname, 'workerenv.js'),
+        main: path.resolve(__dirname, '../worker/workermain.js'),
+      },
+    });
+    this.thread.on('message', (data) => this.onmessage && this.onmessage({ data }));
+    this.thread.on('error', (e) => this.onerror && this.onerror({ message: e.message }));
+  }
+  postMessage(msg: any) {
+    this.thread.postMessage(msg);
+  }
+  terminate() {
+    this.thread.terminate();
+  }
+}
@@ -0,0 +1,206 @@
+
+// Content-addressed cache of build step results
+// persists across store resets and sessions (IndexedDB in the browser, files under Node)
+
+import { hashData } from "../common/util";
+import { BuildStep, BuildStepResult, FileData, FileWorkingStore, getScannedDependencies } from "./builder";
+
+// bump when the format of cached entries (or tool output) changes
+const BUILD_CACHE_VERSION = 2;
+
+export interface BuildCacheEntry {
+  result: BuildStepResult
+  files: { path: string, data: FileData }[] // files written to the store by this step
+  params?: {} // platform params after the step (tools apply #define CFGFILE etc. to them)
+}
+
+export interface BuildCacheStorage {
+  get(key: string): Promise<BuildCacheEntry>;
+  put(key: string, entry: BuildCacheEntry): Promise<void>;
+  clear(): Promise<void>;
+}
+
+///
+
+export class MemoryCacheStorage implements BuildCacheStorage {
+  maxEntries: number = 256;
+  entries = new Map<string, BuildCacheEntry>();
+
+  async get(key: string) {
+    let entry = this.entries.get(key);
+    if (entry) {
+      // move to end of LRU order
+      this.entries.delete(key);
+      this.entries.set(key, entry);
+    }
+    return entry;
+  }
+  async put(key: string, entry: BuildCacheEntry) {
+    this.entries.delete(key);
+    this.entries.set(key, entry);
+    while (this.entries.size > this.maxEntries) {
+      this.entries.delete(this.entries.keys().next().value);
+    }
+  }
+  async clear() {
+    this.entries.clear();
+  }
+}
+
+export class IndexedDBCacheStorage implements BuildCacheStorage {
+  dbname: string;
+  db: Promise<IDBDatabase>;
+
+  constructor(dbname: string) {
+    this.dbname = dbname;
+  }
+  open(): Promise<IDBDatabase> {
+    if (!this.db) {
+      this.db = new Promise((resolve, reject) => {
+        let req = indexedDB.open(this.dbname, BUILD_CACHE_VERSION);
+        req.onupgradeneeded = () => {
+          let db = req.result;
+          if (db.objectStoreNames.contains('steps')) db.deleteObjectStore('steps');
+          db.createObjectStore('steps');
+        };
+        req.onsuccess = () => resolve(req.result);
+        req.onerror = () => reject(req.error);
+      });
+    }
+    return this.db;
+  }
+  async request<T>(mode: IDBTransactionMode, fn: (os: IDBObjectStore) => IDBRequest<T>): Promise<T> {
+    let db = await this.open();
+    return new Promise((resolve, reject) => {
+      let req = fn(db.transaction('steps', mode).objectStore('steps'));
+      req.onsuccess = () => resolve(req.result);
+      req.onerror = () => reject(req.error);
+    });
+  }
+  async get(key: string) {
+    return this.request('readonly', (os) => os.get(key));
+  }
+  async put(key: string, entry: BuildCacheEntry) {
+    await this.request('readwrite', (os) => os.put(entry, key));
+  }
+  async clear() {
+    await this.request('readwrite', (os) => os.clear());
+  }
+}
+
+// one file per entry, serialized with the v8 structured clone format
+export class NodeFileCacheStorage implements BuildCacheStorage {
+  dir: string;
+  fs;
+  v8;
+
+  constructor(dir: string) {
+    let getBuiltinModule = process['getBuiltinModule'];
+    this.fs = getBuiltinModule('fs');
+    this.v8 = getBuiltinModule('v8');
+    this.dir = dir;
+    this.fs.mkdirSync(dir, { recursive: true });
+  }
+  async get(key: string) {
+    try {
+      return this.v8.deserialize(await this.fs.promises.readFile(this.dir + '/' + key));
+    } catch (e) {
+      return null;
+    }
+  }
+  async put(key: string, entry: BuildCacheEntry) {
+    // write to temp file first so concurrent readers never see a partial entry
+    let path = this.dir + '/' + key;
+    let tmppath = path + '.' + process.pid;
+    await this.fs.promises.writeFile(tmppath, this.v8.serialize(entry));
+    await this.fs.promises.rename(tmppath, path);
+  }
+  async clear() {
+    for (let fn of await this.fs.promises.readdir(this.dir)) {
+      await this.fs.promises.unlink(this.dir + '/' + fn);
+    }
+  }
+}
+
+export function createDefaultCacheStorage(): BuildCacheStorage {
+  try {
+    if (typeof indexedDB !== 'undefined') {
+      return new IndexedDBCacheStorage('__buildcache');
+    }
+    if (typeof process !== 'undefined' && typeof process['getBuiltinModule'] === 'function') {
+      let env = process.env;
+      let os = process['getBuiltinModule']('os');
+      return new NodeFileCacheStorage(env.BUILD_CACHE_DIR || (os.tmpdir() + '/8bitworkshop-buildcache'));
+    }
+  } catch (e) {
+    console.log("build cache: falling back to memory", e);
+  }
+  return new MemoryCacheStorage();
+}
+
+///
+
+export class BuildCache {
+  memory = new MemoryCacheStorage();
+  storage: BuildCacheStorage;
+  hits = 0;
+  misses = 0;
+
+  constructor(storage: BuildCacheStorage) {
+    this.storage = storage;
+  }
+  // returns null if the step can't be cached (e.g. missing inputs)
+  computeKey(step: BuildStep, store: FileWorkingStore): string {
+    let files = getScannedDependencies(step) || step.files || (step.path && !step.code ? [step.path] : []);
+    let inputs = [];
+    for (let path of files) {
+      let entry = store.getFileEntry(path);
+      if (!entry) return null;
+      inputs.push([path, entry.encoding, hashData(entry.data)]);
+    }
+    let keydata = JSON.stringify([
+      BUILD_CACHE_VERSION,
+      step.tool,
+      step.platform,
+      step.path,
+      step.mainfile,
+      step.params,
+      step.args,
+      step.code != null ? hashData(step.code) : null,
+      inputs,
+      store.items,
+    ]);
+    return hashData(keydata) + hashData(keydata, keydata.length);
+  }
+  async get(key: string): Promise<BuildCacheEntry> {
+    let entry = await this.memory.get(key);
+    if (!entry) {
+      try {
+        entry = await this.storage.get(key);
+      } catch (e) {
+        console.log("build cache: get failed", e);
+      }
+      if (entry) this.memory.put(key, entry);
+    }
+    if (!entry) {
+      this.misses++;
+      return null;
+    }
+    this.hits++;
+    return structuredClone(entry);
+  }
+  async put(key: string, entry: BuildCacheEntry) {
+    // copy so later mutations of the result don't leak into the cache
+    entry = structuredClone(entry);
+    await this.memory.put(key, entry);
+    try {
+      await this.storage.put(key, entry);
+    } catch (e) {
+      console.log("build cache: put failed", e);
+    }
+  }
+  async clear() {
+    await this.memory.clear();
+    await this.storage.clear();
+  }
+}
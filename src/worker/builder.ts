@@ -1,7 +1,11 @@
 import { convertDataToUint8Array, getBasePlatform } from "../common/util";
 import { WorkerBuildStep, WorkerError, WorkerErrorResult, WorkerMessage, WorkerResult, WorkingStore } from "../common/workertypes";
+import { parseIncludeDependencies } from "../common/dependencies";
 import { PLATFORM_PARAMS } from "./platforms";
+import { BuildCache, createDefaultCacheStorage } from "./buildcache";
+import { BuildWorkerPool, SubBuildResult, createBuildWorkerPool } from "./workerpool";
 import { TOOLS } from "./workertools";
+import { fsMeta } from "./wasmutils";
 
 /// working file store and build steps
 
@@ -15,6 +19,8 @@ export type FileEntry = {
   encoding: string
   data: FileData
   ts: number
+  hash?: string // content hash supplied by the IDE
+  includes?: string[] // parsed include/incbin paths (see getIncludes())
 };
 
 export type BuildOptions = {
@@ -52,13 +58,16 @@ export interface BuildStep extends WorkerBuildStep {
 export class FileWorkingStore implements WorkingStore {
   workfs: { [path: string]: FileEntry } = {};
   workerseq: number = 0;
-  items: {};
+  items: {} = {};
+  written: string[] = null; // paths passed to putFile() while recording
+  builtKeys: { [step: string]: string } = {}; // cache key each step last ran (or replayed) with
 
   constructor() {
     this.reset();
   }
   reset() {
     this.workfs = {};
+    this.builtKeys = {};
     this.newVersion();
   }
   currentVersion() {
@@ -70,13 +79,20 @@ export class FileWorkingStore implements WorkingStore {
       ts = ++this.workerseq;
     return ts;
   }
-  putFile(path: string, data: FileData): FileEntry {
-    var encoding = (typeof data === 'string') ? 'utf8' : 'binary';
+  putFile(path: string, data: FileData, hash?: string): FileEntry {
     var entry = this.workfs[path];
+    // matching hash means the contents are unchanged, skip the compare
+    if (hash && entry && entry.hash == hash) {
+      if (this.written) this.written.push(path);
+      return entry;
+    }
+    var encoding = (typeof data === 'string') ? 'utf8' : 'binary';
     if (!entry || !compareData(entry.data, data) || entry.encoding != encoding) {
       this.workfs[path] = entry = { path: path, data: data, encoding: encoding, ts: this.newVersion() };
       console.log('+++', entry.path, entry.encoding, entry.data.length, entry.ts);
     }
+    if (hash) entry.hash = hash;
+    if (this.written) this.written.push(path);
     return entry;
   }
   hasFile(path: string) {
@@ -97,6 +113,51 @@ export class FileWorkingStore implements WorkingStore {
   setItem(key: string, value: object) {
     this.items[key] = value;
   }
+  // direct dependencies of a source file that exist in the store
+  getIncludes(path: string): string[] {
+    let entry = this.workfs[path];
+    if (!entry || typeof entry.data !== 'string') return [];
+    if (!entry.includes) {
+      let dir = path.lastIndexOf('/') > 0 ? path.substring(0, path.lastIndexOf('/') + 1) : '';
+      entry.includes = parseIncludePaths(entry.data).map((fn) => {
+        return (dir && this.workfs[dir + fn]) ? dir + fn : fn;
+      });
+    }
+    return entry.includes.filter((fn) => this.workfs[fn] != null);
+  }
+  // path plus everything it transitively includes
+  getDependencyClosure(path: string): string[] {
+    let seen = new Set<string>();
+    let stack = [path];
+    while (stack.length) {
+      let fn = stack.pop();
+      if (seen.has(fn) || !this.workfs[fn]) continue;
+      seen.add(fn);
+      stack.push(...this.getIncludes(fn));
+    }
+    return Array.from(seen);
+  }
+}
+
+// tools whose inputs are fully described by the include scan
+const DEPENDENCY_SCAN_TOOLS = new Set(['cc65', 'ca65', 'sdcc', 'sdasz80', 'cmoc', 'lwasm']);
+
+// returns the source file and its include closure, or null if the tool isn't scannable
+export function getScannedDependencies(step: BuildStep): string[] {
+  if (step.path && DEPENDENCY_SCAN_TOOLS.has(step.tool) && typeof store.getFileData(step.path) === 'string') {
+    return store.getDependencyClosure(step.path);
+  }
+  return null;
+}
+
+// unique include paths, scanned the same way as the IDE
+export function parseIncludePaths(text: string): string[] {
+  return Array.from(new Set(parseIncludeDependencies(text, false)));
+}
+
+// a step's identity across builds, whatever its inputs (link steps have no path)
+function getStepId(step: BuildStep): string {
+  return step.tool + ':' + (step.path || (step.files || []).join(' '));
 }
 
 export var store = new FileWorkingStore();
@@ -110,15 +171,38 @@ export function errorResult(msg: string): WorkerErrorResult {
 export class Builder {
   steps: BuildStep[] = [];
   startseq: number = 0;
+  cache: BuildCache = new BuildCache(createDefaultCacheStorage());
+  pool: BuildWorkerPool = createBuildWorkerPool();
+  deferLink = false; // sub-worker: return the link step instead of running it
+  deferredLinkStep: BuildStep = null;
+  buildGen = 0;  // generation of the running build
+  latestGen = 0; // newest generation received, set as messages arrive
+
+  // a newer build arrived, so the running one can stop
+  isSuperseded(): boolean {
+    return this.buildGen < this.latestGen;
+  }
 
   // returns true if file changed during this build step
   wasChanged(entry: FileEntry): boolean {
     return entry.ts > this.startseq;
   }
+  // independent top-level steps (one per translation unit) can go to the pool
+  canRunParallel(): boolean {
+    return this.pool != null && !this.deferLink && this.steps.length > 1
+      && this.steps.every((step) => step.tool.indexOf(':') < 0);
+  }
   async executeBuildSteps(): Promise<WorkerResult> {
     this.startseq = store.currentVersion();
     var linkstep: BuildStep = null;
+    if (this.canRunParallel()) {
+      let result = await this.executeParallelSteps();
+      if (result || this.isSuperseded()) return result;
+    }
     while (this.steps.length) {
+      // let newer messages arrive (tools run synchronously), drop this build if superseded
+      await yieldToMessages();
+      if (this.isSuperseded()) return null;
       var step = this.steps.shift(); // get top of array
       var platform = step.platform;
       var [tool, remoteTool] = step.tool.split(':', 2);
@@ -131,7 +215,7 @@ export class Builder {
       }
       step.params = PLATFORM_PARAMS[getBasePlatform(platform)];
       try {
-        step.result = await toolfn(step);
+        step.result = await this.executeStepCached(step, toolfn, !remoteTool);
       } catch (e) {
         console.log("EXCEPTION", e, e.stack);
         return errorResult(e + ""); // TODO: catch errors already generated?
@@ -179,17 +263,130 @@ export class Builder {
         }
         // process final step?
         if (this.steps.length == 0 && linkstep) {
-          this.steps.push(linkstep);
+          if (this.deferLink)
+            this.deferredLinkStep = linkstep;
+          else
+            this.steps.push(linkstep);
           linkstep = null;
         }
       }
     }
   }
+  // compile each step's chain on a sub-worker, then queue one merged link step
+  async executeParallelSteps(): Promise<WorkerResult> {
+    let steps = this.steps;
+    this.steps = [];
+    let params = PLATFORM_PARAMS[getBasePlatform(steps[0].platform)];
+    let sentParams = structuredClone(params);
+    let subresults: SubBuildResult[];
+    try {
+      let preloadfs = Object.keys(fsMeta);
+      subresults = await Promise.all(steps.map((step) => {
+        // sub-workers start from this worker's params (e.g. after #define CFGFILE)
+        step.params = params;
+        return this.pool.execute(step, store, preloadfs);
+      }));
+    } catch (e) {
+      console.log("EXCEPTION", e);
+      return errorResult(e + "");
+    }
+    // a newer build arrived while the sub-workers ran, skip the merge and link
+    if (this.isSuperseded()) return null;
+    let linkstep: BuildStep = null;
+    // merge in original step order, so link order matches a serial build
+    for (let sub of subresults) {
+      for (let f of sub.files) store.putFile(f.path, f.data);
+      // keep only what each step changed, as if the steps ran in turn
+      for (let key in sub.params) {
+        if (JSON.stringify(sub.params[key]) !== JSON.stringify(sentParams[key]))
+          params[key] = sub.params[key];
+      }
+      if (sub.result) return sub.result;
+      if (sub.linkstep) {
+        if (linkstep) {
+          linkstep.files = linkstep.files.concat(sub.linkstep.files);
+          linkstep.args = linkstep.args.concat(sub.linkstep.args);
+          linkstep.debuginfo = sub.linkstep.debuginfo;
+        } else {
+          linkstep = sub.linkstep;
+        }
+      }
+    }
+    if (linkstep) this.steps.push(linkstep);
+  }
+  // run a single step chain for a coordinating worker (see workerpool.ts)
+  async executeSubStep(step: BuildStep): Promise<SubBuildResult> {
+    if (step.params) Object.assign(PLATFORM_PARAMS[getBasePlatform(step.platform)], step.params);
+    this.steps = [step];
+    this.deferLink = true;
+    this.deferredLinkStep = null;
+    store.written = [];
+    try {
+      var result = await this.executeBuildSteps();
+      var written = store.written;
+    } finally {
+      this.deferLink = false;
+      store.written = null;
+    }
+    let linkstep = this.deferredLinkStep;
+    this.deferredLinkStep = null;
+    // last write wins
+    let paths = Array.from(new Set(written));
+    return {
+      result,
+      linkstep,
+      params: PLATFORM_PARAMS[getBasePlatform(step.platform)],
+      files: paths.map((path) => ({ path, data: store.getFileData(path) })),
+    };
+  }
+  // run a tool, or replay its result and output files from the build cache
+  async executeStepCached(step: BuildStep, toolfn, cacheable: boolean): Promise<BuildStepResult> {
+    let key = (cacheable && this.cache) ? this.cache.computeKey(step, store) : null;
+    if (key) {
+      let entry = await this.cache.get(key);
+      if (entry) {
+        console.log("cache hit", step.tool, step.path, key);
+        for (let f of entry.files) store.putFile(f.path, f.data);
+        // the tool didn't run, so replay its changes to the params (e.g. cfgfile for ld65)
+        if (entry.params && step.params) Object.assign(step.params, entry.params);
+        // output from the same inputs as this step's last build: the tool would
+        // find its targets up to date and return "unchanged" (see anyTargetChanged)
+        let stepid = getStepId(step);
+        if (store.builtKeys[stepid] == key && 'output' in entry.result) return undefined;
+        store.builtKeys[stepid] = key;
+        return entry.result;
+      }
+    }
+    let outer = store.written;
+    store.written = [];
+    try {
+      var result = await toolfn(step);
+      var written = store.written;
+    } finally {
+      store.written = outer;
+    }
+    if (outer) outer.push(...written);
+    // don't cache "unchanged" (no result) or errors
+    if (key && result && !('errors' in result && result.errors.length)) {
+      let files = written.map((path) => ({ path, data: store.getFileData(path) }));
+      await this.cache.put(key, { result, files, params: step.params });
+    }
+    if (key) store.builtKeys[getStepId(step)] = key;
+    return result;
+  }
   async handleMessage(data: WorkerMessage): Promise<WorkerResult> {
     this.steps = [];
-    // file updates
+    this.buildGen = data.gen != null ? data.gen : this.latestGen;
+    // file updates (data is omitted if the IDE thinks we have it)
     if (data.updates) {
-      data.updates.forEach((u) => store.putFile(u.path, u.data));
+      let missing = [];
+      for (let u of data.updates) {
+        if (u.data == null && store.getFileEntry(u.path)?.hash != u.hash)
+          missing.push(u.path);
+        else
+          store.putFile(u.path, u.data, u.hash);
+      }
+      if (missing.length) return { resend: missing };
     }
     // object update
     if (data.setitems) {
@@ -203,17 +400,30 @@ export class Builder {
     if (data.code) {
       this.steps.push(data as BuildStep); // TODO: remove cast
     }
-    // execute build steps
+    // execute build steps (files above are kept even if superseded)
     if (this.steps.length) {
       var result = await this.executeBuildSteps();
+      if (this.isSuperseded()) return null;
       return result ? result : { unchanged: true };
     }
-    // TODO: cache results
     // message not recognized
     console.log("Unknown message", data);
   }
 }
 
+// resolves after messages that are already queued have been dispatched
+function yieldToMessages(): Promise<void> {
+  return new Promise((resolve) => {
+    if (typeof setImmediate === 'function') {
+      setImmediate(resolve); // Node
+    } else {
+      let ch = new MessageChannel();
+      ch.port1.onmessage = () => resolve();
+      ch.port2.postMessage(null);
+    }
+  });
+}
+
 function applyDefaultErrorPath(errors: WorkerError[], path: string) {
   if (!path) return;
   for (var i = 0; i < errors.length; i++) {
@@ -303,6 +513,15 @@ export function gatherFiles(step: BuildStep, options?: BuildOptions): number {
   if (step.path && !step.prefix) {
     step.prefix = getPrefix(step.path);
   }
+  // only the files this translation unit actually includes decide staleness,
+  // not every header the main file pulled into step.files
+  let deps = getScannedDependencies(step);
+  if (deps) {
+    maxts = 0;
+    for (let fn of deps) {
+      maxts = Math.max(maxts, store.workfs[fn].ts);
+    }
+  }
   step.maxts = maxts;
   return maxts;
 }
@@ -321,6 +540,66 @@ export function populateFiles(step: BuildStep, fs, options?: BuildOptions) {
   }
 }
 
+// library files fetched ahead of time, keyed by path under PWORKER
+var prefetchedFiles: { [xpath: string]: Uint8Array } = {};
+
+// cached copies are revalidated (ETag / Last-Modified) on each fetch
+const LIB_CACHE_NAME = '8bitworkshop-lib-v1';
+
+export function getExtraFilePath(platform: string, xfn: string): string {
+  var basePlatform = getBasePlatform(platform);
+  // Special case: msx-shell uses msx runtime files
+  if (basePlatform === 'msx-shell') {
+    basePlatform = 'msx';
+  }
+  // Special case: zxspectrum uses zx runtime files
+  if (basePlatform === 'zxspectrum') {
+    basePlatform = 'zx';
+  }
+  return "lib/" + basePlatform + "/" + xfn;
+}
+
+export async function fetchExtraFile(xpath: string): Promise<Uint8Array> {
+  var url = new URL(PWORKER + xpath, self.location.href).href;
+  var cache = typeof caches !== 'undefined' ? await caches.open(LIB_CACHE_NAME) : null;
+  var cached = cache && await cache.match(url);
+  var headers = {};
+  if (cached) {
+    var etag = cached.headers.get('ETag');
+    var modified = cached.headers.get('Last-Modified');
+    if (etag) headers['If-None-Match'] = etag;
+    if (modified) headers['If-Modified-Since'] = modified;
+  }
+  try {
+    var response = await fetch(url, { headers: headers, cache: 'no-store' });
+  } catch (e) {
+    if (cached) return new Uint8Array(await cached.arrayBuffer()); // offline
+    throw e;
+  }
+  if (cached && response.status == 304) {
+    return new Uint8Array(await cached.arrayBuffer());
+  }
+  if (!response.ok) throw Error("Could not load extra file " + xpath);
+  if (cache) await cache.put(url, response.clone());
+  return new Uint8Array(await response.arrayBuffer());
+}
+
+// fetch all extra compile/link files for a platform in parallel
+export async function prefetchExtraFiles(platform: string) {
+  var params = PLATFORM_PARAMS[getBasePlatform(platform)];
+  if (!params) return;
+  var xfns = [].concat(params.extra_compile_files || [], params.extra_link_files || []);
+  await Promise.all(xfns.map(async (xfn) => {
+    var xpath = getExtraFilePath(platform, xfn);
+    if (prefetchedFiles[xpath]) return;
+    try {
+      prefetchedFiles[xpath] = await fetchExtraFile(xpath);
+    } catch (e) {
+      console.log("prefetch failed", xpath, e); // populateExtraFiles() will retry
+    }
+  }));
+}
+
 export function populateExtraFiles(step: BuildStep, fs, extrafiles) {
   if (extrafiles) {
     for (var i = 0; i < extrafiles.length; i++) {
@@ -330,29 +609,23 @@ export function populateExtraFiles(step: BuildStep, fs, extrafiles) {
         fs.writeFile(xfn, store.workfs[xfn].data, { encoding: 'binary' });
         continue;
       }
-      // fetch from network
-      var basePlatform = getBasePlatform(step.platform);
-      // Special case: msx-shell uses msx runtime files
-      if (basePlatform === 'msx-shell') {
-        basePlatform = 'msx';
-      }
-      // Special case: zxspectrum uses zx runtime files
-      if (basePlatform === 'zxspectrum') {
-        basePlatform = 'zx';
-      }
-      var xpath = "lib/" + basePlatform + "/" + xfn;
-      var xhr = new XMLHttpRequest();
-      xhr.responseType = 'arraybuffer';
-      xhr.open("GET", PWORKER + xpath, false);  // synchronous request
-      xhr.send(null);
-      if (xhr.response && xhr.status == 200) {
-        var data = new Uint8Array(xhr.response);
-        fs.writeFile(xfn, data, { encoding: 'binary' });
-        putWorkFile(xfn, data);
-        console.log(":::", xfn, data.length);
-      } else {
-        throw Error("Could not load extra file " + xpath);
+      var xpath = getExtraFilePath(step.platform, xfn);
+      var data = prefetchedFiles[xpath];
+      if (!data) {
+        // not prefetched, fetch from network
+        var xhr = new XMLHttpRequest();
+        xhr.responseType = 'arraybuffer';
+        xhr.open("GET", PWORKER + xpath, false);  // synchronous request
+        xhr.send(null);
+        if (xhr.response && xhr.status == 200) {
+          data = new Uint8Array(xhr.response);
+        } else {
+          throw Error("Could not load extra file " + xpath);
+        }
       }
+      fs.writeFile(xfn, data, { encoding: 'binary' });
+      putWorkFile(xfn, data);
+      console.log(":::", xfn, data.length);
     }
   }
 }
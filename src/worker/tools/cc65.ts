@@ -3,7 +3,7 @@ import { getRootBasePlatform } from "../../common/util";
 import { CodeListingMap, WorkerError } from "../../common/workertypes";
 import { BuildStep, BuildStepResult, gatherFiles, staleFiles, populateFiles, fixParamsWithDefines, putWorkFile, populateExtraFiles, store, populateEntry, anyTargetChanged, processEmbedDirective } from "../builder";
 import { re_crlf, makeErrorMatcher } from "../listingutils";
-import { loadNative, moduleInstFn, print_fn, setupFS, execMain, emglobal, EmscriptenModule } from "../wasmutils";
+import { loadNative, moduleInstFn, print_fn, setupFS, execMain, emglobal, EmscriptenModule, probeToolVersion } from "../wasmutils";
 import { TOOL_PRELOADFS } from "../workertools";
 
 
@@ -117,37 +117,7 @@ export function assembleCA65(step: BuildStep): BuildStepResult {
         loadNative('ca65');
     }
     var errors = [];
-    
-    // Check ca65 version first
-    console.log("=== CA65 VERSION CHECK ===");
-    var CA65_VERSION: EmscriptenModule = emglobal.ca65({
-        instantiateWasm: moduleInstFn('ca65'),
-        noInitialRun: true,
-        print: (s) => console.log("ca65 version:", s),
-        printErr: (s) => console.log("ca65 version error:", s),
-    });
-    var FS_VERSION = CA65_VERSION.FS;
-    setupFS(FS_VERSION, '65-' + getRootBasePlatform(step.platform));
-    
-    // Create a simple version check step
-    var versionStep = {
-        path: 'version_check',
-        mainfile: false,
-        platform: step.platform,
-        tool: 'ca65',
-        args: [],
-        input: '',
-        output: '',
-        defines: [],
-        includes: [],
-        extraFiles: [],
-        params: {},
-        prefix: 'version_check'
-    };
-    
-    execMain(versionStep, CA65_VERSION, ['--version']);
-    console.log("=== END CA65 VERSION CHECK ===");
-    
+    probeToolVersion('ca65', null);
     gatherFiles(step, { mainFilePath: "main.s" });
     var objpath = step.prefix + ".o";
     var lstpath = step.prefix + ".lst";
@@ -418,50 +388,7 @@ export function compileCC65(step: BuildStep): BuildStepResult {
         }
     }
     
-    // Check cc65 version first
-    console.log("=== CC65 VERSION CHECK ===");
-    // Use BBC-specific WASM modules for BBC platform
-    var moduleName = step.platform === 'bbc' ? 'cc65-bbc' : 'cc65';
-    console.log("Using module:", moduleName, "Available modules:", Object.keys(emglobal));
-    console.log("emglobal contents:", emglobal);
-    
-    // Try to use the specific module, fallback to standard if not available
-    var moduleFunc = emglobal[moduleName];
-    console.log("moduleFunc for", moduleName, ":", moduleFunc);
-    if (!moduleFunc) {
-        console.log("BBC-specific module not available, falling back to standard cc65");
-        moduleName = 'cc65';
-        moduleFunc = emglobal.cc65;
-        console.log("Fallback moduleFunc:", moduleFunc);
-    }
-    
-    var CC65_VERSION: EmscriptenModule = moduleFunc({
-        instantiateWasm: moduleInstFn(moduleName),
-        noInitialRun: true,
-        print: (s) => console.log("cc65 version:", s),
-        printErr: (s) => console.log("cc65 version error:", s),
-    });
-    var FS_VERSION = CC65_VERSION.FS;
-    setupFS(FS_VERSION, '65-' + getRootBasePlatform(step.platform));
-    
-    // Create a simple version check step
-    var versionStep = {
-        path: 'version_check',
-        mainfile: false,
-        platform: step.platform,
-        tool: 'cc65',
-        args: [],
-        input: '',
-        output: '',
-        defines: [],
-        includes: [],
-        extraFiles: [],
-        params: {},
-        prefix: 'version_check'
-    };
-    
-    execMain(versionStep, CC65_VERSION, ['--version']);
-    console.log("=== END CC65 VERSION CHECK ===");
+    probeToolVersion(emglobal[moduleName] ? moduleName : 'cc65', null);
     gatherFiles(step, { mainFilePath: "main.c" });
     var destpath = step.prefix + '.s';
     if (staleFiles(step, [destpath])) {
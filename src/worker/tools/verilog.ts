@@ -7,6 +7,7 @@ import * as vxmlparser from '../../common/hdl/vxmlparser';
 import { EmscriptenModule, emglobal, execMain, getWASMMemory, loadNative, moduleInstFn, print_fn, setupFS } from "../wasmutils";
 import { getWorkFileAsString, BuildStep, BuildStepResult, gatherFiles, staleFiles, populateFiles, starttime, endtime, putWorkFile, anyTargetChanged, populateExtraFiles } from "../builder";
 import { makeErrorMatcher } from "../listingutils";
+import { hashData } from "../../common/util";
 
 function detectModuleName(code: string) {
     var m = /^\s*module\s+(\w+_top)\b/m.exec(code)
@@ -189,6 +190,7 @@ export function compileVerilator(step: BuildStep): BuildStepResult {
             if (!anyTargetChanged(step, [xmlPath]))
                 return;
             xmlParser.parse(xmlContent);
+            xmlParser.hash = hashData(xmlContent);
         } catch (e) {
             console.log(e, e.stack);
             if (e.$loc != null) {
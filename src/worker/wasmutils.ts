@@ -143,6 +143,9 @@ export function loadNative(modulename: string) {
   }
 }
 
+// decoded file contents for each mounted filesystem, shared by all module instances
+var fsBlobCache: { [name: string]: { [path: string]: Uint8Array } } = {};
+
 // mount the filesystem at /share
 export function setupFS(FS, name: string) {
   var WORKERFS = FS.filesystems['WORKERFS'];
@@ -162,7 +165,7 @@ export function setupFS(FS, name: string) {
   // https://github.com/kripken/emscripten/blob/incoming/src/library_workerfs.js
   // https://bugs.chromium.org/p/chromium/issues/detail?id=349304#c30
   var reader = WORKERFS.reader;
-  var blobcache = {};
+  var blobcache = fsBlobCache[name] || (fsBlobCache[name] = {});
   WORKERFS.stream_ops.read = function (stream, buffer, offset, length, position) {
     if (position >= stream.node.size) return 0;
     var contents = blobcache[stream.path];
@@ -179,6 +182,32 @@ export function setupFS(FS, name: string) {
   };
 }
 
+// tool version strings, probed once per worker lifetime
+var toolVersions: { [modulename: string]: string } = {};
+
+// run a tool with version args in a throwaway instance, returns its output
+export function probeToolVersion(modulename: string, fsname: string, args?: string[]): string {
+  var version = toolVersions[modulename];
+  if (version == null) {
+    var lines = [];
+    var mod: EmscriptenModule = emglobal[modulename]({
+      instantiateWasm: moduleInstFn(modulename),
+      noInitialRun: true,
+      print: (s) => lines.push(s),
+      printErr: (s) => lines.push(s),
+    });
+    if (fsname) setupFS(mod.FS, fsname);
+    try {
+      mod.callMain(args || ['--version']);
+    } catch (e) {
+      lines.push(e + "");
+    }
+    version = toolVersions[modulename] = lines.join('\n').trim();
+    console.log(modulename, "version:", version);
+  }
+  return version;
+}
+
 export var print_fn = function (s: string) {
   console.log(s);
   //console.log(new Error().stack);
@@ -2,7 +2,7 @@
 import type { WorkerResult, WorkerMessage, WorkerError, SourceLine } from "../common/workertypes";
 import { getBasePlatform, getRootBasePlatform } from "../common/util";
 import { TOOL_PRELOADFS, TOOLS } from "./workertools";
-import { store, builder, errorResult, getWorkFileAsString } from "./builder";
+import { store, builder, errorResult, getWorkFileAsString, prefetchExtraFiles } from "./builder";
 import { emglobal, fsMeta, loadFilesystem } from "./wasmutils";
 import { compileC64Basic } from "./tools/c64basic";
 import { C64BasicTokenizer } from "../common/basic/c64tokenizer";
@@ -41,11 +41,26 @@ async function handleMessage(data: WorkerMessage): Promise<WorkerResult> {
       fs = TOOL_PRELOADFS[data.preload + '-' + getRootBasePlatform(data.platform)];
     if (fs && !fsMeta[fs])
       loadFilesystem(fs);
+    // the next build message waits for this
+    if (data.platform)
+      await prefetchExtraFiles(data.platform);
     return;
   }
+  // compile one step for a coordinating worker
+  if (data.substep) {
+    if (data.reset) store.reset();
+    for (let fs of data.preloadfs || []) {
+      if (!fsMeta[fs]) loadFilesystem(fs);
+    }
+    await prefetchExtraFiles(data.substep.platform);
+    data.setitems?.forEach((i) => store.setItem(i.key, i.value));
+    data.updates.forEach((u) => store.putFile(u.path, u.data));
+    return builder.executeSubStep(data.substep) as any;
+  }
   // clear filesystem? (TODO: buildkey)
   if (data.reset) {
     store.reset();
+    builder.pool?.reset();
     return;
   }
   return builder.handleMessage(data);
@@ -53,13 +68,20 @@ async function handleMessage(data: WorkerMessage): Promise<WorkerResult> {
 
 const ENVIRONMENT_IS_WORKER = typeof importScripts === 'function';
 if (ENVIRONMENT_IS_WORKER) {
-  var lastpromise = null;
+  var lastpromise : Promise<any> = null;
   onmessage = async function (e) {
-    await lastpromise; // wait for previous message to complete
-    lastpromise = handleMessage(e.data);
-    var result = await lastpromise;
-    lastpromise = null;
+    // a newer build cancels the running one at its next step
+    if (e.data.gen > builder.latestGen) builder.latestGen = e.data.gen;
+    // wait for previous messages to complete
+    var prev = lastpromise;
+    var promise = lastpromise = (async () => {
+      await prev?.catch(() => null);
+      return handleMessage(e.data);
+    })();
+    var result = await promise;
+    if (lastpromise === promise) lastpromise = null;
     if (result) {
+      if (e.data.gen != null) result.gen = e.data.gen;
       try {
         postMessage(result);
       } catch (e) {
@@ -0,0 +1,110 @@
+
+// Pool of sub-workers that run independent compile/assemble steps in parallel
+// each sub-worker keeps its own replica of the working store
+
+import type { WorkerFileUpdate, WorkerItemUpdate } from "../common/workertypes";
+import type { BuildStep, FileData, FileWorkingStore } from "./builder";
+
+export interface SubBuildResult {
+  result?: any          // errors or output, if the step didn't end in a link tool
+  linkstep?: BuildStep  // partial link step, to be merged by the coordinator
+  params?: {}           // platform params after the step (e.g. #define CFGFILE)
+  files: { path: string, data: FileData }[] // files written to the sub-worker's store
+}
+
+class SubWorker {
+  worker: Worker;
+  syncseq = 0;        // newest store version already sent
+  needsReset = true;
+  reserved = false;   // set by acquire(), before any await
+  busy: (r: SubBuildResult) => void = null;
+  fail: (e: any) => void = null;
+
+  constructor(url: string) {
+    this.worker = new Worker(url);
+    this.worker.onmessage = (e) => {
+      let done = this.busy;
+      this.busy = this.fail = null;
+      if (done) done(e.data);
+    };
+    this.worker.onerror = (e) => {
+      let fail = this.fail;
+      this.busy = this.fail = null;
+      if (fail) fail(new Error("build sub-worker: " + e.message));
+    };
+  }
+}
+
+export class BuildWorkerPool {
+  url: string;
+  size: number;
+  workers: SubWorker[] = [];
+  waiting: (() => void)[] = [];
+
+  constructor(url: string, size: number) {
+    this.url = url;
+    this.size = size;
+  }
+  // discard replicas after the coordinator's store is reset
+  reset() {
+    this.workers.forEach((w) => { w.needsReset = true; w.syncseq = 0; });
+  }
+  async acquire(): Promise<SubWorker> {
+    for (;;) {
+      let w = this.workers.find((w) => !w.reserved);
+      if (!w && this.workers.length < this.size) {
+        w = new SubWorker(this.url);
+        this.workers.push(w);
+      }
+      if (w) {
+        w.reserved = true;
+        return w;
+      }
+      await new Promise<void>((resolve) => this.waiting.push(resolve));
+    }
+  }
+  // preloadfs: filesystems the coordinator has loaded, the sub-worker loads any it lacks
+  async execute(step: BuildStep, store: FileWorkingStore, preloadfs: string[]): Promise<SubBuildResult> {
+    let w = await this.acquire();
+    // send files newer than the replica
+    let updates: WorkerFileUpdate[] = [];
+    let maxts = w.syncseq;
+    for (let path in store.workfs) {
+      let entry = store.workfs[path];
+      if (entry.ts > w.syncseq) {
+        updates.push({ path, data: entry.data });
+        maxts = Math.max(maxts, entry.ts);
+      }
+    }
+    let setitems: WorkerItemUpdate[] = Object.entries(store.items).map(([key, value]) => ({ key, value }));
+    let msg = { substep: step, updates, setitems, preloadfs, reset: w.needsReset };
+    w.syncseq = maxts;
+    w.needsReset = false;
+    try {
+      return await new Promise<SubBuildResult>((resolve, reject) => {
+        w.busy = resolve;
+        w.fail = reject;
+        w.worker.postMessage(msg);
+      });
+    } catch (e) {
+      // replica state is unknown after a crash
+      w.worker.terminate();
+      this.workers.splice(this.workers.indexOf(w), 1);
+      throw e;
+    } finally {
+      w.reserved = false;
+      let next = this.waiting.shift();
+      if (next) next();
+    }
+  }
+}
+
+declare function importScripts(path: string);
+
+// only nested workers can spawn sub-workers
+export function createBuildWorkerPool(): BuildWorkerPool {
+  if (typeof importScripts !== 'function' || typeof Worker === 'undefined') return null;
+  let size = Math.min(4, (navigator.hardwareConcurrency || 2) - 1);
+  if (size < 2) return null;
+  return new BuildWorkerPool(self.location.href, size);
+}